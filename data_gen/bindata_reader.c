@@ -9,8 +9,15 @@
 #include <unistd.h>
 #endif
 #include <errno.h>
+#include <threads.h>
 
 #include "haversine.h"
+#include "pair_file.h"
+#include "pair_soa.h"
+#include "pair_order.h"
+#include "float_sum.h"
+#include "pair_answers.h"
+#include "rdtsc_utils.h"
 
 #define MY_ERROR(...) {                    \
         fprintf(stderr, "[%d]", __LINE__);      \
@@ -20,23 +27,284 @@
 
 #define APPROX_EARTH_RADIUS     6372.8
 
+enum profile_blocks_e {
+    BLOCK_OPEN,
+    BLOCK_CHECKSUM,
+    BLOCK_VERIFY,
+    BLOCK_SUM,
+    BLOCK_DEQUANTIZE,
+    BLOCK_DECOMPRESS,
+};
+
+/*
+ * Rows are verified in parallel, each thread owns a contiguous range of
+ * VERIFY_BLOCK_ROWS blocks and recomputes the distances VERIFY_BATCH_ROWS
+ * at a time with the lane based haversine_soa kernel, which is bit identical
+ * to ReferenceHaversine. SoA files are used straight from the mapping, AoS
+ * rows are first gathered into per thread column buffers.
+ * Every thread keeps the first max_report mismatches of its range, since the
+ * ranges are in row order the first max_report of all threads together are
+ * the first max_report of the file.
+ * Q32 files have no distance column, their rows are dequantized and the
+ * distances kept so the sum can be checked against the header.
+ * Compressed files are split on their own blocks, every thread decodes its
+ * blocks into a private block buffer and the batches point into it.
+ * With -c every thread also checks its rows against the binary answers of
+ * the data_gen answer file, block by block, and the checks are merged in
+ * thread order so the first divergent block of the file is reported.
+ */
+#define VERIFY_BLOCK_ROWS       PAIR_FILE_BLOCK_ROWS
+#define VERIFY_BATCH_ROWS       1024
+#define DEFAULT_MAX_REPORT      10
+
+struct mismatch {
+    uint64_t row;
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+    double expected;
+    double calculated;
+};
+
+struct verify_job {
+    const struct pair_file *pairs;
+    uint64_t first_row;
+    uint64_t last_row;      // exclusive
+    struct mismatch *mismatches;
+    int max_report;
+    uint64_t mismatch_count;
+    double *distances;          // Q32 and compressed files, one per row of the file
+    uint64_t dequantize_ticks;
+    uint64_t decompress_ticks;
+    struct pair_answer_check check;
+};
+
+int max_report = DEFAULT_MAX_REPORT;
+int thread_count = 1;
+struct pair_answers *answers = NULL;
+
+int verify_thread(void *arg) {
+    struct verify_job *job = (struct verify_job *)arg;
+    const struct pair_file *pairs = job->pairs;
+    bool compressed = pairs->header.compression == PAIR_COMPRESSION_BLOCKS;
+    double x0[VERIFY_BATCH_ROWS], y0[VERIFY_BATCH_ROWS], x1[VERIFY_BATCH_ROWS], y1[VERIFY_BATCH_ROWS];
+    double calculated[VERIFY_BATCH_ROWS];
+    struct pair_file_block_buffer buffer = {};
+
+    if (compressed) {
+        pair_file_block_buffer_init(pairs, &buffer);
+    }
+
+    for (uint64_t start=job->first_row; start<job->last_row; ) {
+        size_t n = job->last_row - start < VERIFY_BATCH_ROWS ? job->last_row - start : VERIFY_BATCH_ROWS;
+        struct pair_soa batch = { .count = n, .capacity = n };
+        // x0, y0, x1, y1 and the stored distance of the batch rows, value i at [i*stride]
+        const double *columns[PAIR_FILE_COLUMNS];
+        const int32_t *q[4];
+        size_t stride = pairs->stride;
+
+        if (compressed) {
+            uint64_t start_ticks = GET_CPU_TICKS();
+            pair_file_load_block(pairs, &buffer, start);
+            job->decompress_ticks += GET_CPU_TICKS() - start_ticks;
+            // batches never cross a block
+            size_t at = start - buffer.first_row;
+            n = buffer.rows - at < n ? buffer.rows - at : n;
+            batch.count = batch.capacity = n;
+            if (pairs->header.layout == PAIR_LAYOUT_Q32) {
+                for (int c=0; c<4; c++) {
+                    q[c] = (const int32_t *)buffer.columns + c*buffer.rows + at;
+                }
+            } else {
+                for (int c=0; c<PAIR_FILE_COLUMNS; c++) {
+                    columns[c] = (const double *)buffer.columns + c*buffer.rows + at;
+                }
+            }
+        } else if (pairs->header.layout == PAIR_LAYOUT_Q32) {
+            q[0] = &pairs->qx0[start];
+            q[1] = &pairs->qy0[start];
+            q[2] = &pairs->qx1[start];
+            q[3] = &pairs->qy1[start];
+        } else {
+            columns[0] = &pairs->x0[start * stride];
+            columns[1] = &pairs->y0[start * stride];
+            columns[2] = &pairs->x1[start * stride];
+            columns[3] = &pairs->y1[start * stride];
+            columns[4] = &pairs->haversine[start * stride];
+        }
+
+        if (pairs->header.layout == PAIR_LAYOUT_Q32) {
+            uint64_t start_ticks = GET_CPU_TICKS();
+            double step = pairs->header.coordinate_step;
+            pair_file_dequantize(q[0], n, step, x0);
+            pair_file_dequantize(q[1], n, step, y0);
+            pair_file_dequantize(q[2], n, step, x1);
+            pair_file_dequantize(q[3], n, step, y1);
+            job->dequantize_ticks += GET_CPU_TICKS() - start_ticks;
+            batch.x0 = x0;
+            batch.y0 = y0;
+            batch.x1 = x1;
+            batch.y1 = y1;
+        } else if (stride == 1) {
+            // the kernel only reads, the casts only drop the const of the mapping
+            batch.x0 = (double *)columns[0];
+            batch.y0 = (double *)columns[1];
+            batch.x1 = (double *)columns[2];
+            batch.y1 = (double *)columns[3];
+        } else {
+            for (size_t i=0; i<n; i++) {
+                x0[i] = columns[0][i * stride];
+                y0[i] = columns[1][i * stride];
+                x1[i] = columns[2][i * stride];
+                y1[i] = columns[3][i * stride];
+            }
+            batch.x0 = x0;
+            batch.y0 = y0;
+            batch.x1 = x1;
+            batch.y1 = y1;
+        }
+        double *out = job->distances ? &job->distances[start] : calculated;
+        haversine_soa(&batch, 0, n, APPROX_EARTH_RADIUS, out);
+        if (answers) {
+            for (size_t i=0; i<n; i++) {
+                pair_answer_check_row(&job->check, batch.x0[i], batch.y0[i], batch.x1[i], batch.y1[i], out[i]);
+            }
+        }
+        if (pairs->header.layout == PAIR_LAYOUT_Q32) {
+            start += n;
+            continue;
+        }
+
+        for (size_t i=0; i<n; i++) {
+            double expected = columns[4][i * stride];
+            if (expected != out[i]) {
+                if (job->mismatch_count < (uint64_t)job->max_report) {
+                    struct mismatch *m = &job->mismatches[job->mismatch_count];
+                    m->row = start + i;
+                    m->x0 = batch.x0[i];
+                    m->y0 = batch.y0[i];
+                    m->x1 = batch.x1[i];
+                    m->y1 = batch.y1[i];
+                    m->expected = expected;
+                    m->calculated = out[i];
+                }
+                job->mismatch_count++;
+            }
+        }
+        start += n;
+    }
+
+    if (compressed) {
+        pair_file_block_buffer_free(&buffer);
+    }
+    if (answers) {
+        pair_answer_check_finish(&job->check);
+    }
+    return 0;
+}
+
+/*
+ * Returns the number of mismatching rows and prints the first max_report
+ */
+uint64_t verify_pairs(const struct pair_file *pairs, double *distances) {
+    bool compressed = pairs->header.compression == PAIR_COMPRESSION_BLOCKS;
+    uint64_t block_rows = compressed ? pairs->header.block_rows : VERIFY_BLOCK_ROWS;
+    uint64_t block_count = (pairs->count + block_rows - 1) / block_rows;
+    struct verify_job *jobs = calloc(thread_count, sizeof(struct verify_job));
+    thrd_t *threads = calloc(thread_count, sizeof(thrd_t));
+    if (!jobs || !threads) {
+        MY_ERROR("Failed to allocate verify jobs for [%d] threads\n", thread_count);
+    }
+
+    for (int t=0; t<thread_count; t++) {
+        uint64_t first_block = block_count * t / thread_count;
+        uint64_t last_block = block_count * (t+1) / thread_count;
+        jobs[t].pairs = pairs;
+        jobs[t].first_row = first_block * block_rows;
+        jobs[t].last_row = last_block * block_rows < pairs->count ? last_block * block_rows : pairs->count;
+        jobs[t].max_report = max_report;
+        jobs[t].distances = distances;
+        jobs[t].mismatches = calloc(max_report > 0 ? max_report : 1, sizeof(struct mismatch));
+        if (!jobs[t].mismatches) {
+            MY_ERROR("Failed to allocate mismatch report for thread [%d]\n", t);
+        }
+        if (answers) {
+            pair_answer_check_init(&jobs[t].check, answers, PAIR_ANSWER_BINARY, false, jobs[t].first_row);
+        }
+        if (thrd_create(&threads[t], verify_thread, &jobs[t]) != thrd_success) {
+            MY_ERROR("Failed to create verify thread [%d]\n", t);
+        }
+    }
+    for (int t=0; t<thread_count; t++) {
+        thrd_join(threads[t], NULL);
+    }
+
+    uint64_t mismatch_count = 0;
+    uint64_t dequantize_ticks = 0;
+    uint64_t decompress_ticks = 0;
+    int reported = 0;
+    for (int t=0; t<thread_count; t++) {
+        dequantize_ticks += jobs[t].dequantize_ticks;
+        decompress_ticks += jobs[t].decompress_ticks;
+        uint64_t kept = jobs[t].mismatch_count < (uint64_t)max_report ? jobs[t].mismatch_count : (uint64_t)max_report;
+        for (uint64_t m=0; m<kept && reported<max_report; m++, reported++) {
+            struct mismatch *mm = &jobs[t].mismatches[m];
+            printf("Mismatch row[%" PRIu64 "] x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f | h_dist:%3.16f | h_dist_calc:%3.16f | delta:%3.16f\n",
+                   mm->row, mm->x0, mm->y0, mm->x1, mm->y1, mm->expected, mm->calculated, mm->expected - mm->calculated);
+        }
+        mismatch_count += jobs[t].mismatch_count;
+        free(jobs[t].mismatches);
+    }
+
+    if (answers) {
+        for (int t=1; t<thread_count; t++) {
+            pair_answer_check_merge(&jobs[0].check, &jobs[t].check);
+        }
+        bool answers_ok = pair_answer_check_report(&jobs[0].check);
+        for (int t=0; t<thread_count; t++) {
+            pair_answer_check_free(&jobs[t].check);
+        }
+        if (!answers_ok) {
+            MY_ERROR("Pair file does not match the answer file\n");
+        }
+    }
+
+    // thread time, with several threads it overlaps
+    if (pairs->header.layout == PAIR_LAYOUT_Q32) {
+        TAG_DATA_BLOCK_RECORD(BLOCK_DEQUANTIZE, "Dequantize", dequantize_ticks, pairs->count * 4 * sizeof(int32_t));
+    }
+    if (compressed) {
+        size_t block_bytes = pair_file_block_bytes(pairs);
+        TAG_DATA_BLOCK_RECORD(BLOCK_DECOMPRESS, "Decompress", decompress_ticks, pairs->count * (block_bytes / block_rows));
+    }
+
+    free(threads);
+    free(jobs);
+    return mismatch_count;
+}
+
 void usage(void) {
     fprintf(stderr, "Data Generator Binary Reader:\n");
     fprintf(stderr, "-h            This help dialog.\n");
-    fprintf(stderr, "-i <bin_file> Path to binary file.\n");
+    fprintf(stderr, "-i <bin_file> Path to binary file, pair file v2 or a v1 raw stream of rows.\n");
+    fprintf(stderr, "              Compressed pair files are decompressed block by block by the threads.\n");
+    fprintf(stderr, "-j <threads>  Verify the rows with <threads> threads (default 1).\n");
+    fprintf(stderr, "-n <rows>     Print up to <rows> mismatching rows (default %d).\n", DEFAULT_MAX_REPORT);
+    fprintf(stderr, "-c <answers>  Check the pairs and distances block by block against the data_gen\n");
+    fprintf(stderr, "              answer file and report the first block that differs.\n");
 }
 
 
 int main (int argc, char *argv[]) {
     int opt;
     char *input_file = NULL;
-    FILE *binary_fp = NULL;
-    uint32_t count = 0;
-    int ret;
-    uint32_t binary_write_count = 0;
-    double X0, Y0, X1, Y1 = 0;
-    double H_DIST, H_DIST_CALC, sum = 0;
-    double delta = 0;
+    char *answers_file = NULL;
+    struct pair_answers pair_answers;
+    struct pair_file pairs;
+    uint64_t binary_write_count = 0;
+    struct float_sum sum;
+    TAG_PROGRAM_START();
 
 #ifdef _WIN32
     for (int index=1; index<argc; ++index) {
@@ -53,20 +321,56 @@ int main (int argc, char *argv[]) {
             input_file = strdup(argv[index+1]);
             // since we consume the next parameter then skip it
             ++index;
+        } else if (strcmp(argv[index], "-j")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing thread count\n");
+                usage();
+                exit(1);
+            }
+            thread_count = atoi(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-n")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing mismatch row count\n");
+                usage();
+                exit(1);
+            }
+            max_report = atoi(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-c")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing answer file\n");
+                usage();
+                exit(1);
+            }
+            answers_file = strdup(argv[index+1]);
+            ++index;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "hi:")) != -1) {
+    while( (opt = getopt(argc, argv, "hi:j:n:c:")) != -1) {
         switch (opt) {
             case 'h':
                 usage();
                 exit(0);
                 break;
-            
+
             case 'i':
                 input_file = strdup(optarg);
                 break;
 
+            case 'j':
+                thread_count = atoi(optarg);
+                break;
+
+            case 'n':
+                max_report = atoi(optarg);
+                break;
+
+            case 'c':
+                answers_file = strdup(optarg);
+                break;
+
             default:
                 fprintf(stderr, "MY_ERROR Invalid command line option\n");
                 usage();
@@ -80,52 +384,131 @@ int main (int argc, char *argv[]) {
         usage();
         exit(1);
     }
+    if (thread_count < 1) {
+        fprintf(stderr, "ERROR invalid thread count [%d]\n", thread_count);
+        usage();
+        exit(1);
+    }
+    if (max_report < 0) {
+        fprintf(stderr, "ERROR invalid mismatch row count [%d]\n", max_report);
+        usage();
+        exit(1);
+    }
 
     printf("============================\n");
     printf("Data Generator Binary Reader\n");
     printf("============================\n");
 
     printf("Using input_file              [%s]\n", input_file);
+    printf("Verify threads                [%d]\n", thread_count);
+    if (answers_file) {
+        printf("Using answers_file            [%s]\n", answers_file);
+    }
     printf("\n\n");
 
-    binary_fp = fopen(input_file, "r");
-    if (!binary_fp) {
-        MY_ERROR("Failed to open binary file [%d][%s]\n", errno, strerror(errno));
+    // the file is mapped and the values are read in place
+    TAG_BLOCK_START(BLOCK_OPEN, "Open");
+    pair_file_open(&pairs, input_file);
+    if (answers_file) {
+        pair_answers_load(&pair_answers, answers_file);
+        if (pair_answers.header.count != pairs.count) {
+            MY_ERROR("Answer file has [%" PRIu64 "] rows, the pair file [%" PRIu64 "]\n", pair_answers.header.count, pairs.count);
+        }
+        answers = &pair_answers;
     }
+    TAG_BLOCK_END(BLOCK_OPEN);
 
-    while (1) {
-        ret = fread(&X0, sizeof(double), 1, binary_fp);
-        if (ret!=1) break;
-        ret = fread(&Y0, sizeof(double), 1, binary_fp);
-        if (ret!=1) break;
-        ret = fread(&X1, sizeof(double), 1, binary_fp);
-        if (ret!=1) break;
-        ret = fread(&Y1, sizeof(double), 1, binary_fp);
-        if (ret!=1) break;
-        ret = fread(&H_DIST, sizeof(double), 1, binary_fp);
-        if (ret!=1) break;
-        H_DIST_CALC = ReferenceHaversine(X0, Y0, X1, Y1, APPROX_EARTH_RADIUS);
-        delta = H_DIST - H_DIST_CALC;
-        // printf("x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f | h_dist:%3.16f | h_dist_calc:%3.16f | delta:%3.16f\n", X0, Y0, X1, Y1, H_DIST, H_DIST_CALC, delta);
-        if (delta!=0) {
-            MY_ERROR("Delta[%3.16f] for a row[%" PRIu32 "] is not zero\n", delta, count);
+    bool compressed = pairs.header.compression == PAIR_COMPRESSION_BLOCKS;
+    bool is_q32 = pairs.header.layout == PAIR_LAYOUT_Q32;
+    uint64_t data_bytes = pairs.count * (is_q32 ? 4 * sizeof(int32_t) : PAIR_FILE_COLUMNS * sizeof(double));
+    // checksummed bytes, the block table and blocks of a compressed file
+    uint64_t stored_bytes = compressed ? pairs.header.footer_offset - pairs.header.block_table_offset : data_bytes;
+    double *distances = NULL;
+    // compressed files have no mapped distance column to add up afterwards
+    if (is_q32 || compressed) {
+        distances = malloc((pairs.count ? pairs.count : 1) * sizeof(double));
+        if (!distances) {
+            MY_ERROR("Failed to allocate [%" PRIu64 "] distances\n", pairs.count);
         }
-        sum += H_DIST_CALC;
-        binary_write_count += 5;
-        count++;
     }
 
-    printf("All read values match expected Haversine Distance\n\n");
+    printf("Pair file version             [%u]\n", pairs.header.version);
+    printf("Count                         [%" PRIu64 "]\n", pairs.count);
+    printf("Layout                        [%s]\n", pair_file_layout_name(pairs.header.layout));
+    if (compressed) {
+        printf("Compression                   [%s, %" PRIu64 " blocks of %u rows]\n", pair_file_compression_name(pairs.header.compression),
+               pairs.header.block_count, pairs.header.block_rows);
+        printf("Compressed bytes              [%" PRIu64 "] ratio [%.4f]\n", stored_bytes, data_bytes ? (double)stored_bytes / data_bytes : 0);
+    }
+    if (!pairs.legacy) {
+        printf("Seed                          [%" PRIu64 "]\n", pairs.header.seed);
+        printf("Distribution                  [%s]\n", pair_file_distribution_name(pairs.header.distribution));
+        printf("Order                         [%s]\n", pair_order_name(pairs.header.order));
+        printf("Expected sum                  [%3.16f] added as [%s]\n", pairs.header.expected_sum,
+               float_sum_mode_name(pairs.header.sum_mode));
+        TAG_DATA_BLOCK_START(BLOCK_CHECKSUM, "Checksum", stored_bytes);
+        bool checksum_ok = pair_file_verify_checksum(&pairs);
+        TAG_BLOCK_END(BLOCK_CHECKSUM);
+        if (!checksum_ok) {
+            MY_ERROR("Pair file checksum does not match its footer\n");
+        }
+        printf("Checksum                      [OK]\n");
+    }
+    printf("\n\n");
 
-   
-    double average = sum/count;
-    printf("binary_write_count     %" PRIu32 "\n", binary_write_count);
-    printf("binary_bytes_writen    %zu\n", binary_write_count*sizeof(double));
-    printf("sum H_DIST_CALC        %3.16f\n", sum);
-    printf("average H_DIST_CALC    %3.16f\n\n", average);
+    TAG_DATA_BLOCK_START(BLOCK_VERIFY, "Verify", data_bytes);
+    uint64_t verify_start = GET_CPU_TICKS();
+    uint64_t mismatch_count = verify_pairs(&pairs, distances);
+    uint64_t verify_ticks = GET_CPU_TICKS() - verify_start;
+    TAG_BLOCK_END(BLOCK_VERIFY);
 
+    if (mismatch_count > 0) {
+        MY_ERROR("[%" PRIu64 "] of [%" PRIu64 "] rows do not match the expected Haversine Distance\n", mismatch_count, pairs.count);
+    }
+    if (is_q32) {
+        printf("Q32 file has no distances, checking the sum only\n\n");
+    } else {
+        printf("All read values match expected Haversine Distance\n\n");
+    }
+
+    // every stored distance matched, add them in row order the way data_gen did
+    TAG_DATA_BLOCK_START(BLOCK_SUM, "Sum", pairs.count * sizeof(double));
+    if (pairs.header.sum_mode > FLOAT_SUM_KAHAN) {
+        MY_ERROR("Unknown sum mode [%u]\n", pairs.header.sum_mode);
+    }
+    float_sum_init(&sum, pairs.header.sum_mode);
+    if (distances || pairs.stride == 1) {
+        float_sum_add_array(&sum, distances ? distances : pairs.haversine, pairs.count);
+    } else {
+        for (uint64_t i=0; i<pairs.count; i++) {
+            float_sum_add(&sum, pairs.haversine[i * pairs.stride]);
+        }
+    }
+    binary_write_count = pairs.count * (is_q32 ? 4 : PAIR_FILE_COLUMNS);
+    TAG_BLOCK_END(BLOCK_SUM);
+
+    double total = float_sum_result(&sum);
+    if (!pairs.legacy && total != pairs.header.expected_sum) {
+        MY_ERROR("Sum [%3.16f] does not match the expected sum [%3.16f]\n", total, pairs.header.expected_sum);
+    }
+
+    double verify_seconds = (double)verify_ticks / (double)guess_cpu_freq(100);
+    double average = total/pairs.count;
+    printf("binary_write_count     %" PRIu64 "\n", binary_write_count);
+    printf("binary_bytes_writen    %" PRIu64 "\n", data_bytes);
+    printf("sum H_DIST_CALC        %3.16f\n", total);
+    printf("average H_DIST_CALC    %3.16f\n", average);
+    printf("verified rows/s        %.0f\n", verify_seconds > 0 ? (double)pairs.count / verify_seconds : 0);
+    printf("verified GB/s          %.2f\n\n", verify_seconds > 0 ? (double)data_bytes / verify_seconds / (1024.0*1024.0*1024.0) : 0);
+
+    free(distances);
+    if (answers) {
+        pair_answers_free(answers);
+    }
+    free(answers_file);
+    pair_file_close(&pairs);
 
-    fclose(binary_fp);
+    TAG_PROGRAM_END();
 
     return 0;
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
 #ifndef _WIN32
@@ -9,8 +10,21 @@
 #endif
 #include <errno.h>
 #include <time.h>
+#include <math.h>
+#include <threads.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 #include "haversine.h"
+#include "rng.h"
+#include "float_format.h"
+#include "pair_file.h"
+#include "pair_codec.h"
+#include "pair_order.h"
+#include "float_sum.h"
+#include "fast_double.h"
+#include "pair_answers.h"
 
 /*
  * X -180 to 180 degrees
@@ -47,46 +61,672 @@
 #define NUM_CLUSTERS            4
 
 
+/*
+ * Block generation
+ *
+ * Rows are split in fixed blocks of GEN_BLOCK_ROWS. Block b draws from its
+ * own xoshiro256** stream, the seed stream jumped b+1 times, so the values
+ * of a row only depend on the seed and the row number and never on how
+ * many threads run or which thread got the block. The seed stream itself
+ * draws the cluster origins. All coordinates of a block come from one
+ * rng_fill_uniform call, one lane per x0, y0, x1, y1.
+ * Without -j the main thread generates one block at a time. With -j each
+ * round every thread formats one block into its own buffers. Either way
+ * the main thread writes the blocks in order at their file offsets with
+ * pwrite and adds the distances in row order.
+ * The binary file is a pair_file v2, its header is written last once the
+ * sum is known.
+ * With -z every block also compresses its binary columns on its thread and
+ * the main thread appends them one after the other, so the generator block
+ * is also the pair file block.
+ * With -o the blocks first only draw their pairs into whole file columns,
+ * the rows are sorted along the curve and the blocks then format the
+ * sorted columns instead of drawing. That keeps every pair of the seed and
+ * only changes the row order, at about 44 bytes of memory per row.
+ * Every block also computes its answer block (pair_answers.h), the binary
+ * and JSON block sums and hashes, the generator block is the answer block.
+ */
+#define GEN_BLOCK_ROWS          PAIR_FILE_BLOCK_ROWS
+#define JSON_ROW_MAX_BYTES      128     // ",\n" + row, coordinates are always within +-225 degrees
+#define BINARY_ROW_DOUBLES      5       // x0, y0, x1, y1, haversine
+
+/*
+ * With -q the coordinates are rounded to the Q32 grid before anything is
+ * written, so the JSON and the binary file hold the same pairs. The error
+ * is measured against the distances of the unrounded coordinates.
+ */
+struct quant_error {
+    double max_error;           // largest |haversine(rounded) - haversine(exact)| of a row
+    double exact_sum;           // sum of haversine(exact), block sums merged in block order
+};
+
+struct gen_block {
+    uint64_t first_row;
+    uint64_t row_count;
+    struct rng_lanes lanes;
+    const double *cluster_x;
+    const double *cluster_y;
+    bool is_clustered;
+    uint64_t cluster_rows;      // rows per cluster, 0 when count < NUM_CLUSTERS
+    bool soa_binary;            // binary holds one column of row_count values after the other
+    bool quantize;
+    int32_t *quantized;         // Q32 x0, y0, x1, y1 columns of row_count values
+    struct quant_error quant;
+    enum float_sum_mode_e sum_mode;
+    struct float_sum exact_sum; // -q, distances of the unrounded pairs, GEN_BLOCK_ROWS is one float_sum block
+    struct pair_answer_block answer;
+    struct float_sum answer_sum[PAIR_ANSWER_SOURCES];
+    bool compress;
+    uint8_t *compressed;
+    size_t compressed_size;
+    double *drawn[4];           // draw pass, x0, y0, x1, y1 columns of the whole file
+    double *const *sorted;      // write pass of a sorted file, read instead of drawing
+    double *draws;
+    char *json;
+    size_t json_size;
+    double *binary;
+    struct value_range range;
+};
 
-double pos_min = 0;
-double pos_max = 0;
-double neg_min = 0;
-double neg_max = 0;
+/*
+ * Format one JSON row, same text as
+ *   ",\n{\"x0\":%3.16f, \"y0\":%3.16f, \"x1\":%3.16f, \"y1\":%3.16f}"
+ * with the leading separator left out for the first row
+ */
+static size_t format_json_row(char *out, bool first_row, double X0, double Y0, double X1, double Y1) {
+    char *ptr = out;
+    if (!first_row) {
+        memcpy(ptr, ",\n", 2);
+        ptr += 2;
+    }
+    memcpy(ptr, "{\"x0\":", 6);
+    ptr += 6;
+    ptr += format_fixed16(ptr, X0);
+    memcpy(ptr, ", \"y0\":", 7);
+    ptr += 7;
+    ptr += format_fixed16(ptr, Y0);
+    memcpy(ptr, ", \"x1\":", 7);
+    ptr += 7;
+    ptr += format_fixed16(ptr, X1);
+    memcpy(ptr, ", \"y1\":", 7);
+    ptr += 7;
+    ptr += format_fixed16(ptr, Y1);
+    *ptr++ = '}';
+    return ptr - out;
+}
 
+/*
+ * The value a JSON reader gets back from the text of value. From 1.0 up the
+ * 16 decimals are at least 17 significant digits, which always round trip,
+ * smaller values are formatted and parsed back the way json_data_parser does.
+ */
+static double json_value(double value) {
+    char text[FORMAT_FIXED16_MAX_LEN];
+    double parsed;
 
-double get_random_data(double radius) {
-    int rnum;
-    rnum =  rand();
-    double fnum = ((double)(rnum-RAND_MAX/2)/RAND_MAX)*2*radius;
+    if (fabs(value) >= 1.0) {
+        return value;
+    }
+    size_t size = format_fixed16(text, value);
+    parse_double(text, text + size, &parsed);
+    return parsed;
+}
+
+/*
+ * Range bookkeeping for single draws like the cluster origins
+ */
+static void track_value(struct value_range *range, double fnum) {
     if (fnum>0) {
-        if (fnum>pos_max) {
-            pos_max = fnum;
+        if (fnum>range->pos_max) {
+            range->pos_max = fnum;
         }
-        if (pos_min==0 && fnum!=0)  {
-            pos_min = fnum;
-        } else if (fnum<pos_min) {
-            pos_min = fnum;
+        if (range->pos_min==0 && fnum!=0)  {
+            range->pos_min = fnum;
+        } else if (fnum<range->pos_min) {
+            range->pos_min = fnum;
         }
     } else {
-        if (fnum<neg_max) {
-            neg_max = fnum;
+        if (fnum<range->neg_max) {
+            range->neg_max = fnum;
         }
-        if (neg_min==0 && fnum!=0) {
-            neg_min = fnum;
-        } else if (fnum>neg_min) {
-            neg_min = fnum;
+        if (range->neg_min==0 && fnum!=0) {
+            range->neg_min = fnum;
+        } else if (fnum>range->neg_min) {
+            range->neg_min = fnum;
         }
     }
-    return fnum;
 }
 
+static void merge_range(struct value_range *total, const struct value_range *block) {
+    if (block->pos_max > total->pos_max) {
+        total->pos_max = block->pos_max;
+    }
+    if (block->pos_min != 0 && (total->pos_min == 0 || block->pos_min < total->pos_min)) {
+        total->pos_min = block->pos_min;
+    }
+    if (block->neg_max < total->neg_max) {
+        total->neg_max = block->neg_max;
+    }
+    if (block->neg_min != 0 && (total->neg_min == 0 || block->neg_min > total->neg_min)) {
+        total->neg_min = block->neg_min;
+    }
+}
+
+/*
+ * Coordinates of row r of the block from its draws
+ */
+static void drawn_pair(const struct gen_block *block, uint64_t r, double pair[4]) {
+    uint64_t row = block->first_row + r;
+    const double *draw = &block->draws[r*RNG_LANES];
+
+    if (block->is_clustered) {
+        // with less rows than clusters the first cluster change is on row 0
+        uint64_t cluster = block->cluster_rows ? row / block->cluster_rows : 1;
+        pair[0] = block->cluster_x[cluster] + draw[0];
+        pair[1] = block->cluster_y[cluster] + draw[1];
+        pair[2] = block->cluster_x[cluster] + draw[2];
+        pair[3] = block->cluster_y[cluster] + draw[3];
+    } else {
+        pair[0] = draw[0];
+        pair[1] = draw[1];
+        pair[2] = draw[2];
+        pair[3] = draw[3];
+    }
+}
+
+static const double uniform_radius[RNG_LANES] = { X_RADIUS, Y_RADIUS, X_RADIUS, Y_RADIUS };
+static const double cluster_radius[RNG_LANES] = { X_RADIUS/4, Y_RADIUS/4, X_RADIUS/4, Y_RADIUS/4 };
+
+int draw_block_thread(void *arg) {
+    struct gen_block *block = (struct gen_block *)arg;
+
+    memset(&block->range, 0, sizeof(struct value_range));
+    rng_fill_uniform(&block->lanes, block->draws, block->row_count * RNG_LANES,
+                     block->is_clustered ? cluster_radius : uniform_radius, &block->range);
+    for (uint64_t r=0; r<block->row_count; r++) {
+        double pair[4];
+        drawn_pair(block, r, pair);
+        for (int c=0; c<4; c++) {
+            block->drawn[c][block->first_row + r] = pair[c];
+        }
+    }
+    return 0;
+}
+
+int generate_block_thread(void *arg) {
+    struct gen_block *block = (struct gen_block *)arg;
+    char *out = block->json;
+
+    memset(&block->range, 0, sizeof(struct value_range));
+    memset(&block->quant, 0, sizeof(struct quant_error));
+    float_sum_init(&block->exact_sum, block->sum_mode);
+    memset(&block->answer, 0, sizeof(struct pair_answer_block));
+    block->answer.first_row = block->first_row;
+    block->answer.rows = block->row_count;
+    for (int a=0; a<PAIR_ANSWER_SOURCES; a++) {
+        float_sum_init(&block->answer_sum[a], block->sum_mode);
+    }
+    if (!block->sorted) {
+        rng_fill_uniform(&block->lanes, block->draws, block->row_count * RNG_LANES,
+                         block->is_clustered ? cluster_radius : uniform_radius, &block->range);
+    }
+
+    for (uint64_t r=0; r<block->row_count; r++) {
+        uint64_t row = block->first_row + r;
+        double pair[4];
+
+        if (block->sorted) {
+            for (int c=0; c<4; c++) {
+                pair[c] = block->sorted[c][row];
+            }
+        } else {
+            drawn_pair(block, r, pair);
+        }
+        double X0 = pair[0];
+        double Y0 = pair[1];
+        double X1 = pair[2];
+        double Y1 = pair[3];
+        if (block->quantize) {
+            double exact = ReferenceHaversine(X0, Y0, X1, Y1, APPROX_EARTH_RADIUS);
+            int32_t *q = &block->quantized[r];
+            q[0] = pair_file_quantize(X0);
+            q[block->row_count] = pair_file_quantize(Y0);
+            q[2*block->row_count] = pair_file_quantize(X1);
+            q[3*block->row_count] = pair_file_quantize(Y1);
+            X0 = q[0] / PAIR_FILE_Q32_STEPS;
+            Y0 = q[block->row_count] / PAIR_FILE_Q32_STEPS;
+            X1 = q[2*block->row_count] / PAIR_FILE_Q32_STEPS;
+            Y1 = q[3*block->row_count] / PAIR_FILE_Q32_STEPS;
+            double error = fabs(ReferenceHaversine(X0, Y0, X1, Y1, APPROX_EARTH_RADIUS) - exact);
+            block->quant.max_error = error > block->quant.max_error ? error : block->quant.max_error;
+            float_sum_add(&block->exact_sum, exact);
+        }
+        double H_DIST = ReferenceHaversine(X0, Y0, X1, Y1, APPROX_EARTH_RADIUS);
+
+        out += format_json_row(out, row == 0, X0, Y0, X1, Y1);
+
+        double json_pair[4] = {json_value(X0), json_value(Y0), json_value(X1), json_value(Y1)};
+        double json_distance = H_DIST;
+        if (json_pair[0] != X0 || json_pair[1] != Y0 || json_pair[2] != X1 || json_pair[3] != Y1) {
+            json_distance = ReferenceHaversine(json_pair[0], json_pair[1], json_pair[2], json_pair[3], APPROX_EARTH_RADIUS);
+        }
+        pair_answer_add(&block->answer.answer[PAIR_ANSWER_BINARY], &block->answer_sum[PAIR_ANSWER_BINARY], row,
+                        X0, Y0, X1, Y1, H_DIST);
+        pair_answer_add(&block->answer.answer[PAIR_ANSWER_JSON], &block->answer_sum[PAIR_ANSWER_JSON], row,
+                        json_pair[0], json_pair[1], json_pair[2], json_pair[3], json_distance);
+
+        if (block->soa_binary) {
+            double *bin = &block->binary[r];
+            bin[0] = X0;
+            bin[block->row_count] = Y0;
+            bin[2*block->row_count] = X1;
+            bin[3*block->row_count] = Y1;
+            bin[4*block->row_count] = H_DIST;
+        } else {
+            double *bin = &block->binary[r*BINARY_ROW_DOUBLES];
+            bin[0] = X0;
+            bin[1] = Y0;
+            bin[2] = X1;
+            bin[3] = Y1;
+            bin[4] = H_DIST;
+        }
+    }
+    block->json_size = out - block->json;
+    for (int a=0; a<PAIR_ANSWER_SOURCES; a++) {
+        block->answer.answer[a].sum = float_sum_result(&block->answer_sum[a]);
+    }
+
+    if (block->compress) {
+        // the columns are contiguous, each one row_count values long
+        if (block->quantize) {
+            block->compressed_size = pair_codec_compress(block->quantized, 4, block->row_count, sizeof(int32_t), block->compressed);
+        } else {
+            block->compressed_size = pair_codec_compress(block->binary, BINARY_ROW_DOUBLES, block->row_count, sizeof(double), block->compressed);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Write all of buffer at offset without moving a shared file position
+ */
+static void write_at(FILE *fp, const void *buffer, size_t size, uint64_t offset) {
+    const uint8_t *ptr = buffer;
+#ifdef _WIN32
+    // only the main thread writes so seek + write is enough here
+    int fd = _fileno(fp);
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        MY_ERROR("Failed to seek output file [%d][%s]\n", errno, strerror(errno));
+    }
+    while (size > 0) {
+        unsigned int chunk = size > (1U<<30) ? (1U<<30) : (unsigned int)size;
+        int written = _write(fd, ptr, chunk);
+        if (written <= 0) {
+            MY_ERROR("Failed to write output file [%d][%s]\n", errno, strerror(errno));
+        }
+        ptr += written;
+        size -= written;
+    }
+#else
+    int fd = fileno(fp);
+    while (size > 0) {
+        ssize_t written = pwrite(fd, ptr, size, offset);
+        if (written <= 0) {
+            MY_ERROR("Failed to write output file [%d][%s]\n", errno, strerror(errno));
+        }
+        ptr += written;
+        size -= written;
+        offset += written;
+    }
+#endif
+}
+
+/*
+ * Run block_thread on the first round_blocks blocks, one thread each or all
+ * on the calling thread when thread_count is 0
+ */
+static void run_round(struct gen_block *blocks, int round_blocks, int thread_count, thrd_start_t block_thread) {
+    if (thread_count == 0) {
+        for (int t=0; t<round_blocks; t++) {
+            block_thread(&blocks[t]);
+        }
+        return;
+    }
+    thrd_t threads[round_blocks];
+    for (int t=0; t<round_blocks; t++) {
+        if (thrd_create(&threads[t], block_thread, &blocks[t]) != thrd_success) {
+            MY_ERROR("Failed to create generator thread [%d]\n", t);
+        }
+    }
+    for (int t=0; t<round_blocks; t++) {
+        thrd_join(threads[t], NULL);
+    }
+}
+
+/*
+ * Point the blocks of a round at their rows, block b uses the seed stream
+ * jumped b+1 times. Returns the number of blocks in the round.
+ */
+static int setup_round(struct gen_block *blocks, int block_count, uint64_t round_start, uint64_t block_total,
+                       uint64_t count, struct rng_state *block_rng) {
+    int round_blocks = 0;
+    for (int t=0; t<block_count && round_start+t<block_total; t++) {
+        uint64_t b = round_start + t;
+        rng_jump(block_rng);
+        rng_lanes_init(&blocks[t].lanes, block_rng);
+        blocks[t].first_row = b * GEN_BLOCK_ROWS;
+        blocks[t].row_count = count - blocks[t].first_row < GEN_BLOCK_ROWS ? count - blocks[t].first_row : GEN_BLOCK_ROWS;
+        round_blocks++;
+    }
+    return round_blocks;
+}
+
+/*
+ * Draw pass of a sorted file, returns the x0, y0, x1, y1 columns of all
+ * pairs in curve order. Ranges are tracked here, the write pass draws
+ * nothing.
+ */
+static void draw_sorted_pairs(struct gen_block *blocks, int block_count, int thread_count, const struct rng_state *seed_rng,
+                              uint64_t count, enum pair_order_e order, struct value_range *range, double *sorted[4]) {
+    uint64_t block_total = (count + GEN_BLOCK_ROWS - 1) / GEN_BLOCK_ROWS;
+    struct rng_state block_rng = *seed_rng;
+    uint32_t *permutation = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!permutation) {
+        MY_ERROR("Failed to allocate the sort permutation of [%" PRIu64 "] rows\n", count);
+    }
+    for (int c=0; c<4; c++) {
+        sorted[c] = malloc((count ? count : 1) * sizeof(double));
+        if (!sorted[c]) {
+            MY_ERROR("Failed to allocate [%" PRIu64 "] sorted coordinates\n", count);
+        }
+        for (int t=0; t<block_count; t++) {
+            blocks[t].drawn[c] = sorted[c];
+        }
+    }
+
+    for (uint64_t round_start=0; round_start<block_total; round_start+=block_count) {
+        int round_blocks = setup_round(blocks, block_count, round_start, block_total, count, &block_rng);
+        run_round(blocks, round_blocks, thread_count, draw_block_thread);
+        for (int t=0; t<round_blocks; t++) {
+            merge_range(range, &blocks[t].range);
+        }
+    }
+
+    if (!pair_order_sort(order, sorted[0], sorted[1], count, permutation)) {
+        MY_ERROR("Failed to allocate the sort buffers for [%" PRIu64 "] rows\n", count);
+    }
+    // gather one column at a time, the column replaced is the next gather target
+    double *gathered = malloc((count ? count : 1) * sizeof(double));
+    if (!gathered) {
+        MY_ERROR("Failed to allocate [%" PRIu64 "] sorted coordinates\n", count);
+    }
+    for (int c=0; c<4; c++) {
+        for (uint64_t i=0; i<count; i++) {
+            gathered[i] = sorted[c][permutation[i]];
+        }
+        double *drawn = sorted[c];
+        sorted[c] = gathered;
+        gathered = drawn;
+    }
+    free(gathered);
+    free(permutation);
+}
+
+/*
+ * Returns the haversine sum added as sum_mode, the value ranges are merged
+ * into range. thread_count 0 generates on the calling thread. With compress
+ * the compressed size of all blocks is added to compressed_bytes.
+ */
+double generate_pairs(FILE *json_fp, FILE *binary_fp, FILE *stats_fp, FILE *answers_fp, uint64_t count, uint64_t seed,
+                      bool is_clustered, enum pair_file_layout_e layout, bool compress, enum pair_order_e order,
+                      enum float_sum_mode_e sum_mode, int thread_count, struct value_range *range, int *num_clusters,
+                      struct quant_error *quant, uint64_t *compressed_bytes) {
+    const char json_header[] = "{\"pairs\":[\n";
+    const char json_footer[] = "\n]}\n";
+    struct pair_file_header binary_header;
+    struct pair_file_footer binary_footer = {};
+    uint64_t checksum = 0;
+    struct rng_state seed_rng;
+    double *cluster_x = NULL;
+    double *cluster_y = NULL;
+    uint64_t cluster_rows = 0;
+
+    rng_seed(&seed_rng, seed);
+
+    if (is_clustered) {
+        // new cluster origin every count/NUM_CLUSTERS rows, cluster 0 is at 0,0
+        cluster_rows = count / NUM_CLUSTERS;
+        *num_clusters = cluster_rows ? (count - 1) / cluster_rows + 1 : 2;
+        cluster_x = calloc(*num_clusters, sizeof(double));
+        cluster_y = calloc(*num_clusters, sizeof(double));
+        if (!cluster_x || !cluster_y) {
+            MY_ERROR("Failed to allocate [%d] cluster origins\n", *num_clusters);
+        }
+        for (int c=1; c<*num_clusters; c++) {
+            cluster_x[c] = rng_uniform(&seed_rng, X_RADIUS);
+            cluster_y[c] = rng_uniform(&seed_rng, Y_RADIUS);
+            track_value(range, cluster_x[c]);
+            track_value(range, cluster_y[c]);
+            fprintf(stats_fp,"New cluster              [%3.16f][%3.16f]\n", cluster_x[c], cluster_y[c]);
+            printf("New cluster              [%3.16f][%3.16f]\n", cluster_x[c], cluster_y[c]);
+        }
+    }
+
+    int block_count = thread_count > 0 ? thread_count : 1;
+    struct gen_block *blocks = calloc(block_count, sizeof(struct gen_block));
+    if (!blocks) {
+        MY_ERROR("Failed to allocate blocks for [%d] threads\n", block_count);
+    }
+    for (int t=0; t<block_count; t++) {
+        blocks[t].draws = malloc((size_t)GEN_BLOCK_ROWS * RNG_LANES * sizeof(double));
+        blocks[t].json = malloc((size_t)GEN_BLOCK_ROWS * JSON_ROW_MAX_BYTES);
+        blocks[t].binary = malloc((size_t)GEN_BLOCK_ROWS * BINARY_ROW_DOUBLES * sizeof(double));
+        if (layout == PAIR_LAYOUT_Q32) {
+            blocks[t].quantized = malloc((size_t)GEN_BLOCK_ROWS * 4 * sizeof(int32_t));
+            if (!blocks[t].quantized) {
+                MY_ERROR("Failed to allocate quantized buffer for thread [%d]\n", t);
+            }
+        }
+        if (compress) {
+            blocks[t].compressed = malloc(pair_codec_bound(BINARY_ROW_DOUBLES, GEN_BLOCK_ROWS, sizeof(double)));
+            if (!blocks[t].compressed) {
+                MY_ERROR("Failed to allocate compressed buffer for thread [%d]\n", t);
+            }
+        }
+        if (!blocks[t].draws || !blocks[t].json || !blocks[t].binary) {
+            MY_ERROR("Failed to allocate block buffers for thread [%d]\n", t);
+        }
+        blocks[t].cluster_x = cluster_x;
+        blocks[t].cluster_y = cluster_y;
+        blocks[t].is_clustered = is_clustered;
+        blocks[t].cluster_rows = cluster_rows;
+        // Q32 keeps the doubles as columns too, only the distance column is used
+        blocks[t].soa_binary = layout != PAIR_LAYOUT_AOS;
+        blocks[t].quantize = layout == PAIR_LAYOUT_Q32;
+        blocks[t].compress = compress;
+        blocks[t].sum_mode = sum_mode;
+    }
+
+    double *sorted[4] = {};
+    if (order != PAIR_ORDER_GENERATED) {
+        draw_sorted_pairs(blocks, block_count, thread_count, &seed_rng, count, order, range, sorted);
+        for (int t=0; t<block_count; t++) {
+            blocks[t].sorted = sorted;
+        }
+    }
+
+    pair_file_header_init(&binary_header, count, seed, is_clustered ? PAIR_DIST_CLUSTERED : PAIR_DIST_UNIFORM, layout);
+    binary_header.order = order;
+    binary_header.sum_mode = sum_mode;
+    struct pair_file_block *block_table = NULL;
+    uint64_t block_offset = 0;
+    if (compress) {
+        pair_file_header_use_blocks(&binary_header, GEN_BLOCK_ROWS);
+        block_table = calloc(binary_header.block_count ? binary_header.block_count : 1, sizeof(struct pair_file_block));
+        if (!block_table) {
+            MY_ERROR("Failed to allocate the table of [%" PRIu64 "] blocks\n", binary_header.block_count);
+        }
+        block_offset = binary_header.block_data_offset;
+    }
+
+    write_at(json_fp, json_header, strlen(json_header), 0);
+    uint64_t json_offset = strlen(json_header);
+
+    // block b uses the seed stream jumped b+1 times
+    struct rng_state block_rng = seed_rng;
+    uint64_t block_total = (count + GEN_BLOCK_ROWS - 1) / GEN_BLOCK_ROWS;
+    struct float_sum sum;
+    struct float_sum exact_sum;
+    float_sum_init(&sum, sum_mode);
+    float_sum_init(&exact_sum, sum_mode);
+
+    struct pair_answers_header answers_header = {};
+    struct float_sum answer_sum[PAIR_ANSWER_SOURCES];
+    struct pair_answer_block *answer_blocks = calloc(block_total ? block_total : 1, sizeof(struct pair_answer_block));
+    if (!answer_blocks) {
+        MY_ERROR("Failed to allocate [%" PRIu64 "] answer blocks\n", block_total);
+    }
+    for (int a=0; a<PAIR_ANSWER_SOURCES; a++) {
+        float_sum_init(&answer_sum[a], sum_mode);
+    }
+
+    for (uint64_t round_start=0; round_start<block_total; round_start+=block_count) {
+        int round_blocks = setup_round(blocks, block_count, round_start, block_total, count, &block_rng);
+        run_round(blocks, round_blocks, thread_count, generate_block_thread);
+        for (int t=0; t<round_blocks; t++) {
+            write_at(json_fp, blocks[t].json, blocks[t].json_size, json_offset);
+            json_offset += blocks[t].json_size;
+            const double *haversine;
+            if (compress) {
+                if (blocks[t].compressed_size == 0) {
+                    MY_ERROR("Failed to compress block [%" PRIu64 "]\n", round_start + t);
+                }
+                struct pair_file_block *entry = &block_table[round_start + t];
+                entry->offset = block_offset;
+                entry->size = (uint32_t)blocks[t].compressed_size;
+                entry->rows = (uint32_t)blocks[t].row_count;
+                write_at(binary_fp, blocks[t].compressed, entry->size, entry->offset);
+                checksum += pair_file_checksum(blocks[t].compressed, entry->size, entry->offset);
+                *compressed_bytes += entry->size;
+                // blocks start on 8 bytes so the checksum words line up with the file
+                block_offset = (block_offset + entry->size + 7) & ~(uint64_t)7;
+                haversine = &blocks[t].binary[4*blocks[t].row_count];
+            } else if (layout == PAIR_LAYOUT_Q32) {
+                size_t column_size = blocks[t].row_count * sizeof(int32_t);
+                for (int c=0; c<4; c++) {
+                    uint64_t offset = binary_header.column_offset[c] + blocks[t].first_row * sizeof(int32_t);
+                    write_at(binary_fp, &blocks[t].quantized[c*blocks[t].row_count], column_size, offset);
+                    checksum += pair_file_checksum(&blocks[t].quantized[c*blocks[t].row_count], column_size, offset);
+                }
+                haversine = &blocks[t].binary[4*blocks[t].row_count];
+            } else if (layout == PAIR_LAYOUT_SOA) {
+                size_t column_size = blocks[t].row_count * sizeof(double);
+                for (int c=0; c<BINARY_ROW_DOUBLES; c++) {
+                    uint64_t offset = binary_header.column_offset[c] + blocks[t].first_row * sizeof(double);
+                    write_at(binary_fp, &blocks[t].binary[c*blocks[t].row_count], column_size, offset);
+                    checksum += pair_file_checksum(&blocks[t].binary[c*blocks[t].row_count], column_size, offset);
+                }
+                haversine = &blocks[t].binary[4*blocks[t].row_count];
+            } else {
+                size_t rows_size = blocks[t].row_count * BINARY_ROW_DOUBLES * sizeof(double);
+                uint64_t offset = binary_header.column_offset[0] + blocks[t].first_row * BINARY_ROW_DOUBLES * sizeof(double);
+                write_at(binary_fp, blocks[t].binary, rows_size, offset);
+                checksum += pair_file_checksum(blocks[t].binary, rows_size, offset);
+                haversine = &blocks[t].binary[4];
+            }
+            if (layout == PAIR_LAYOUT_AOS) {
+                for (uint64_t r=0; r<blocks[t].row_count; r++) {
+                    float_sum_add(&sum, haversine[r*BINARY_ROW_DOUBLES]);
+                }
+            } else {
+                float_sum_add_array(&sum, haversine, blocks[t].row_count);
+            }
+            if (!float_sum_merge(&exact_sum, &blocks[t].exact_sum)) {
+                MY_ERROR("Failed to merge the exact sum of block [%" PRIu64 "]\n", round_start + t);
+            }
+            answer_blocks[round_start + t] = blocks[t].answer;
+            for (int a=0; a<PAIR_ANSWER_SOURCES; a++) {
+                if (!float_sum_merge(&answer_sum[a], &blocks[t].answer_sum[a])) {
+                    MY_ERROR("Failed to merge the answer sum of block [%" PRIu64 "]\n", round_start + t);
+                }
+            }
+            merge_range(range, &blocks[t].range);
+            if (blocks[t].quant.max_error > quant->max_error) {
+                quant->max_error = blocks[t].quant.max_error;
+            }
+        }
+    }
+
+    write_at(json_fp, json_footer, strlen(json_footer), json_offset);
+
+    if (compress) {
+        size_t table_size = binary_header.block_count * sizeof(struct pair_file_block);
+        write_at(binary_fp, block_table, table_size, binary_header.block_table_offset);
+        checksum += pair_file_checksum(block_table, table_size, binary_header.block_table_offset);
+        binary_header.footer_offset = (block_offset + PAIR_FILE_ALIGNMENT - 1) / PAIR_FILE_ALIGNMENT * PAIR_FILE_ALIGNMENT;
+    }
+
+    // the gaps left between columns read back as zeros
+    binary_header.expected_sum = float_sum_result(&sum);
+    quant->exact_sum = float_sum_result(&exact_sum);
+    write_at(binary_fp, &binary_header, sizeof(binary_header), 0);
+    memcpy(binary_footer.magic, PAIR_FILE_FOOTER_MAGIC, sizeof(PAIR_FILE_FOOTER_MAGIC));
+    binary_footer.checksum = checksum;
+    write_at(binary_fp, &binary_footer, sizeof(binary_footer), binary_header.footer_offset);
+
+    memcpy(answers_header.magic, PAIR_ANSWERS_MAGIC, sizeof(PAIR_ANSWERS_MAGIC));
+    answers_header.version = PAIR_ANSWERS_VERSION;
+    answers_header.sum_mode = sum_mode;
+    answers_header.count = count;
+    answers_header.seed = seed;
+    answers_header.block_rows = GEN_BLOCK_ROWS;
+    answers_header.block_count = block_total;
+    for (int a=0; a<PAIR_ANSWER_SOURCES; a++) {
+        answers_header.sum[a] = float_sum_result(&answer_sum[a]);
+    }
+    write_at(answers_fp, &answers_header, sizeof(answers_header), 0);
+    write_at(answers_fp, answer_blocks, block_total * sizeof(struct pair_answer_block), sizeof(answers_header));
+
+    for (int t=0; t<block_count; t++) {
+        free(blocks[t].draws);
+        free(blocks[t].json);
+        free(blocks[t].binary);
+        free(blocks[t].quantized);
+        free(blocks[t].compressed);
+    }
+    free(block_table);
+    free(answer_blocks);
+    for (int c=0; c<4; c++) {
+        free(sorted[c]);
+    }
+    free(blocks);
+    free(cluster_x);
+    free(cluster_y);
+
+    return binary_header.expected_sum;
+}
 
 void usage(void) {
     fprintf(stderr, "Data Generator Usage:\n");
     fprintf(stderr, "-c         Use a clustered distribution (default is uniform distribution).\n");
     fprintf(stderr, "-h         This help dialog.\n");
+    fprintf(stderr, "-j <N>     Generate with N threads, each block of rows has its own xoshiro256**\n");
+    fprintf(stderr, "           stream so the output for a seed is the same with or without -j.\n");
     fprintf(stderr, "-n <count> Generate count data points.\n");
     fprintf(stderr, "-s <seed>  Set the Seed.\n");
+    fprintf(stderr, "-S         Write the binary pair file with one column after the other (SoA),\n");
+    fprintf(stderr, "           default is one row of x0, y0, x1, y1, haversine after the other (AoS).\n");
+    fprintf(stderr, "-q         Round the coordinates to int32 fixed point with 2^23 steps per degree and\n");
+    fprintf(stderr, "           write them as Q32 columns, 16 bytes per pair. The JSON holds the same\n");
+    fprintf(stderr, "           rounded pairs and the error against the unrounded ones is reported.\n");
+    fprintf(stderr, "-z         Write the binary columns in independently compressed blocks of %d rows\n", GEN_BLOCK_ROWS);
+    fprintf(stderr, "           (delta + byte shuffle + LZ), needs -S or -q.\n");
+    fprintf(stderr, "-o <order> Write the pairs sorted along a space filling curve by their first point,\n");
+    fprintf(stderr, "           <order> is hilbert or morton (default generated, the order they are drawn in).\n");
+    fprintf(stderr, "-r <sum>   Add up the distances as pairwise (default) or kahan, the result is the same\n");
+    fprintf(stderr, "           for any -j. naive adds them one after the other like older versions.\n");
+    fprintf(stderr, "Every run also writes a .answers file with the expected sum and hashes of each\n");
+    fprintf(stderr, "block of %d rows, check it with -c in json_data_parser or bindata_reader.\n", GEN_BLOCK_ROWS);
 }
 
 
@@ -95,19 +735,25 @@ int main (int argc, char *argv[]) {
     char json_outfile[MAX_FILENAME_LEN] = {};
     char binary_outfile[MAX_FILENAME_LEN] = {};
     char stats_outfile[MAX_FILENAME_LEN] = {};
+    char answers_outfile[MAX_FILENAME_LEN] = {};
     char timestamp[MAX_TIMESTAMP_LEN] = {};
     bool is_clustered = false;
+    enum pair_file_layout_e binary_layout = PAIR_LAYOUT_AOS;
+    bool compress = false;
+    enum pair_order_e order = PAIR_ORDER_GENERATED;
+    enum float_sum_mode_e sum_mode = FLOAT_SUM_PAIRWISE;
     FILE *json_fp = NULL;
     FILE *binary_fp = NULL;
     FILE *stats_fp = NULL;
+    FILE *answers_fp = NULL;
     unsigned int count = 0;
     unsigned int seed = 0;
     time_t temp;
     struct tm *timeptr;
     int ret;
-    unsigned int binary_write_count = 0;
     double cluster_x = 0;
     double cluster_y = 0;
+    int thread_count = 0;
 
 #ifdef _WIN32
     for (int index=1; index<argc; ++index) {
@@ -136,10 +782,48 @@ int main (int argc, char *argv[]) {
             ++index;
         } else if (strcmp(argv[index], "-c")==0) {
             is_clustered = true;
+        } else if (strcmp(argv[index], "-S")==0) {
+            binary_layout = PAIR_LAYOUT_SOA;
+        } else if (strcmp(argv[index], "-q")==0) {
+            binary_layout = PAIR_LAYOUT_Q32;
+        } else if (strcmp(argv[index], "-z")==0) {
+            compress = true;
+        } else if (strcmp(argv[index], "-o")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing pair order\n");
+                usage();
+                exit(1);
+            }
+            if (!pair_order_parse(argv[index+1], &order)) {
+                printf("ERROR: unknown pair order [%s]\n", argv[index+1]);
+                usage();
+                exit(1);
+            }
+            ++index;
+        } else if (strcmp(argv[index], "-r")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing sum mode\n");
+                usage();
+                exit(1);
+            }
+            if (!float_sum_mode_parse(argv[index+1], &sum_mode)) {
+                printf("ERROR: unknown sum mode [%s]\n", argv[index+1]);
+                usage();
+                exit(1);
+            }
+            ++index;
+        } else if (strcmp(argv[index], "-j")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing thread count\n");
+                usage();
+                exit(1);
+            }
+            thread_count = atoi(argv[index+1]);
+            ++index;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "chn:s:")) != -1) {
+    while( (opt = getopt(argc, argv, "chj:n:o:qr:s:Sz")) != -1) {
         switch (opt) {
             case 'c':
                 is_clustered = true;
@@ -150,6 +834,10 @@ int main (int argc, char *argv[]) {
                 exit(0);
                 break;
 
+            case 'j':
+                thread_count = atoi(optarg);
+                break;
+
             case 'n':
                 count = strtoull(optarg, NULL, 0);
                 break;
@@ -158,6 +846,34 @@ int main (int argc, char *argv[]) {
                 seed = strtoul(optarg, NULL, 0);
                 break;
 
+            case 'S':
+                binary_layout = PAIR_LAYOUT_SOA;
+                break;
+
+            case 'q':
+                binary_layout = PAIR_LAYOUT_Q32;
+                break;
+
+            case 'z':
+                compress = true;
+                break;
+
+            case 'o':
+                if (!pair_order_parse(optarg, &order)) {
+                    fprintf(stderr, "ERROR unknown pair order [%s]\n", optarg);
+                    usage();
+                    exit(1);
+                }
+                break;
+
+            case 'r':
+                if (!float_sum_mode_parse(optarg, &sum_mode)) {
+                    fprintf(stderr, "ERROR unknown sum mode [%s]\n", optarg);
+                    usage();
+                    exit(1);
+                }
+                break;
+
             default:
                 fprintf(stderr, "MY_ERROR Invalid command line option\n");
                 usage();
@@ -175,6 +891,16 @@ int main (int argc, char *argv[]) {
         usage();
         exit(1);
     }
+    if (thread_count < 0) {
+        fprintf(stderr, "ERROR invalid thread count [%d]\n", thread_count);
+        usage();
+        exit(1);
+    }
+    if (compress && binary_layout == PAIR_LAYOUT_AOS) {
+        fprintf(stderr, "ERROR -z compresses columns, use it with -S or -q\n");
+        usage();
+        exit(1);
+    }
 
     printf("==============\n");
     printf("Data Generator\n");
@@ -203,14 +929,29 @@ int main (int argc, char *argv[]) {
        MY_ERROR("Stats filename overflow\n");
     }
 
+    ret = snprintf((char *)&answers_outfile, MAX_FILENAME_LEN, "test_data_seed_%u_count_%u_timestamp_%s.answers", seed, count, timestamp);
+    if (ret>=MAX_FILENAME_LEN) {
+       MY_ERROR("Answers filename overflow\n");
+    }
+
     printf("Distribution             [%s]\n", is_clustered ? "Clustered" : "Uniform");
     printf("Using Count              [%u]\n", count);
     printf("Using Seed               [%u]\n", seed);
-    printf("Using RAND_MAX           [%u]\n", RAND_MAX);
+    printf("Using RNG                [xoshiro256** x%d lanes %d rows per stream]\n", RNG_LANES, GEN_BLOCK_ROWS);
+    if (thread_count > 0) {
+        printf("Using threads            [%d]\n", thread_count);
+    }
     printf("Using timestamp          [%s]\n", timestamp);
     printf("Using json_outfile       [%s]\n", json_outfile);
     printf("Using binary_outfile     [%s]\n", binary_outfile);
+    printf("Binary layout            [pair file v%d %s]\n", PAIR_FILE_VERSION, pair_file_layout_name(binary_layout));
+    if (compress) {
+        printf("Binary compression       [%s, %d rows per block]\n", pair_file_compression_name(PAIR_COMPRESSION_BLOCKS), GEN_BLOCK_ROWS);
+    }
+    printf("Pair order               [%s]\n", pair_order_name(order));
+    printf("Sum mode                 [%s]\n", float_sum_mode_name(sum_mode));
     printf("Using stats_outfile      [%s]\n", stats_outfile);
+    printf("Using answers_outfile    [%s]\n", answers_outfile);
     if (is_clustered) {
         printf("Start cluster            [%3.16f][%3.16f]\n", cluster_x, cluster_y);
     }
@@ -220,7 +961,7 @@ int main (int argc, char *argv[]) {
     if (!json_fp) {
         MY_ERROR("Failed to open json file [%d][%s]\n", errno, strerror(errno));
     }
-    binary_fp = fopen(binary_outfile, "w");
+    binary_fp = fopen(binary_outfile, "wb");
     if (!binary_fp) {
         MY_ERROR("Failed to open binary file [%d][%s]\n", errno, strerror(errno));
     }
@@ -228,105 +969,95 @@ int main (int argc, char *argv[]) {
     if (!stats_fp) {
         MY_ERROR("Failed to open stats file [%d][%s]\n", errno, strerror(errno));
     }
+    answers_fp = fopen(answers_outfile, "wb");
+    if (!answers_fp) {
+        MY_ERROR("Failed to open answers file [%d][%s]\n", errno, strerror(errno));
+    }
 
     fprintf(stats_fp, "Distribution             [%s]\n", is_clustered ? "Clustered" : "Uniform");
     fprintf(stats_fp, "Using Count              [%u]\n", count);
     fprintf(stats_fp, "Using Seed               [%u]\n", seed);
-    fprintf(stats_fp, "Using RAND_MAX           [%u]\n", RAND_MAX);
+    fprintf(stats_fp, "Using RNG                [xoshiro256** x%d lanes %d rows per stream]\n", RNG_LANES, GEN_BLOCK_ROWS);
     fprintf(stats_fp, "Using timestamp          [%s]\n", timestamp);
     fprintf(stats_fp, "Using json_outfile       [%s]\n", json_outfile);
     fprintf(stats_fp, "Using binary_outfile     [%s]\n", binary_outfile);
+    fprintf(stats_fp, "Binary layout            [pair file v%d %s]\n", PAIR_FILE_VERSION, pair_file_layout_name(binary_layout));
+    if (compress) {
+        fprintf(stats_fp, "Binary compression       [%s, %d rows per block]\n", pair_file_compression_name(PAIR_COMPRESSION_BLOCKS), GEN_BLOCK_ROWS);
+    }
+    fprintf(stats_fp, "Pair order               [%s]\n", pair_order_name(order));
+    fprintf(stats_fp, "Sum mode                 [%s]\n", float_sum_mode_name(sum_mode));
     fprintf(stats_fp, "Using stats_outfile      [%s]\n", stats_outfile);
+    fprintf(stats_fp, "Using answers_outfile    [%s]\n", answers_outfile);
     if (is_clustered) {
             fprintf(stats_fp, "Start cluster            [%3.16f][%3.16f]\n", cluster_x, cluster_y);
     }
 
-    /* start json structure */
-    fprintf(json_fp, "{\"pairs\":[\n");
-
-    srand(seed);
-
-    double sum = 0;
-    bool first_line = true;
     int num_clusters = 1;
-    uint64_t cluster_threshold = count / NUM_CLUSTERS;
-
-    for (uint64_t i=0; i<count; i++) {
-        double X0, Y0, X1, Y1;
-        double H_DIST;
-       
-        if (is_clustered) {
-            if ( i == cluster_threshold) {
-                // generate new cluster origin
-                cluster_x = get_random_data(X_RADIUS);
-                cluster_y = get_random_data(Y_RADIUS);
-                fprintf(stats_fp,"New cluster              [%3.16f][%3.16f]\n", cluster_x, cluster_y);
-                printf("New cluster              [%3.16f][%3.16f]\n", cluster_x, cluster_y);
-                num_clusters++;
-                cluster_threshold += count / NUM_CLUSTERS;
-            }
-            X0 = cluster_x + get_random_data(X_RADIUS/4);
-            Y0 = cluster_y + get_random_data(Y_RADIUS/4);
-            X1 = cluster_x + get_random_data(X_RADIUS/4);
-            Y1 = cluster_y + get_random_data(Y_RADIUS/4);
-        } else {
-            X0 = get_random_data(X_RADIUS);
-            Y0 = get_random_data(Y_RADIUS);
-            X1 = get_random_data(X_RADIUS);
-            Y1 = get_random_data(Y_RADIUS);
-        }
-        H_DIST = ReferenceHaversine(X0, Y0, X1, Y1, APPROX_EARTH_RADIUS);
-        sum += H_DIST;
-
-        /*
-        {"x0":102.1633205722960440, "y0":-24.9977499718717624, "x1":-14.3322557404258362, "y1":62.6708294856625940},
-        */
-        if (!first_line) fprintf(json_fp, ",\n");
-        fprintf(json_fp, "{\"x0\":%3.16f, \"y0\":%3.16f, \"x1\":%3.16f, \"y1\":%3.16f}", X0, Y0, X1, Y1);
-        fwrite(&X0, sizeof(double), 1, binary_fp);
-        fwrite(&Y0, sizeof(double), 1, binary_fp);
-        fwrite(&X1, sizeof(double), 1, binary_fp);
-        fwrite(&Y1, sizeof(double), 1, binary_fp);
-        fwrite(&H_DIST, sizeof(double), 1, binary_fp);
-        binary_write_count += 5;
-        first_line = false;
-
-    }
-    /* close out json structure */
-    fprintf(json_fp, "\n]}\n");
+
+    struct value_range range = {};
+    struct quant_error quant = {};
+    uint64_t compressed_bytes = 0;
+    double sum = generate_pairs(json_fp, binary_fp, stats_fp, answers_fp, count, seed, is_clustered, binary_layout, compress, order, sum_mode,
+                                thread_count, &range, &num_clusters, &quant, &compressed_bytes);
+    unsigned int binary_write_count = count * BINARY_ROW_DOUBLES;
+    size_t binary_bytes = (size_t)count * BINARY_ROW_DOUBLES * sizeof(double);
+    if (binary_layout == PAIR_LAYOUT_Q32) {
+        binary_write_count = count * 4;
+        binary_bytes = (size_t)count * 4 * sizeof(int32_t);
+    }
 
     printf("\n\n");
     if (is_clustered) {
         printf("num_clusters             [%d]\n", num_clusters);
         fprintf(stats_fp, "num_clusters             [%d]\n", num_clusters);
     }
-    printf("pos_min                  %3.16f\n", pos_min);
-    printf("pos_max                  %3.16f\n", pos_max);
-    printf("neg_min                  %3.16f\n", neg_min);
-    printf("neg_max                  %3.16f\n", neg_max);
+    printf("pos_min                  %3.16f\n", range.pos_min);
+    printf("pos_max                  %3.16f\n", range.pos_max);
+    printf("neg_min                  %3.16f\n", range.neg_min);
+    printf("neg_max                  %3.16f\n", range.neg_max);
     printf("\n\n");
     
-    fprintf(stats_fp, "pos_min                  %3.16f\n", pos_min);
-    fprintf(stats_fp, "pos_max                  %3.16f\n", pos_max);
-    fprintf(stats_fp, "neg_min                  %3.16f\n", neg_min);
-    fprintf(stats_fp, "neg_max                  %3.16f\n", neg_max);
+    fprintf(stats_fp, "pos_min                  %3.16f\n", range.pos_min);
+    fprintf(stats_fp, "pos_max                  %3.16f\n", range.pos_max);
+    fprintf(stats_fp, "neg_min                  %3.16f\n", range.neg_min);
+    fprintf(stats_fp, "neg_max                  %3.16f\n", range.neg_max);
 
     
     double average = sum/count;
     printf("binary_write_count     %u\n", binary_write_count);
-    printf("binary_bytes_writen    %zu\n", binary_write_count*sizeof(double));
+    printf("binary_bytes_writen    %zu\n", binary_bytes);
+    if (compress) {
+        printf("compressed_bytes       %" PRIu64 " (ratio %.4f)\n", compressed_bytes, binary_bytes ? (double)compressed_bytes / binary_bytes : 0);
+    }
     printf("sum H_DIST             %3.16f\n", sum);
     printf("average H_DIST         %3.16f\n\n", average);
 
     fprintf(stats_fp, "binary_write_count       %u\n", binary_write_count);
-    fprintf(stats_fp, "binary_bytes_writen      %zu\n", binary_write_count*sizeof(double));
+    fprintf(stats_fp, "binary_bytes_writen      %zu\n", binary_bytes);
+    if (compress) {
+        fprintf(stats_fp, "compressed_bytes         %" PRIu64 " (ratio %.4f)\n", compressed_bytes, binary_bytes ? (double)compressed_bytes / binary_bytes : 0);
+    }
     fprintf(stats_fp, "sum H_DIST               %3.16f\n", sum);
     fprintf(stats_fp, "average H_DIST           %3.16f\n\n", average);
 
+    if (binary_layout == PAIR_LAYOUT_Q32) {
+        printf("Q32 step                 %3.16e degrees\n", 1.0 / PAIR_FILE_Q32_STEPS);
+        printf("Q32 max pair error       %3.16e\n", quant.max_error);
+        printf("exact sum H_DIST         %3.16f\n", quant.exact_sum);
+        printf("Q32 sum error            %3.16e (relative %3.4e)\n\n", sum - quant.exact_sum, (sum - quant.exact_sum) / quant.exact_sum);
+
+        fprintf(stats_fp, "Q32 step                 %3.16e degrees\n", 1.0 / PAIR_FILE_Q32_STEPS);
+        fprintf(stats_fp, "Q32 max pair error       %3.16e\n", quant.max_error);
+        fprintf(stats_fp, "exact sum H_DIST         %3.16f\n", quant.exact_sum);
+        fprintf(stats_fp, "Q32 sum error            %3.16e (relative %3.4e)\n\n", sum - quant.exact_sum, (sum - quant.exact_sum) / quant.exact_sum);
+    }
+
 
     fclose(json_fp);
     fclose(binary_fp);
     fclose(stats_fp);
+    fclose(answers_fp);
 
     return 0;
 }
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "float_format.h"
+
+#define FRACTION_DIGITS     16
+#define FRACTION_SCALE      10000000000000000ULL    // 10^16
+
+/*
+ * Slow path, anything the integer path can not represent exactly
+ */
+static size_t format_fixed16_printf(char *out, double value) {
+    char buffer[FORMAT_FIXED16_MAX_LEN + 1];
+    int len = snprintf(buffer, sizeof(buffer), "%3.16f", value);
+    memcpy(out, buffer, len);
+    return len;
+}
+
+size_t format_fixed16(char *out, double value) {
+#if defined(__SIZEOF_INT128__)
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bool negative = bits >> 63;
+    int biased_exponent = (bits >> 52) & 0x7ff;
+    uint64_t mantissa = bits & ((1ULL << 52) - 1);
+
+    /*
+     * value = mantissa * 2^exponent, only handle |value| < 2^53 so that
+     * mantissa * 10^16 always fits in 128 bits before the shift
+     */
+    if (biased_exponent == 0x7ff || biased_exponent >= 1023 + 53) {
+        return format_fixed16_printf(out, value);
+    }
+    int exponent;
+    if (biased_exponent == 0) {
+        exponent = 1 - 1075;
+    } else {
+        mantissa |= 1ULL << 52;
+        exponent = biased_exponent - 1075;
+    }
+
+    /*
+     * scaled = round_half_even(mantissa * 10^16 * 2^exponent), this is the
+     * value in units of 10^-16 computed from the exact binary value
+     */
+    unsigned __int128 product = (unsigned __int128)mantissa * FRACTION_SCALE;
+    unsigned __int128 scaled;
+    if (exponent >= 0) {
+        scaled = product << exponent;
+    } else {
+        int shift = -exponent;
+        if (shift >= 128) {
+            scaled = 0;     // far below half a unit
+        } else {
+            unsigned __int128 half = (unsigned __int128)1 << (shift - 1);
+            unsigned __int128 remainder = product & ((half << 1) - 1);
+            scaled = product >> shift;
+            if (remainder > half || (remainder == half && (scaled & 1))) {
+                scaled++;
+            }
+        }
+    }
+
+    uint64_t integer_part = (uint64_t)(scaled / FRACTION_SCALE);
+    uint64_t fraction_part = (uint64_t)(scaled % FRACTION_SCALE);
+
+    char *ptr = out;
+    if (negative) {
+        *ptr++ = '-';
+    }
+
+    // integer digits, at least one
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = '0' + (integer_part % 10);
+        integer_part /= 10;
+    } while (integer_part);
+    // "%3" pads short numbers with spaces on the left, the shortest
+    // output here is already "0." + 16 digits so it never applies
+    while (count) {
+        *ptr++ = digits[--count];
+    }
+
+    *ptr++ = '.';
+    for (int i=FRACTION_DIGITS-1; i>=0; i--) {
+        ptr[i] = '0' + (fraction_part % 10);
+        fraction_part /= 10;
+    }
+    ptr += FRACTION_DIGITS;
+
+    return ptr - out;
+#else
+    return format_fixed16_printf(out, value);
+#endif
+}
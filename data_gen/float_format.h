@@ -0,0 +1,13 @@
+#include <stddef.h>
+
+/*
+ * Double to text with 16 fixed decimals, the same text printf produces for
+ * "%3.16f" (exact decimal value rounded half to even, '-' kept for negative
+ * zero) without going through the printf machinery.
+ *
+ * Writes at most FORMAT_FIXED16_MAX_LEN bytes to out, no terminating NUL.
+ * Returns the number of bytes written.
+ */
+#define FORMAT_FIXED16_MAX_LEN  330     // -DBL_MAX has 309 integer digits
+
+size_t format_fixed16(char *out, double value);
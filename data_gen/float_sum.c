@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "float_sum.h"
+
+/*
+ * Add two tree nodes. For kahan the high parts are added with a two sum,
+ * the exact rounding error joins the low parts and the result is
+ * renormalized so hi is always the rounded value of hi + lo.
+ */
+static struct float_sum_node node_add(enum float_sum_mode_e mode, struct float_sum_node a, struct float_sum_node b) {
+    struct float_sum_node r;
+    if (mode != FLOAT_SUM_KAHAN) {
+        r.hi = a.hi + b.hi;
+        r.lo = 0;
+        return r;
+    }
+    double s = a.hi + b.hi;
+    double b_part = s - a.hi;
+    double error = (a.hi - (s - b_part)) + (b.hi - b_part);
+    double lo = (a.lo + b.lo) + error;
+    r.hi = s + lo;
+    r.lo = lo - (r.hi - s);
+    return r;
+}
+
+/*
+ * Kahan keeps the negated lost low bits of every lane in lane_error
+ */
+static struct float_sum_node lanes_node(enum float_sum_mode_e mode, const double lane[FLOAT_SUM_LANES],
+                                        const double lane_error[FLOAT_SUM_LANES]) {
+    struct float_sum_node nodes[FLOAT_SUM_LANES];
+    for (int l=0; l<FLOAT_SUM_LANES; l++) {
+        nodes[l].hi = lane[l];
+        nodes[l].lo = -lane_error[l];
+    }
+    for (int width=1; width<FLOAT_SUM_LANES; width*=2) {
+        for (int l=0; l<FLOAT_SUM_LANES; l+=2*width) {
+            nodes[l] = node_add(mode, nodes[l], nodes[l+width]);
+        }
+    }
+    return nodes[0];
+}
+
+/*
+ * Sum of one whole leaf, same lane order as adding the values one by one
+ */
+static struct float_sum_node leaf_node(enum float_sum_mode_e mode, const double *values) {
+    double lane[FLOAT_SUM_LANES] = {};
+    double lane_error[FLOAT_SUM_LANES] = {};
+
+    if (mode == FLOAT_SUM_KAHAN) {
+        for (size_t i=0; i<FLOAT_SUM_LEAF_VALUES; i+=FLOAT_SUM_LANES) {
+            for (int l=0; l<FLOAT_SUM_LANES; l++) {
+                double y = values[i+l] - lane_error[l];
+                double t = lane[l] + y;
+                lane_error[l] = (t - lane[l]) - y;
+                lane[l] = t;
+            }
+        }
+    } else {
+        for (size_t i=0; i<FLOAT_SUM_LEAF_VALUES; i+=FLOAT_SUM_LANES) {
+            for (int l=0; l<FLOAT_SUM_LANES; l++) {
+                lane[l] += values[i+l];
+            }
+        }
+    }
+    return lanes_node(mode, lane, lane_error);
+}
+
+/*
+ * Add a node of 2^level leaves after the count values already in sum,
+ * count must be a multiple of that many leaves. Every set bit of the leaf
+ * count the node carries into is a finished left subtree.
+ */
+static void push_node(struct float_sum *sum, struct float_sum_node node, int level) {
+    uint64_t leaves = sum->count / FLOAT_SUM_LEAF_VALUES;
+    while ((leaves >> level) & 1) {
+        node = node_add(sum->mode, sum->level[level], node);
+        level++;
+    }
+    sum->level[level] = node;
+}
+
+void float_sum_init(struct float_sum *sum, enum float_sum_mode_e mode) {
+    memset(sum, 0, sizeof(*sum));
+    sum->mode = mode;
+}
+
+void float_sum_add(struct float_sum *sum, double value) {
+    if (sum->mode == FLOAT_SUM_NAIVE) {
+        sum->naive += value;
+        sum->count++;
+        return;
+    }
+
+    int l = sum->count % FLOAT_SUM_LANES;
+    if (sum->mode == FLOAT_SUM_KAHAN) {
+        double y = value - sum->lane_error[l];
+        double t = sum->lane[l] + y;
+        sum->lane_error[l] = (t - sum->lane[l]) - y;
+        sum->lane[l] = t;
+    } else {
+        sum->lane[l] += value;
+    }
+
+    if (sum->count % FLOAT_SUM_LEAF_VALUES == FLOAT_SUM_LEAF_VALUES - 1) {
+        push_node(sum, lanes_node(sum->mode, sum->lane, sum->lane_error), 0);
+        memset(sum->lane, 0, sizeof(sum->lane));
+        memset(sum->lane_error, 0, sizeof(sum->lane_error));
+    }
+    sum->count++;
+}
+
+void float_sum_add_array(struct float_sum *sum, const double *values, size_t n) {
+    if (sum->mode == FLOAT_SUM_NAIVE) {
+        double naive = sum->naive;
+        for (size_t i=0; i<n; i++) {
+            naive += values[i];
+        }
+        sum->naive = naive;
+        sum->count += n;
+        return;
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        if (sum->count % FLOAT_SUM_LEAF_VALUES == 0 && n - i >= FLOAT_SUM_LEAF_VALUES) {
+            push_node(sum, leaf_node(sum->mode, &values[i]), 0);
+            sum->count += FLOAT_SUM_LEAF_VALUES;
+            i += FLOAT_SUM_LEAF_VALUES;
+        } else {
+            float_sum_add(sum, values[i++]);
+        }
+    }
+}
+
+bool float_sum_merge(struct float_sum *sum, const struct float_sum *part) {
+    if (sum->mode != part->mode) {
+        return false;
+    }
+    if (sum->mode == FLOAT_SUM_NAIVE) {
+        sum->naive += part->naive;
+        sum->count += part->count;
+        return true;
+    }
+
+    // the largest subtree of part must start on a boundary of its size
+    uint64_t part_leaves = part->count / FLOAT_SUM_LEAF_VALUES;
+    if (sum->count % FLOAT_SUM_LEAF_VALUES != 0) {
+        return false;
+    }
+    int top = 0;
+    while ((part_leaves >> top) > 1) {
+        top++;
+    }
+    if ((sum->count / FLOAT_SUM_LEAF_VALUES) & ((UINT64_C(1) << top) - 1)) {
+        return false;
+    }
+
+    for (int level=FLOAT_SUM_LEVELS-1; level>=0; level--) {
+        if ((part_leaves >> level) & 1) {
+            push_node(sum, part->level[level], level);
+            sum->count += (uint64_t)FLOAT_SUM_LEAF_VALUES << level;
+        }
+    }
+    // sum ends on a leaf boundary, so its lanes are all 0
+    memcpy(sum->lane, part->lane, sizeof(sum->lane));
+    memcpy(sum->lane_error, part->lane_error, sizeof(sum->lane_error));
+    sum->count += part->count % FLOAT_SUM_LEAF_VALUES;
+    return true;
+}
+
+double float_sum_result(const struct float_sum *sum) {
+    if (sum->mode == FLOAT_SUM_NAIVE) {
+        return sum->naive;
+    }
+
+    // fold the unfinished subtrees newest first, like a finished tree would
+    struct float_sum_node total = {};
+    bool have_total = false;
+    if (sum->count % FLOAT_SUM_LEAF_VALUES) {
+        total = lanes_node(sum->mode, sum->lane, sum->lane_error);
+        have_total = true;
+    }
+    uint64_t leaves = sum->count / FLOAT_SUM_LEAF_VALUES;
+    for (int level=0; level<FLOAT_SUM_LEVELS; level++) {
+        if ((leaves >> level) & 1) {
+            total = have_total ? node_add(sum->mode, sum->level[level], total) : sum->level[level];
+            have_total = true;
+        }
+    }
+    return total.hi + total.lo;
+}
+
+bool float_sum_mode_parse(const char *name, enum float_sum_mode_e *mode) {
+    for (uint32_t m=FLOAT_SUM_NAIVE; m<=FLOAT_SUM_KAHAN; m++) {
+        if (strcmp(name, float_sum_mode_name(m)) == 0) {
+            *mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *float_sum_mode_name(uint32_t mode) {
+    switch (mode) {
+        case FLOAT_SUM_NAIVE:
+            return "naive";
+        case FLOAT_SUM_PAIRWISE:
+            return "pairwise";
+        case FLOAT_SUM_KAHAN:
+            return "kahan";
+        default:
+            return "unknown";
+    }
+}
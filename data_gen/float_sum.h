@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Deterministic floating point sum
+ *
+ * Adding doubles one after the other (naive) gives a result that depends on
+ * the order of the additions, so a sum computed over blocks on several
+ * threads or over several lanes of a vector differs in the last bits from
+ * the sequential one, and the rounding error grows with the count.
+ *
+ * The pairwise mode fixes the shape of the additions by value index alone:
+ *  - value i goes to lane i % FLOAT_SUM_LANES of its leaf of
+ *    FLOAT_SUM_LEAF_VALUES values, the lanes of a leaf are added as a
+ *    balanced tree, ((l0+l1)+(l2+l3))+((l4+l5)+(l6+l7))
+ *  - leaves are added as a balanced binary tree over the leaf index, a
+ *    binary counter keeps one partial sum per tree level
+ *  - a last partial tree is folded newest first into the levels above it
+ * The lanes map to one AVX-512 register, two AVX2 or four SSE2 registers or
+ * eight scalar accumulators with the same result, and the error grows with
+ * the log of the count instead of the count.
+ *
+ * The kahan mode has the same shape, every lane is Kahan compensated and
+ * the tree carries the compensation as a second double, which gives close
+ * to the correctly rounded sum.
+ *
+ * A sum over a range that starts on a tree boundary can be merged into the
+ * sum of everything before it with the exact same result as adding the
+ * values one by one, so every FLOAT_SUM_BLOCK_VALUES block can be summed on
+ * any thread and the block sums merged in block order.
+ */
+
+enum float_sum_mode_e {
+    FLOAT_SUM_NAIVE,
+    FLOAT_SUM_PAIRWISE,
+    FLOAT_SUM_KAHAN,
+};
+
+#define FLOAT_SUM_LANES         8
+#define FLOAT_SUM_LEAF_VALUES   1024
+#define FLOAT_SUM_BLOCK_VALUES  65536   // 64 leaves, one complete tree level
+#define FLOAT_SUM_LEVELS        64
+
+struct float_sum_node {
+    double hi;
+    double lo;                  // kahan compensation, 0 otherwise
+};
+
+struct float_sum {
+    enum float_sum_mode_e mode;
+    uint64_t count;
+    double naive;
+    double lane[FLOAT_SUM_LANES];
+    double lane_error[FLOAT_SUM_LANES];
+    struct float_sum_node level[FLOAT_SUM_LEVELS];  // level l holds 2^l leaves when bit l of the leaf count is set
+};
+
+void float_sum_init(struct float_sum *sum, enum float_sum_mode_e mode);
+void float_sum_add(struct float_sum *sum, double value);
+void float_sum_add_array(struct float_sum *sum, const double *values, size_t n);
+
+/*
+ * Merge part, the sum of the values that follow the ones in sum, into sum.
+ * Returns false when the modes differ or part does not start on a tree
+ * boundary of its size, which never happens for a part of at most
+ * FLOAT_SUM_BLOCK_VALUES values merged after whole blocks. Naive parts
+ * are simply added, so the naive result depends on the split.
+ */
+bool float_sum_merge(struct float_sum *sum, const struct float_sum *part);
+
+double float_sum_result(const struct float_sum *sum);
+
+/*
+ * Parse "naive", "pairwise" or "kahan"
+ */
+bool float_sum_mode_parse(const char *name, enum float_sum_mode_e *mode);
+const char *float_sum_mode_name(uint32_t mode);
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#if defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#include "haversine_batch.h"
+
+#define RADIANS_PER_DEGREE      0.01745329251994329577
+
+// pi split in two so k*pi is subtracted with ~107 bits of precision
+#define PI_HI                   3.14159265358979311600e+00
+#define PI_LO                   1.22464679914735317723e-16
+#define INV_PI                  3.18309886183790671538e-01
+#define PIO2_HI                 1.57079632679489655800e+00
+#define PIO2_LO                 6.12323399573676603587e-17
+
+/*
+ * Taylor coefficients, after range reduction |r| <= pi/2 so the first
+ * dropped term is below 1e-20
+ *   sin(r) = r + r^3 * S(r^2)
+ *   cos(r) = 1 + r^2 * C(r^2)
+ */
+static const double sin_coeff[] = {
+    -1.0/6.0,
+    1.0/120.0,
+    -1.0/5040.0,
+    1.0/362880.0,
+    -1.0/39916800.0,
+    1.0/6227020800.0,
+    -1.0/1307674368000.0,
+    1.0/355687428096000.0,
+    -1.0/121645100408832000.0,
+    1.0/51090942171709440000.0,
+    -1.0/25852016738884976640000.0,
+};
+#define SIN_COEFF_COUNT     (sizeof(sin_coeff)/sizeof(sin_coeff[0]))
+
+static const double cos_coeff[] = {
+    -1.0/2.0,
+    1.0/24.0,
+    -1.0/720.0,
+    1.0/40320.0,
+    -1.0/3628800.0,
+    1.0/479001600.0,
+    -1.0/87178291200.0,
+    1.0/20922789888000.0,
+    -1.0/6402373705728000.0,
+    1.0/2432902008176640000.0,
+    -1.0/1124000727777607680000.0,
+    1.0/620448401733239439360000.0,
+};
+#define COS_COEFF_COUNT     (sizeof(cos_coeff)/sizeof(cos_coeff[0]))
+
+/*
+ * fdlibm rational approximation, asin(s) = s + s*R(s^2) for s <= 0.5 and
+ * asin(s) = pi/2 - 2*(w + w*R(t)) with t = (1-s)/2, w = sqrt(t) above that
+ */
+#define ASIN_P0      1.66666666666666657415e-01
+#define ASIN_P1     -3.25565818622400915405e-01
+#define ASIN_P2      2.01212532134862925881e-01
+#define ASIN_P3     -4.00555345006794114027e-02
+#define ASIN_P4      7.91534994289814532176e-04
+#define ASIN_P5      3.47933107596021167570e-05
+#define ASIN_Q1     -2.40339491173441421878e+00
+#define ASIN_Q2      2.02094576023350569471e+00
+#define ASIN_Q3     -6.88283971605453293030e-01
+#define ASIN_Q4      7.70381505559019352791e-02
+
+static enum haversine_isa_e selected_isa = HAVERSINE_AUTO;
+
+const char *haversine_isa_name(enum haversine_isa_e isa) {
+    switch (isa) {
+        case HAVERSINE_SCALAR:  return "Scalar";
+        case HAVERSINE_AVX2:    return "AVX2";
+        case HAVERSINE_AVX512:  return "AVX512";
+        default:                return "Auto";
+    }
+}
+
+enum haversine_isa_e haversine_batch_select(enum haversine_isa_e isa) {
+    enum haversine_isa_e widest = HAVERSINE_SCALAR;
+#if defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        widest = HAVERSINE_AVX2;
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        widest = HAVERSINE_AVX512;
+    }
+#endif
+    if (isa == HAVERSINE_AUTO || isa > widest) {
+        isa = widest;
+    }
+    selected_isa = isa;
+    return isa;
+}
+
+/*
+ * Scalar version, every step matches a vector instruction of the SIMD
+ * kernels so all of them round the same way
+ */
+static double sin_cos_reduce(double x, double *sign) {
+    double k = nearbyint(x * INV_PI);
+    // (-1)^k without integer conversion, k - 2*floor(k/2) is 0 or 1
+    *sign = fma(-2.0, k - 2.0*floor(k*0.5), 1.0);
+    double r = fma(-k, PI_HI, x);
+    return fma(-k, PI_LO, r);
+}
+
+static double poly_sin(double x) {
+    double sign;
+    double r = sin_cos_reduce(x, &sign);
+    double r2 = r*r;
+    double p = sin_coeff[SIN_COEFF_COUNT-1];
+    for (int i=SIN_COEFF_COUNT-2; i>=0; i--) {
+        p = fma(p, r2, sin_coeff[i]);
+    }
+    return sign * fma(r*r2, p, r);
+}
+
+static double poly_cos(double x) {
+    double sign;
+    double r = sin_cos_reduce(x, &sign);
+    double r2 = r*r;
+    double p = cos_coeff[COS_COEFF_COUNT-1];
+    for (int i=COS_COEFF_COUNT-2; i>=0; i--) {
+        p = fma(p, r2, cos_coeff[i]);
+    }
+    return sign * fma(r2, p, 1.0);
+}
+
+static double poly_asin_ratio(double t) {
+    double p = fma(t, ASIN_P5, ASIN_P4);
+    p = fma(t, p, ASIN_P3);
+    p = fma(t, p, ASIN_P2);
+    p = fma(t, p, ASIN_P1);
+    p = fma(t, p, ASIN_P0);
+    p = p * t;
+    double q = fma(t, ASIN_Q4, ASIN_Q3);
+    q = fma(t, q, ASIN_Q2);
+    q = fma(t, q, ASIN_Q1);
+    q = fma(t, q, 1.0);
+    return p / q;
+}
+
+// s in [0, 1]
+static double poly_asin(double s) {
+    bool small = s <= 0.5;
+    double t = small ? s*s : (1.0 - s)*0.5;
+    double w = small ? s : sqrt(t);
+    double v = fma(w, poly_asin_ratio(t), w);
+    return small ? v : PIO2_HI - (2.0*v - PIO2_LO);
+}
+
+static double haversine_scalar(double x0, double y0, double x1, double y1, double earth_radius) {
+    double d_lat = RADIANS_PER_DEGREE * (y1 - y0);
+    double d_lon = RADIANS_PER_DEGREE * (x1 - x0);
+    double lat1 = RADIANS_PER_DEGREE * y0;
+    double lat2 = RADIANS_PER_DEGREE * y1;
+
+    double sin_lat = poly_sin(d_lat*0.5);
+    double sin_lon = poly_sin(d_lon*0.5);
+    double a = fma(poly_cos(lat1)*poly_cos(lat2), sin_lon*sin_lon, sin_lat*sin_lat);
+    a = fmin(fmax(a, 0.0), 1.0);
+
+    return earth_radius * (2.0*poly_asin(sqrt(a)));
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2,fma")))
+static __m256d sin_cos_reduce_avx2(__m256d x, __m256d *sign) {
+    __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(INV_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d half_k = _mm256_floor_pd(_mm256_mul_pd(k, _mm256_set1_pd(0.5)));
+    __m256d odd = _mm256_fnmadd_pd(_mm256_set1_pd(2.0), half_k, k);
+    *sign = _mm256_fmadd_pd(_mm256_set1_pd(-2.0), odd, _mm256_set1_pd(1.0));
+    __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PI_HI), x);
+    return _mm256_fnmadd_pd(k, _mm256_set1_pd(PI_LO), r);
+}
+
+__attribute__((target("avx2,fma")))
+static __m256d poly_sin_avx2(__m256d x) {
+    __m256d sign;
+    __m256d r = sin_cos_reduce_avx2(x, &sign);
+    __m256d r2 = _mm256_mul_pd(r, r);
+    __m256d p = _mm256_set1_pd(sin_coeff[SIN_COEFF_COUNT-1]);
+    for (int i=SIN_COEFF_COUNT-2; i>=0; i--) {
+        p = _mm256_fmadd_pd(p, r2, _mm256_set1_pd(sin_coeff[i]));
+    }
+    return _mm256_mul_pd(sign, _mm256_fmadd_pd(_mm256_mul_pd(r, r2), p, r));
+}
+
+__attribute__((target("avx2,fma")))
+static __m256d poly_cos_avx2(__m256d x) {
+    __m256d sign;
+    __m256d r = sin_cos_reduce_avx2(x, &sign);
+    __m256d r2 = _mm256_mul_pd(r, r);
+    __m256d p = _mm256_set1_pd(cos_coeff[COS_COEFF_COUNT-1]);
+    for (int i=COS_COEFF_COUNT-2; i>=0; i--) {
+        p = _mm256_fmadd_pd(p, r2, _mm256_set1_pd(cos_coeff[i]));
+    }
+    return _mm256_mul_pd(sign, _mm256_fmadd_pd(r2, p, _mm256_set1_pd(1.0)));
+}
+
+__attribute__((target("avx2,fma")))
+static __m256d poly_asin_avx2(__m256d s) {
+    __m256d small = _mm256_cmp_pd(s, _mm256_set1_pd(0.5), _CMP_LE_OQ);
+    __m256d t = _mm256_blendv_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), s), _mm256_set1_pd(0.5)),
+                                 _mm256_mul_pd(s, s), small);
+    __m256d w = _mm256_blendv_pd(_mm256_sqrt_pd(t), s, small);
+
+    __m256d p = _mm256_fmadd_pd(t, _mm256_set1_pd(ASIN_P5), _mm256_set1_pd(ASIN_P4));
+    p = _mm256_fmadd_pd(t, p, _mm256_set1_pd(ASIN_P3));
+    p = _mm256_fmadd_pd(t, p, _mm256_set1_pd(ASIN_P2));
+    p = _mm256_fmadd_pd(t, p, _mm256_set1_pd(ASIN_P1));
+    p = _mm256_fmadd_pd(t, p, _mm256_set1_pd(ASIN_P0));
+    p = _mm256_mul_pd(p, t);
+    __m256d q = _mm256_fmadd_pd(t, _mm256_set1_pd(ASIN_Q4), _mm256_set1_pd(ASIN_Q3));
+    q = _mm256_fmadd_pd(t, q, _mm256_set1_pd(ASIN_Q2));
+    q = _mm256_fmadd_pd(t, q, _mm256_set1_pd(ASIN_Q1));
+    q = _mm256_fmadd_pd(t, q, _mm256_set1_pd(1.0));
+
+    __m256d v = _mm256_fmadd_pd(w, _mm256_div_pd(p, q), w);
+    __m256d big = _mm256_sub_pd(_mm256_set1_pd(PIO2_HI),
+                                _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), v), _mm256_set1_pd(PIO2_LO)));
+    return _mm256_blendv_pd(big, v, small);
+}
+
+__attribute__((target("avx2,fma")))
+static size_t haversine_avx2(const double *x0, const double *y0, const double *x1, const double *y1,
+                             size_t n, double earth_radius, double *out) {
+    const __m256d radians = _mm256_set1_pd(RADIANS_PER_DEGREE);
+    const __m256d half = _mm256_set1_pd(0.5);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d vx0 = _mm256_loadu_pd(x0 + i);
+        __m256d vy0 = _mm256_loadu_pd(y0 + i);
+        __m256d vx1 = _mm256_loadu_pd(x1 + i);
+        __m256d vy1 = _mm256_loadu_pd(y1 + i);
+
+        __m256d d_lat = _mm256_mul_pd(radians, _mm256_sub_pd(vy1, vy0));
+        __m256d d_lon = _mm256_mul_pd(radians, _mm256_sub_pd(vx1, vx0));
+        __m256d lat1 = _mm256_mul_pd(radians, vy0);
+        __m256d lat2 = _mm256_mul_pd(radians, vy1);
+
+        __m256d sin_lat = poly_sin_avx2(_mm256_mul_pd(d_lat, half));
+        __m256d sin_lon = poly_sin_avx2(_mm256_mul_pd(d_lon, half));
+        __m256d cos_prod = _mm256_mul_pd(poly_cos_avx2(lat1), poly_cos_avx2(lat2));
+        __m256d a = _mm256_fmadd_pd(cos_prod, _mm256_mul_pd(sin_lon, sin_lon), _mm256_mul_pd(sin_lat, sin_lat));
+        a = _mm256_min_pd(_mm256_max_pd(a, _mm256_setzero_pd()), _mm256_set1_pd(1.0));
+
+        __m256d c = _mm256_mul_pd(_mm256_set1_pd(2.0), poly_asin_avx2(_mm256_sqrt_pd(a)));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_set1_pd(earth_radius), c));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static __m512d sin_cos_reduce_avx512(__m512d x, __m512d *sign) {
+    __m512d k = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(INV_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d half_k = _mm512_roundscale_pd(_mm512_mul_pd(k, _mm512_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __m512d odd = _mm512_fnmadd_pd(_mm512_set1_pd(2.0), half_k, k);
+    *sign = _mm512_fmadd_pd(_mm512_set1_pd(-2.0), odd, _mm512_set1_pd(1.0));
+    __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(PI_HI), x);
+    return _mm512_fnmadd_pd(k, _mm512_set1_pd(PI_LO), r);
+}
+
+__attribute__((target("avx512f")))
+static __m512d poly_sin_avx512(__m512d x) {
+    __m512d sign;
+    __m512d r = sin_cos_reduce_avx512(x, &sign);
+    __m512d r2 = _mm512_mul_pd(r, r);
+    __m512d p = _mm512_set1_pd(sin_coeff[SIN_COEFF_COUNT-1]);
+    for (int i=SIN_COEFF_COUNT-2; i>=0; i--) {
+        p = _mm512_fmadd_pd(p, r2, _mm512_set1_pd(sin_coeff[i]));
+    }
+    return _mm512_mul_pd(sign, _mm512_fmadd_pd(_mm512_mul_pd(r, r2), p, r));
+}
+
+__attribute__((target("avx512f")))
+static __m512d poly_cos_avx512(__m512d x) {
+    __m512d sign;
+    __m512d r = sin_cos_reduce_avx512(x, &sign);
+    __m512d r2 = _mm512_mul_pd(r, r);
+    __m512d p = _mm512_set1_pd(cos_coeff[COS_COEFF_COUNT-1]);
+    for (int i=COS_COEFF_COUNT-2; i>=0; i--) {
+        p = _mm512_fmadd_pd(p, r2, _mm512_set1_pd(cos_coeff[i]));
+    }
+    return _mm512_mul_pd(sign, _mm512_fmadd_pd(r2, p, _mm512_set1_pd(1.0)));
+}
+
+__attribute__((target("avx512f")))
+static __m512d poly_asin_avx512(__m512d s) {
+    __mmask8 small = _mm512_cmp_pd_mask(s, _mm512_set1_pd(0.5), _CMP_LE_OQ);
+    __m512d t = _mm512_mask_blend_pd(small, _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(1.0), s), _mm512_set1_pd(0.5)),
+                                     _mm512_mul_pd(s, s));
+    __m512d w = _mm512_mask_blend_pd(small, _mm512_sqrt_pd(t), s);
+
+    __m512d p = _mm512_fmadd_pd(t, _mm512_set1_pd(ASIN_P5), _mm512_set1_pd(ASIN_P4));
+    p = _mm512_fmadd_pd(t, p, _mm512_set1_pd(ASIN_P3));
+    p = _mm512_fmadd_pd(t, p, _mm512_set1_pd(ASIN_P2));
+    p = _mm512_fmadd_pd(t, p, _mm512_set1_pd(ASIN_P1));
+    p = _mm512_fmadd_pd(t, p, _mm512_set1_pd(ASIN_P0));
+    p = _mm512_mul_pd(p, t);
+    __m512d q = _mm512_fmadd_pd(t, _mm512_set1_pd(ASIN_Q4), _mm512_set1_pd(ASIN_Q3));
+    q = _mm512_fmadd_pd(t, q, _mm512_set1_pd(ASIN_Q2));
+    q = _mm512_fmadd_pd(t, q, _mm512_set1_pd(ASIN_Q1));
+    q = _mm512_fmadd_pd(t, q, _mm512_set1_pd(1.0));
+
+    __m512d v = _mm512_fmadd_pd(w, _mm512_div_pd(p, q), w);
+    __m512d big = _mm512_sub_pd(_mm512_set1_pd(PIO2_HI),
+                                _mm512_sub_pd(_mm512_mul_pd(_mm512_set1_pd(2.0), v), _mm512_set1_pd(PIO2_LO)));
+    return _mm512_mask_blend_pd(small, big, v);
+}
+
+__attribute__((target("avx512f")))
+static size_t haversine_avx512(const double *x0, const double *y0, const double *x1, const double *y1,
+                               size_t n, double earth_radius, double *out) {
+    const __m512d radians = _mm512_set1_pd(RADIANS_PER_DEGREE);
+    const __m512d half = _mm512_set1_pd(0.5);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m512d vx0 = _mm512_loadu_pd(x0 + i);
+        __m512d vy0 = _mm512_loadu_pd(y0 + i);
+        __m512d vx1 = _mm512_loadu_pd(x1 + i);
+        __m512d vy1 = _mm512_loadu_pd(y1 + i);
+
+        __m512d d_lat = _mm512_mul_pd(radians, _mm512_sub_pd(vy1, vy0));
+        __m512d d_lon = _mm512_mul_pd(radians, _mm512_sub_pd(vx1, vx0));
+        __m512d lat1 = _mm512_mul_pd(radians, vy0);
+        __m512d lat2 = _mm512_mul_pd(radians, vy1);
+
+        __m512d sin_lat = poly_sin_avx512(_mm512_mul_pd(d_lat, half));
+        __m512d sin_lon = poly_sin_avx512(_mm512_mul_pd(d_lon, half));
+        __m512d cos_prod = _mm512_mul_pd(poly_cos_avx512(lat1), poly_cos_avx512(lat2));
+        __m512d a = _mm512_fmadd_pd(cos_prod, _mm512_mul_pd(sin_lon, sin_lon), _mm512_mul_pd(sin_lat, sin_lat));
+        a = _mm512_min_pd(_mm512_max_pd(a, _mm512_setzero_pd()), _mm512_set1_pd(1.0));
+
+        __m512d c = _mm512_mul_pd(_mm512_set1_pd(2.0), poly_asin_avx512(_mm512_sqrt_pd(a)));
+        _mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_set1_pd(earth_radius), c));
+    }
+    return i;
+}
+#endif
+
+void haversine_batch(const double *x0, const double *y0, const double *x1, const double *y1,
+                     size_t n, double earth_radius, double *out) {
+    size_t done = 0;
+
+    if (selected_isa == HAVERSINE_AUTO) {
+        haversine_batch_select(HAVERSINE_AUTO);
+    }
+#if defined(__GNUC__)
+    if (selected_isa == HAVERSINE_AVX512) {
+        done = haversine_avx512(x0, y0, x1, y1, n, earth_radius, out);
+    } else if (selected_isa == HAVERSINE_AVX2) {
+        done = haversine_avx2(x0, y0, x1, y1, n, earth_radius, out);
+    }
+#endif
+    for (size_t i=done; i<n; i++) {
+        out[i] = haversine_scalar(x0[i], y0[i], x1[i], y1[i], earth_radius);
+    }
+}
@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Batch haversine distance
+ *
+ * Computes out[i] = haversine(x0[i], y0[i], x1[i], y1[i]) for n pairs with
+ * polynomial sin, cos and asin instead of libm calls, so the whole formula
+ * runs in vector registers. The AVX2 (4 lanes) and AVX-512 (8 lanes) kernels
+ * and the scalar fallback use the same operations with fused multiply adds,
+ * so they return bit identical results and only differ in speed.
+ * Results are not bit identical to ReferenceHaversine, use haversine_bench -a
+ * to see the error against it.
+ */
+
+enum haversine_isa_e {
+    HAVERSINE_AUTO,
+    HAVERSINE_SCALAR,
+    HAVERSINE_AVX2,
+    HAVERSINE_AVX512,
+};
+
+/*
+ * Pick the kernel used by haversine_batch, AUTO picks the widest one the CPU
+ * supports. Asking for an ISA the CPU does not have falls back to the widest
+ * supported one. Returns the selected ISA.
+ */
+enum haversine_isa_e haversine_batch_select(enum haversine_isa_e isa);
+const char *haversine_isa_name(enum haversine_isa_e isa);
+
+void haversine_batch(const double *x0, const double *y0, const double *x1, const double *y1,
+                     size_t n, double earth_radius, double *out);
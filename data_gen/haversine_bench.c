@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "haversine.h"
+#include "pair_soa.h"
+#include "haversine_batch.h"
+#include "pair_file.h"
+#include "pair_order.h"
+#include "float_sum.h"
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+#define APPROX_EARTH_RADIUS     6372.8
+#define BENCH_SEED              1234
+#define MAX_INPUT_FILES         8
+#define MAX_TEST_NAME           96
+#define MAX_LABEL               24
+#define FILE_BATCH_PAIRS        4096
+
+/*
+ * Haversine kernel benchmark
+ *
+ * Runs the haversine sum over the same random pairs stored as an array of
+ * structs (the json_data_parser -p layout) and as a structure of arrays
+ * (the -A layout), then over the SoA layout with the haversine_batch kernel
+ * for every ISA the CPU supports (-A -K), and reports the GB/s of pair data
+ * consumed.
+ *
+ * With -i the pairs come from data_gen pair files instead, in file order.
+ * Giving the same seed generated in draw order and sorted along a curve
+ * (data_gen -o) times the same pairs with and without spatial locality.
+ *
+ * With -a it reports the error of haversine_batch against ReferenceHaversine
+ * instead.
+ */
+enum bench_layout_e {
+    LAYOUT_AOS,
+    LAYOUT_SOA,
+    LAYOUT_SOA_BATCH,
+};
+
+struct data_item_s {
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+};
+
+struct test_context {
+    char name[MAX_TEST_NAME];
+    char *filename;             // NULL for random pairs
+    enum bench_layout_e layout;
+    enum haversine_isa_e isa;
+    size_t item_count;
+    struct data_item_s *aos;
+    struct pair_soa soa;
+    double sum;
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+/*
+ * Small xorshift so both layouts get the same pairs for a given count
+ */
+static uint64_t rng_state;
+
+static double random_degrees(double range) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((double)(rng_state >> 11) / (double)(1ULL << 53)) * 2.0 * range - range;
+}
+
+/*
+ * Load every pair of a pair file in file order
+ */
+static void load_pair_file(struct test_context *ctx) {
+    struct pair_file pairs;
+    double x0[FILE_BATCH_PAIRS];
+    double y0[FILE_BATCH_PAIRS];
+    double x1[FILE_BATCH_PAIRS];
+    double y1[FILE_BATCH_PAIRS];
+
+    pair_file_open(&pairs, ctx->filename);
+    if (pairs.count != ctx->item_count) {
+        MY_ERROR("Pair file [%s] changed, [%" PRIu64 "] pairs instead of [%zu]\n", ctx->filename, pairs.count, ctx->item_count);
+    }
+    for (size_t start=0; start<ctx->item_count; start+=FILE_BATCH_PAIRS) {
+        size_t n = ctx->item_count - start < FILE_BATCH_PAIRS ? ctx->item_count - start : FILE_BATCH_PAIRS;
+        pair_file_read_coordinates(&pairs, start, n, x0, y0, x1, y1);
+        for (size_t i=0; i<n; i++) {
+            if (ctx->layout == LAYOUT_AOS) {
+                struct data_item_s row = {x0[i], y0[i], x1[i], y1[i]};
+                ctx->aos[start + i] = row;
+            } else {
+                pair_soa_append(&ctx->soa, x0[i], y0[i], x1[i], y1[i]);
+            }
+        }
+    }
+    pair_file_close(&pairs);
+}
+
+void env_setup(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+
+    printf("[%s] name[%s] items[%zu]\n", __FUNCTION__, ctx->name, ctx->item_count);
+
+    if (ctx->layout == LAYOUT_AOS) {
+        ctx->aos = malloc(ctx->item_count * sizeof(struct data_item_s));
+        if (!ctx->aos) {
+            MY_ERROR("Malloc failed for size[%zu]\n", ctx->item_count * sizeof(struct data_item_s));
+        }
+    } else {
+        pair_soa_alloc(&ctx->soa, ctx->item_count);
+    }
+
+    if (ctx->filename) {
+        load_pair_file(ctx);
+        return;
+    }
+
+    rng_state = BENCH_SEED;
+    for (size_t i=0; i<ctx->item_count; i++) {
+        double x0 = random_degrees(180);
+        double y0 = random_degrees(90);
+        double x1 = random_degrees(180);
+        double y1 = random_degrees(90);
+        if (ctx->layout == LAYOUT_AOS) {
+            struct data_item_s row = {x0, y0, x1, y1};
+            ctx->aos[i] = row;
+        } else {
+            pair_soa_append(&ctx->soa, x0, y0, x1, y1);
+        }
+    }
+}
+
+void test_setup(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    if (ctx->layout == LAYOUT_SOA_BATCH) {
+        haversine_batch_select(ctx->isa);
+    }
+}
+
+void env_teardown(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    if (ctx->layout == LAYOUT_AOS) {
+        free(ctx->aos);
+        ctx->aos = NULL;
+    } else {
+        pair_soa_free(&ctx->soa);
+    }
+}
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+    double sum = 0;
+    // all layouts add the distances one after the other, only the kernel differs
+    struct float_sum soa_sum;
+    float_sum_init(&soa_sum, FLOAT_SUM_NAIVE);
+
+    uint64_t start = GET_CPU_TICKS();
+    if (ctx->layout == LAYOUT_AOS) {
+        for (size_t i=0; i<ctx->item_count; i++) {
+            struct data_item_s *item = &ctx->aos[i];
+            sum += ReferenceHaversine(item->x0, item->y0, item->x1, item->y1, APPROX_EARTH_RADIUS);
+        }
+    } else if (ctx->layout == LAYOUT_SOA) {
+        haversine_sum_soa(&ctx->soa, APPROX_EARTH_RADIUS, &soa_sum);
+        sum = float_sum_result(&soa_sum);
+    } else {
+        haversine_batch_sum_soa(&ctx->soa, APPROX_EARTH_RADIUS, &soa_sum);
+        sum = float_sum_result(&soa_sum);
+    }
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+    ctx->sum = sum;
+
+    size_t data_size = ctx->item_count * sizeof(struct data_item_s);
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(data_size, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(data_size, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    size_t data_size = ctx->item_count * sizeof(struct data_item_s);
+
+    printf("[%s] name[%s] items[%zu] sum[%3.16f]\n", __FUNCTION__, ctx->name, ctx->item_count, ctx->sum);
+    printf("\n");
+
+    printf("[%s] Slowest Speed", __FUNCTION__);
+    print_data_speed(data_size, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Speed", __FUNCTION__);
+    print_data_speed(data_size, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+
+/*
+ * Distance in units in the last place between two doubles, the bit
+ * patterns are mapped so that they order like the values they encode
+ */
+static uint64_t ulp_distance(double a, double b) {
+    int64_t ia;
+    int64_t ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    if (ia < 0) {
+        ia = INT64_MIN - ia;
+    }
+    if (ib < 0) {
+        ib = INT64_MIN - ib;
+    }
+    return ia > ib ? (uint64_t)ia - (uint64_t)ib : (uint64_t)ib - (uint64_t)ia;
+}
+
+#define ACCURACY_BATCH_PAIRS    4096
+
+void report_accuracy(size_t item_count) {
+    enum haversine_isa_e isas[] = {HAVERSINE_SCALAR, HAVERSINE_AVX2, HAVERSINE_AVX512};
+    double x0[ACCURACY_BATCH_PAIRS];
+    double y0[ACCURACY_BATCH_PAIRS];
+    double x1[ACCURACY_BATCH_PAIRS];
+    double y1[ACCURACY_BATCH_PAIRS];
+    double reference[ACCURACY_BATCH_PAIRS];
+    double scalar[ACCURACY_BATCH_PAIRS];
+    double out[ACCURACY_BATCH_PAIRS];
+
+    printf("Accuracy of haversine_batch against ReferenceHaversine over [%zu] random pairs\n\n", item_count);
+
+    for (int k=0; k<sizeof(isas)/sizeof(isas[0]); k++) {
+        if (haversine_batch_select(isas[k]) != isas[k]) {
+            printf("%-8s not supported by this CPU\n", haversine_isa_name(isas[k]));
+            continue;
+        }
+
+        uint64_t max_ulp = 0;
+        double sum_ulp = 0;
+        double max_abs = 0;
+        double sum_abs = 0;
+        size_t scalar_mismatch = 0;
+        double worst[4] = {};
+
+        rng_state = BENCH_SEED;
+        for (size_t start=0; start<item_count; start+=ACCURACY_BATCH_PAIRS) {
+            size_t n = item_count - start < ACCURACY_BATCH_PAIRS ? item_count - start : ACCURACY_BATCH_PAIRS;
+            for (size_t i=0; i<n; i++) {
+                x0[i] = random_degrees(180);
+                y0[i] = random_degrees(90);
+                x1[i] = random_degrees(180);
+                y1[i] = random_degrees(90);
+                reference[i] = ReferenceHaversine(x0[i], y0[i], x1[i], y1[i], APPROX_EARTH_RADIUS);
+            }
+            haversine_batch_select(HAVERSINE_SCALAR);
+            haversine_batch(x0, y0, x1, y1, n, APPROX_EARTH_RADIUS, scalar);
+            haversine_batch_select(isas[k]);
+            haversine_batch(x0, y0, x1, y1, n, APPROX_EARTH_RADIUS, out);
+
+            for (size_t i=0; i<n; i++) {
+                uint64_t ulp = ulp_distance(out[i], reference[i]);
+                double abs_error = fabs(out[i] - reference[i]);
+                if (ulp > max_ulp) {
+                    max_ulp = ulp;
+                    worst[0] = x0[i];
+                    worst[1] = y0[i];
+                    worst[2] = x1[i];
+                    worst[3] = y1[i];
+                }
+                if (abs_error > max_abs) {
+                    max_abs = abs_error;
+                }
+                sum_ulp += (double)ulp;
+                sum_abs += abs_error;
+                scalar_mismatch += (ulp_distance(out[i], scalar[i]) != 0);
+            }
+        }
+
+        printf("%-8s max ULP [%" PRIu64 "] mean ULP [%.4f] max abs error [%.3e] mean abs error [%.3e] differs from scalar [%zu]\n",
+            haversine_isa_name(isas[k]), max_ulp, sum_ulp/(double)item_count, max_abs, sum_abs/(double)item_count, scalar_mismatch);
+        printf("         worst pair x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f\n", worst[0], worst[1], worst[2], worst[3]);
+    }
+    printf("\n");
+}
+
+void usage(void) {
+    fprintf(stderr, "Haversine Kernel Benchmark Usage:\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+    fprintf(stderr, "-n <count>     Only run with <count> pairs, default runs 1M, 10M and 100M pairs.\n");
+    fprintf(stderr, "-i <bin_file>  Time the pairs of a data_gen pair file in file order instead of random\n");
+    fprintf(stderr, "               pairs, up to %d files, e.g. the same seed with and without -o hilbert.\n", MAX_INPUT_FILES);
+    fprintf(stderr, "-a             Report the error of haversine_batch against ReferenceHaversine\n");
+    fprintf(stderr, "               over <count> pairs (defaults to 1M) instead of timing.\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    size_t counts[] = {1000000, 10000000, 100000000};
+    int count_total = sizeof(counts)/sizeof(counts[0]);
+    bool accuracy_report = false;
+    char *files[MAX_INPUT_FILES] = {};
+    int file_count = 0;
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-n")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing count parameter\n");
+                usage();
+                exit(1);
+            }
+            counts[0] = strtoull(argv[index+1], NULL, 10);
+            count_total = 1;
+            ++index;
+        } else if (strcmp(argv[index], "-a")==0) {
+            accuracy_report = true;
+        } else if (strcmp(argv[index], "-i")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing pair file parameter\n");
+                usage();
+                exit(1);
+            }
+            if (file_count == MAX_INPUT_FILES) {
+                printf("ERROR: more than %d pair files\n", MAX_INPUT_FILES);
+                usage();
+                exit(1);
+            }
+            files[file_count++] = strdup(argv[index+1]);
+            ++index;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "ht:n:ai:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            case 'n':
+                counts[0] = strtoull(optarg, NULL, 10);
+                count_total = 1;
+                break;
+
+            case 'a':
+                accuracy_report = true;
+                break;
+
+            case 'i':
+                if (file_count == MAX_INPUT_FILES) {
+                    fprintf(stderr, "ERROR more than %d pair files\n", MAX_INPUT_FILES);
+                    usage();
+                    exit(1);
+                }
+                files[file_count++] = strdup(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    printf("==========================\n");
+    printf("Haversine Kernel Benchmark\n");
+    printf("==========================\n");
+
+    if (accuracy_report) {
+        report_accuracy(counts[0]);
+        return 0;
+    }
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+
+    // one run per pair file, or per count of random pairs
+    int run_total = file_count > 0 ? file_count : count_total;
+    for (int c=0; c<run_total; c++) {
+        char label[MAX_LABEL] = "";
+        size_t item_count = counts[c];
+        char *filename = NULL;
+        if (file_count > 0) {
+            struct pair_file pairs;
+            filename = files[c];
+            pair_file_open(&pairs, filename);
+            item_count = pairs.count;
+            snprintf(label, sizeof(label), "[%s]", pair_order_name(pairs.header.order));
+            printf("Pair file [%s] pairs [%zu] order [%s]\n", filename, item_count, pair_order_name(pairs.header.order));
+            pair_file_close(&pairs);
+        }
+
+        struct test_context contexts[5] = {};
+        int test_count = 0;
+        snprintf(contexts[test_count].name, MAX_TEST_NAME, "Haversine_AoS_Reference%s", label);
+        contexts[test_count++].layout = LAYOUT_AOS;
+        snprintf(contexts[test_count].name, MAX_TEST_NAME, "Haversine_SoA_Lanes%s", label);
+        contexts[test_count++].layout = LAYOUT_SOA;
+        snprintf(contexts[test_count].name, MAX_TEST_NAME, "Haversine_SoA_Batch_Scalar%s", label);
+        contexts[test_count].layout = LAYOUT_SOA_BATCH;
+        contexts[test_count++].isa = HAVERSINE_SCALAR;
+        if (haversine_batch_select(HAVERSINE_AVX2) == HAVERSINE_AVX2) {
+            snprintf(contexts[test_count].name, MAX_TEST_NAME, "Haversine_SoA_Batch_AVX2%s", label);
+            contexts[test_count].layout = LAYOUT_SOA_BATCH;
+            contexts[test_count++].isa = HAVERSINE_AVX2;
+        }
+        if (haversine_batch_select(HAVERSINE_AVX512) == HAVERSINE_AVX512) {
+            snprintf(contexts[test_count].name, MAX_TEST_NAME, "Haversine_SoA_Batch_AVX512%s", label);
+            contexts[test_count].layout = LAYOUT_SOA_BATCH;
+            contexts[test_count++].isa = HAVERSINE_AVX512;
+        }
+
+        struct rep_tester_config tests[5] = {};
+        for (int i=0; i<test_count; i++) {
+            contexts[i].item_count = item_count;
+            contexts[i].filename = filename;
+
+            tests[i].test_name = contexts[i].name;
+            tests[i].env_setup = env_setup;
+            tests[i].test_setup = test_setup;
+            tests[i].test_main = test_main;
+            tests[i].env_teardown = env_teardown;
+            tests[i].print_stats = print_stats;
+            tests[i].test_runtime_seconds = runtime;
+            tests[i].silent = true;
+            tests[i].context = &contexts[i];
+        }
+
+        printf("\n\n");
+        rep_tester_run(tests, test_count);
+    }
+
+    printf("\n\n");
+
+    for (int f=0; f<file_count; f++) {
+        free(files[f]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "json_scan.h"
+#include "json_row.h"
+#include "json_dfa.h"
+#include "haversine_json.h"
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+/*
+ * libhaversine_json benchmark
+ *
+ * The JSON file is read into memory once and every test keeps its own
+ * haversine_json context over that warm buffer. Each repetition rewinds the
+ * context and pulls all the rows through haversine_json_next_batch into one
+ * batch array, so only the parser and the batch calls are timed:
+ *  - Rows_Batch1, the row parser one row per call
+ *  - Rows, the row parser with the scalar walk
+ *  - Rows_Indexed, the row parser over a structural index built up front
+ *  - DFA, the table driven tokenizer
+ * Speeds are JSON bytes over time, the sums of the rows of every test must
+ * match.
+ */
+enum json_bench_test_e {
+    TEST_ROWS_BATCH1,
+    TEST_ROWS,
+    TEST_ROWS_INDEXED,
+    TEST_DFA,
+    MAX_TESTS,
+};
+
+struct test_context {
+    char *name;
+    struct haversine_json json;
+    struct data_item_s *batch;
+    size_t batch_rows;
+    size_t rows;
+    double check;               // sum of all the coordinates of the last pass
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+    double check = 0.0;
+    size_t count;
+
+    uint64_t start = GET_CPU_TICKS();
+    if (!haversine_json_rewind(&ctx->json)) {
+        MY_ERROR("[%s] Invalid json header, %s at offset [%zu]\n", ctx->name, ctx->json.error, ctx->json.error_pos);
+    }
+    while ((count = haversine_json_next_batch(&ctx->json, ctx->batch, ctx->batch_rows)) > 0) {
+        for (size_t i=0; i<count; i++) {
+            check += ctx->batch[i].x0 + ctx->batch[i].y0 + ctx->batch[i].x1 + ctx->batch[i].y1;
+        }
+    }
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+
+    if (ctx->json.incomplete) {
+        MY_ERROR("[%s] Invalid row format, file ends in the middle of a row\n", ctx->name);
+    }
+    if (ctx->json.error) {
+        MY_ERROR("[%s] Invalid row format, %s at offset [%zu]\n", ctx->name, ctx->json.error, ctx->json.error_pos);
+    }
+    ctx->rows = ctx->json.rows;
+    ctx->check = check;
+
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(ctx->json.size, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(ctx->json.size, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+
+    printf("[%s] name[%s] rows[%zu] batch[%zu] check[%.6f]\n", __FUNCTION__, ctx->name,
+           ctx->rows, ctx->batch_rows, ctx->check);
+    printf("\n");
+
+    printf("[%s] Slowest Speed", __FUNCTION__);
+    print_data_speed(ctx->json.size, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Speed", __FUNCTION__);
+    print_data_speed(ctx->json.size, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+static uint8_t *read_file(const char *filename, size_t *size) {
+    struct stat statbuf = {};
+
+    if (stat(filename, &statbuf) != 0) {
+        MY_ERROR("Unable to get filestats[%d][%s]\n", errno, strerror(errno));
+    }
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        MY_ERROR("Failed to open [%s] [%d][%s]\n", filename, errno, strerror(errno));
+    }
+    uint8_t *data = malloc(statbuf.st_size ? statbuf.st_size : 1);
+    if (!data) {
+        MY_ERROR("Malloc failed for size[%zu]\n", (size_t)statbuf.st_size);
+    }
+    if (fread(data, 1, statbuf.st_size, fp) != (size_t)statbuf.st_size) {
+        MY_ERROR("Failed to read [%s]\n", filename);
+    }
+    fclose(fp);
+    *size = statbuf.st_size;
+    return data;
+}
+
+void usage(void) {
+    fprintf(stderr, "libhaversine_json Benchmark Usage:\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+    fprintf(stderr, "-i <json_file> data_gen JSON file to parse.\n");
+    fprintf(stderr, "-b <rows>      Rows per next_batch call. (defaults to 1024)\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    size_t batch_rows = 1024;
+    char *input_file = NULL;
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-i")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing json file parameter\n");
+                usage();
+                exit(1);
+            }
+            input_file = strdup(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-b")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing batch rows parameter\n");
+                usage();
+                exit(1);
+            }
+            batch_rows = strtoull(argv[index+1], NULL, 10);
+            ++index;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "ht:i:b:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            case 'i':
+                input_file = strdup(optarg);
+                break;
+
+            case 'b':
+                batch_rows = strtoull(optarg, NULL, 10);
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    if (!input_file || batch_rows == 0) {
+        usage();
+        exit(1);
+    }
+
+    printf("==============================\n");
+    printf("libhaversine_json Benchmark\n");
+    printf("==============================\n");
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Using input     [%s]\n", input_file);
+    printf("Using batch     [%zu]rows\n", batch_rows);
+
+    size_t size;
+    uint8_t *data = read_file(input_file, &size);
+    struct structural_index index = {};
+    if (!build_structural_index(&index, data, size, JSON_SCAN_AUTO)) {
+        MY_ERROR("Failed to allocate structural index for [%zu]bytes\n", size);
+    }
+
+    char *names[MAX_TESTS] = { "Rows_Batch1", "Rows", "Rows_Indexed", "DFA" };
+    struct haversine_json_options options[MAX_TESTS] = {
+        [TEST_ROWS_BATCH1]  = { .parser = HAVERSINE_JSON_ROWS },
+        [TEST_ROWS]         = { .parser = HAVERSINE_JSON_ROWS },
+        [TEST_ROWS_INDEXED] = { .parser = HAVERSINE_JSON_ROWS, .index = &index },
+        [TEST_DFA]          = { .parser = HAVERSINE_JSON_DFA },
+    };
+    // the contexts hold a json_tokenizer ring each, keep them off the stack
+    struct test_context *contexts = calloc(MAX_TESTS, sizeof(struct test_context));
+    if (!contexts) {
+        MY_ERROR("Calloc failed for [%d] contexts\n", MAX_TESTS);
+    }
+    struct rep_tester_config tests[MAX_TESTS] = {};
+    for (int i=0; i<MAX_TESTS; i++) {
+        contexts[i].name = names[i];
+        contexts[i].batch_rows = i == TEST_ROWS_BATCH1 ? 1 : batch_rows;
+        contexts[i].batch = malloc(contexts[i].batch_rows * sizeof(struct data_item_s));
+        if (!contexts[i].batch) {
+            MY_ERROR("Malloc failed for [%zu] rows\n", contexts[i].batch_rows);
+        }
+        if (!haversine_json_init(&contexts[i].json, data, size, &options[i])) {
+            MY_ERROR("[%s] Invalid json header, %s at offset [%zu]\n", names[i], contexts[i].json.error, contexts[i].json.error_pos);
+        }
+
+        tests[i].test_name = contexts[i].name;
+        tests[i].test_main = test_main;
+        tests[i].print_stats = print_stats;
+        tests[i].test_runtime_seconds = runtime;
+        tests[i].silent = true;
+        tests[i].context = &contexts[i];
+    }
+
+    printf("\n\n");
+    rep_tester_run(tests, MAX_TESTS);
+
+    for (int i=1; i<MAX_TESTS; i++) {
+        if (contexts[i].rows != contexts[0].rows || contexts[i].check != contexts[0].check) {
+            MY_ERROR("[%s] rows differ from [%s]\n", contexts[i].name, contexts[0].name);
+        }
+    }
+    printf("All contexts produced the same [%zu] rows\n", contexts[0].rows);
+
+    for (int i=0; i<MAX_TESTS; i++) {
+        free(contexts[i].batch);
+    }
+    free(contexts);
+    free_structural_index(&index);
+    free(data);
+
+    return 0;
+}
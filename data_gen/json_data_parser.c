@@ -13,9 +13,27 @@
 #define __USE_UNIX98
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <threads.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 
 #include "haversine.h"
+#include "json_scan.h"
+#include "json_row.h"
+#include "json_dfa.h"
+#include "haversine_json.h"
+#include "pair_soa.h"
+#include "haversine_batch.h"
+#include "pair_file.h"
+#include "float_sum.h"
+#include "pair_answers.h"
 #include "rdtsc_utils.h"
+#include "arena.h"
+#include "page_alloc.h"
 
 #define MY_ERROR(...) {                    \
         fprintf(stderr, "[%s:%d]", __FUNCTION__, __LINE__);      \
@@ -30,285 +48,652 @@
     }
 
 #define APPROX_EARTH_RADIUS     6372.8
-#define MAX_ITEM_NAME_LEN       8
-#define MAX_VALUE_LEN           64
 
 #define JSON_OVERHEAD_SIZE      14
 #define JSON_MAX_ROW_SIZE       111 // with trailing coma
 #define JSON_MIN_ROW_SIZE       101 // with trailing coma
 
-#define FOUND_X0                0x1
-#define FOUND_Y0                0x2
-#define FOUND_X1                0x4
-#define FOUND_Y1                0x8
-
 enum profile_blocks_e {
     BLOCK_INIT,
     BLOCK_FILE_READ,
     BLOCK_FREAD,
+    BLOCK_MAP_FILE,
+    BLOCK_STRUCTURAL_INDEX,
+    BLOCK_COUNT_ROWS,
     BLOCK_PARSE_FILE,
     BLOCK_PARSE_DATA_FILE,
+    BLOCK_CONCAT_SLABS,
     BLOCK_HAVERSINE,
+    BLOCK_STREAM,
+    BLOCK_STREAM_READ,
+    BLOCK_STREAM_PARSE,
+    BLOCK_STREAM_HAVERSINE,
+    BLOCK_STREAM_WAIT,
+    BLOCK_READER_IO,
+    BLOCK_CHECK_REFERENCE,
 };
 
 size_t file_size = 0;
 uint8_t *file_data = NULL;
+// the read buffer of the file when it is not mapped
+struct page_buffer file_pages = {};
+
+/*
+ * Instead of reading the whole file into a buffer we can map the file into
+ * our address space and parse straight out of the page cache. This avoids
+ * the extra copy and does not double the RSS for big inputs.
+ * - map_populate: ask the kernel to pre-fault all the pages on mmap, also
+ *   pre-faults the read buffer and the preallocated pair array
+ * - map_sequential: madvise(MADV_SEQUENTIAL) for aggressive readahead
+ * - map_hugepage: madvise(MADV_HUGEPAGE) only works if the kernel supports
+ *   THP for the page cache, otherwise it is just reported and ignored.
+ *   The read buffer, the preallocated pair array and the linked list arena
+ *   are anonymous memory, page_alloc backs those with 2MB pages.
+ */
+bool map_populate = false;
+bool map_sequential = false;
+bool map_hugepage = false;
 
-uint8_t *file_data_ptr = NULL;
-size_t file_data_remaining = 0;
+/*
+ * When enabled we first run a SIMD pass over the whole file that marks the
+ * position of every structural char, then advance_until jumps
+ * from one structural position to the next instead of testing every byte.
+ * When disabled we use the original byte by byte scalar walk.
+ */
+bool use_structural_index = false;
+enum json_scan_isa_e structural_isa = JSON_SCAN_AUTO;
+struct structural_index file_index = {};
+
+/*
+ * With -D the file is cut into tokens by the table driven json_dfa
+ * tokenizer and the rows are built from the tokens instead of parse_row
+ */
+bool use_dfa = false;
 
 /*
  * We will support several parsing JSON options:
- * - put all items in a linked list (will malloc for each item)
- * - estimate the max items and preallocated the required memmory
+ * - put all items in a linked list (nodes come from an arena)
+ * - count the rows and preallocated the required memmory
  *   to store them all and avoid all the small malloc and linked
  *   list overhead
  */
-struct data_item_s {
-    double x0;
-    double y0;
-    double x1;
-    double y1;
-};
-
 struct list_item_s {
     struct data_item_s data_item;
     struct list_item_s *next_item;
 };
 
-// when using linked list
+// when using linked list, nodes are bump allocated from list_arena
 struct list_item_s *list_head = NULL;
 struct list_item_s *list_tail = NULL;
+struct arena list_arena = {};
 
 // when using preallocated memory array
 struct data_item_s *data_array = NULL;
+size_t data_array_capacity = 0;
+struct page_buffer data_array_pages = {};
+
+// with -A the preallocated storage is one aligned array per coordinate
+bool soa_layout = false;
+struct pair_soa data_soa = {};
+// with -K the SoA pass uses the polynomial haversine_batch kernel
+bool use_batch_kernel = false;
+
+// how the distances are added up, pairwise and kahan give the same result
+// for every storage layout, kernel width and -j
+enum float_sum_mode_e sum_mode = FLOAT_SUM_PAIRWISE;
 
 // how many data items were used
 size_t data_item_count = 0;
 
-char item_name_buffer[MAX_ITEM_NAME_LEN] = {};
-char item_value_buffer[MAX_VALUE_LEN] = {};
 bool verbose = false;
 
+// cross check every parsed value against strtod
+bool verify_values = false;
+size_t verified_value_count = 0;
+
+// rows of every parse tier over all cursors
+struct parse_tier parse_tiers[PARSE_TIERS] = {};
+
+// with -b the parsed pairs and sum are compared with the data_gen pair file,
+// which is mapped and read in place
+char *reference_file = NULL;
+struct pair_file reference = {};
+
+// with -c the distances are checked block by block against the JSON answers
+// of the data_gen answer file, answer_file is NULL otherwise
+char *answer_file = NULL;
+struct pair_answers answers = {};
+
+// SoA distances are recomputed for the answer check this many at a time
+#define ANSWER_BATCH_ROWS       1024
+
 /*
- * There is no clear guidance on how conformant this json parser should be
- * It is not the goal to implement a JSON parser but just something that can
- * read the previously generated file. We could cheat as we know the exact 
- * structure to expect:
- * 
- * {"pairs":[
- * {"x0":-152.1370425038677752, "y0":-71.3097241387282139, "x1":-163.3649409391753977, "y1":-67.8408444243673472},
- * {"x0":-97.5403914868554125, "y0":-54.3610062144515211, "x1":-91.8418793435403558, "y1":-45.5549272734461894}
- * ]}
- * 
- * But since we probably want a pig parser to optimize later
- * we are going to add some flexibility like:
- * - ignore whitespace
- * - ignore linefeed or carriage return
- * - data items do not need to be in the order x0, y0, x1, y1, but are tagged using lowercase
- * 
- * Will start with a char based parser which is really inneficient and slow
- * 
- * By using advance to char we may be skipping bad formatted json or other data we don't care about,
- * so this is not really a good way to validate the structure is actually real json
+ * Multithreaded parsing, the array part of the file is split in thread_count
+ * byte ranges, each thread moves its split forward to the next row start on
+ * its own and parses the rows that start in its range into its own slab. The
+ * slabs are then concatenated into data_array in file order.
  */
+#define HAVERSINE_BLOCK_ROWS    65536
+
+struct parse_chunk {
+    uint8_t *split;         // nominal start of the range
+    uint8_t *limit;         // split of the next chunk
+    uint8_t *start;         // first row start at or after split
+    uint8_t *stop;          // first row start at or after limit
+    struct data_item_s *items;
+    size_t capacity;
+    size_t count;
+    size_t verified_value_count;
+    const char *error;      // NULL if the rows ended cleanly
+    size_t error_offset;
+    struct parse_tier tiers[PARSE_TIERS];
+};
 
-bool advance_until(char target) {
-    uint32_t bytes_consumed = 0;
-    bool found = false;
-    while(!found && file_data_remaining>0) {
-        bytes_consumed++;
-        file_data_remaining--;
-        if ((char)*file_data_ptr==target) {
-            // found target and we have already consumed
-            LOG("Found [%c] after [%" PRIu32 "] bytes read\n", target, bytes_consumed);
-            found = true;
-        }
-        file_data_ptr++;
-    }
-    return found;
-}
-
-bool find_string(char *string) {
-    bool found_it = false;
-    int len = strlen(string);
-    LOG("Looking for [%s] len[%d]\n", string, len);
-    char *ptr = string;
-    for (int i=0; i<len; i++) {
-        found_it = advance_until(*ptr);
-        if (!found_it) return false;
-        ptr++;
-    }
-    // we found all elements
-    return true;
-}
-
-// similar to advance_until but it will extract the consumed chars to a
-// given buffer, without the last target char
-bool extract_until(char* buffer, int max_buffer_len, char *target) {
-    uint32_t bytes_consumed = 0;
-    bool found = false;
-    // clear buffer so that it is null terminated
-    memset(buffer, 0, max_buffer_len);
-    char *ptr = buffer;
-    while(!found && file_data_remaining>0) {
-        bytes_consumed++;
-        file_data_remaining--;
-        if ((char)*file_data_ptr==*target) {
-            // found target and we have already consumed
-            LOG("Found [%c] after [%" PRIu32 "] bytes read buffer[%s]\n", *target, bytes_consumed, buffer);
-            found = true;
-        } else {
-            if (bytes_consumed>max_buffer_len) {
-                MY_ERROR("Overran the target buffer\n");
-                break;
-            }
-            // copy read char to buffer
-            *ptr = *file_data_ptr;
-            ptr++;
-        }
-        file_data_ptr++;
+int thread_count = 0;
+
+/*
+ * Streaming parse and reduce, the file is read through a small ring of fixed
+ * size blocks and every parsed row is folded into a running haversine sum, so
+ * the pairs are never stored and memory use does not depend on the input size.
+ *
+ * Each block has STREAM_CARRY_SIZE bytes of headroom in front of its data, a
+ * row that straddles the end of a block is copied into the headroom of the
+ * next block so that the parser always sees the row in one piece.
+ *
+ * With stream_async a reader thread fills the ring ahead of the parser. A block
+ * is owned by the reader until it is marked full and by the parser until it is
+ * released, the parser only releases a block after the carry of its last row
+ * has been copied into the next one.
+ */
+#define STREAM_BLOCK_SIZE       (1024*1024)
+#define STREAM_RING_BLOCKS      4
+#define STREAM_CARRY_SIZE       4096
+#define STREAM_BATCH_ROWS       256
+
+struct stream_block {
+    uint8_t *buffer;        // STREAM_CARRY_SIZE headroom followed by STREAM_BLOCK_SIZE of data
+    size_t data_size;       // bytes read into the data part, 0 at the end of the file
+};
+
+struct stream_ring {
+    struct stream_block blocks[STREAM_RING_BLOCKS];
+    FILE *fp;
+    size_t file_remaining;  // bytes of the file not read yet
+    int next_block;
+    // async reader state
+    bool async;
+    thrd_t reader;
+    mtx_t lock;
+    cnd_t block_filled;
+    cnd_t block_released;
+    bool full[STREAM_RING_BLOCKS];
+    int read_block;
+    bool read_error;
+    uint64_t read_ticks;    // ticks the reader spent in fread
+    uint64_t read_bytes;
+};
+
+bool stream_mode = false;
+bool stream_async = false;
+
+void add_parse_tiers(const struct parse_tier *tiers) {
+    for (int t=0; t<PARSE_TIERS; t++) {
+        parse_tiers[t].rows += tiers[t].rows;
+        parse_tiers[t].bytes += tiers[t].bytes;
+        parse_tiers[t].ticks += tiers[t].ticks;
     }
-    return false;
 }
 
-void parse_file(bool preallocate_entries) {
-    double X0, Y0, X1, Y1 = 0;
-    bool found_it;
-    int ret;
+/*
+ * Print the fast path hit ratio and the speed of each tier. The tiers are not
+ * profile blocks, their ticks are part of ParseFileData or StreamParse and
+ * with -j they are summed over the parsing threads.
+ */
+void report_parse_tiers(void) {
+    size_t rows = parse_tiers[PARSE_TIER_FAST].rows + parse_tiers[PARSE_TIER_FALLBACK].rows;
 
-    // first hit the start of json
-    found_it = advance_until('{');
-    if (!found_it) MY_ERROR("Failed to find start of json\n");
-
-    // there may be other json items, we want to find "pairs"
-    found_it = find_string("\"pairs\"");
-    if (!found_it) MY_ERROR("Failed to find pairs item\n");
-    found_it = advance_until(':');
-    if (!found_it) MY_ERROR("Failed to find item separator\n");
-    found_it = advance_until('[');    // start of json array
-    if (!found_it) MY_ERROR("Failed to find start of json array\n");
-
-    while(file_data_remaining>0) {
-        uint8_t found_item = 0;
-        uint8_t item_count = 0;
-        double value;
-        bool found_x0;
-        bool found_y0;
-        bool found_x1;
-        bool found_y1;
-
-        // parse array row
-        found_it = advance_until('{');    // start of row item
-        if (!found_it) break;
-
-        while (item_count<4) {
-            found_it = advance_until('"');    // Start of item id
-            if (!found_it) break;
-            // next we have the id of a value, can be x0, y0, x1, y1 and then the end '"' if the id
-            // extract into item_name_buffer until we find the end of the identifier
-            extract_until(item_name_buffer, MAX_ITEM_NAME_LEN, "\"");
-
-            if (strncmp("x0",item_name_buffer,MAX_ITEM_NAME_LEN)==0) {
-                found_item = FOUND_X0;
-            } else if (strncmp("y0",item_name_buffer,MAX_ITEM_NAME_LEN)==0) {
-                found_item = FOUND_Y0;
-            } else if (strncmp("x1",item_name_buffer,MAX_ITEM_NAME_LEN)==0) {
-                found_item = FOUND_X1;
-            } else if (strncmp("y1",item_name_buffer,MAX_ITEM_NAME_LEN)==0) {
-                found_item = FOUND_Y1;
-            } else {
-                MY_ERROR("Failed to identify item[%s]\n", item_name_buffer);
-            }
-            found_it = advance_until(':');    // start of value
-            if (!found_it) break;
+    if (use_dfa) {
+        return;
+    }
+    printf("Fast path rows %zu of %zu (%.2f%%), fallback rows %zu\n", parse_tiers[PARSE_TIER_FAST].rows, rows,
+           rows ? 100.0*(double)parse_tiers[PARSE_TIER_FAST].rows/(double)rows : 0.0, parse_tiers[PARSE_TIER_FALLBACK].rows);
+    if (parse_tiers[PARSE_TIER_FAST].rows) {
+        printf("Fast path");
+        print_data_speed(parse_tiers[PARSE_TIER_FAST].bytes, parse_tiers[PARSE_TIER_FAST].ticks);
+        printf("\n");
+    }
+    if (parse_tiers[PARSE_TIER_FALLBACK].rows) {
+        printf("Fallback ");
+        print_data_speed(parse_tiers[PARSE_TIER_FALLBACK].bytes, parse_tiers[PARSE_TIER_FALLBACK].ticks);
+        printf("\n");
+    }
+}
 
-            if (item_count<3) {
-                // first 3 values end with ','
-                extract_until(item_value_buffer, MAX_VALUE_LEN, ",");
+/*
+ * Point a cursor at the [start, start+size) range of the loaded file
+ */
+void init_file_cursor(struct parse_cursor *cur, uint8_t *start, size_t size) {
+    cur->ptr = start;
+    cur->remaining = size;
+    cur->base = file_data;
+    cur->index = use_structural_index ? &file_index : NULL;
+    cur->row_end = start + size;
+    cur->verify_values = verify_values;
+    cur->verbose = verbose;
+}
+
+/*
+ * Preallocated pair array, backed by huge pages and pre-faulted with -H and -P
+ */
+void alloc_data_array(size_t items) {
+    if (!page_alloc(&data_array_pages, items * sizeof(struct data_item_s), map_hugepage, map_populate)) {
+        MY_ERROR("Failed to allocate [%zu]bytes for data array\n", items * sizeof(struct data_item_s));
+    }
+    data_array = (struct data_item_s *)data_array_pages.ptr;
+    LOG("Data array [%s] pages, populated [%s]\n", page_backing_name(data_array_pages.backing),
+        data_array_pages.populated ? "True" : "False");
+}
+
+/*
+ * The single threaded parse pulls the rows from a haversine_json context,
+ * PARSE_BATCH_ROWS at a time or straight into data_array when preallocated
+ */
+#define PARSE_BATCH_ROWS        1024
+
+void store_row(const struct data_item_s *row) {
+    // use linked list
+    struct list_item_s *item = arena_alloc(&list_arena, sizeof(struct list_item_s));
+    if (!item) {
+        MY_ERROR("Failed to allocate [%zu]bytes for item", sizeof(struct list_item_s));
+    }
+    item->data_item = *row;
+    item->next_item = NULL;
+    // add to linked list
+    if (!list_head) {
+        // first item, it is both head and tail
+        list_head = item;
+        list_tail = item;
+    } else {
+        // there are already items in the list
+        // append to the tail
+        list_tail->next_item = item;
+        list_tail = item;
+    }
+}
+
+void parse_file(bool preallocate_entries) {
+    static struct haversine_json ctx;
+    struct data_item_s rows[PARSE_BATCH_ROWS];
+    struct haversine_json_options options = {
+        .parser = use_dfa ? HAVERSINE_JSON_DFA : HAVERSINE_JSON_ROWS,
+        .index = use_structural_index ? &file_index : NULL,
+        .verify_values = verify_values,
+        .verbose = verbose,
+    };
+    size_t count;
+
+    if (!haversine_json_init(&ctx, file_data, file_size, &options)) {
+        MY_ERROR("Invalid json header, %s at offset [%zu]\n", ctx.error, ctx.error_pos);
+    }
+    for (;;) {
+        if (preallocate_entries && !soa_layout) {
+            // use preallocated array, once it is full any further row is an overflow
+            if (data_item_count < data_array_capacity) {
+                count = haversine_json_next_batch(&ctx, &data_array[data_item_count],
+                                                  data_array_capacity - data_item_count);
+            } else if (haversine_json_next_batch(&ctx, rows, 1)) {
+                MY_ERROR("Data array overflow at [%zu] items\n", data_array_capacity);
             } else {
-                // the last item does not end with ',' instead we hit the end of the array item '}'
-                extract_until(item_value_buffer, MAX_VALUE_LEN, "}");
-            }
-            
-            ret = sscanf((char *)&item_value_buffer, "%lf", &value);
-            if (ret!=1) {
-                MY_ERROR("Failed to parse value from [%s]\n", item_value_buffer);
+                count = 0;
             }
-            LOG("Found value [%3.16f]\n", value);
-            switch (found_item) {
-                case FOUND_X0:
-                    X0 = value;
-                    found_x0 = true;
-                    break;
-                case FOUND_Y0:
-                    Y0 = value;
-                    found_y0 = true;
-                    break;
-                case FOUND_X1:
-                    X1 = value;
-                    found_x1 = true;
-                    break;
-                case FOUND_Y1:
-                    Y1 = value;
-                    found_y1 = true;
-                    break;
-                default:
-                    MY_ERROR("Invalid found_item[%d]\n", found_item);
-                    break;
+        } else {
+            count = haversine_json_next_batch(&ctx, rows, PARSE_BATCH_ROWS);
+            for (size_t i=0; i<count; i++) {
+                if (soa_layout) {
+                    pair_soa_append(&data_soa, rows[i].x0, rows[i].y0, rows[i].x1, rows[i].y1);
+                } else {
+                    store_row(&rows[i]);
+                }
             }
-            item_count++;
         }
+        if (count == 0) {
+            break;
+        }
+        data_item_count += count;
+    }
+    if (ctx.incomplete) {
+        MY_ERROR("Invalid row format, file ends in the middle of a row\n");
+    }
+    if (ctx.error) {
+        MY_ERROR("Invalid row format, %s at offset [%zu]\n", ctx.error, ctx.error_pos);
+    }
+    verified_value_count += ctx.cur.verified_value_count;
+    add_parse_tiers(ctx.cur.tiers);
+    LOG("Total Parsed data items [%zu]\n", data_item_count);
+}
 
-        if (!found_x0 || !found_y0 || !found_x1 || !found_y1) {
-            MY_ERROR("Invalid row format, failed to find all items\n");
+/*
+ * Find the first row start '{"' at or after pos, a row follows a ',' or the
+ * '[' of the array, which skips most objects in the value of an unknown key.
+ * This is only a guess, parse_file_threaded checks it against where the
+ * chunk before stopped.
+ */
+static bool is_row_start(uint8_t *pos, uint8_t *end) {
+    uint8_t *next = pos + 1;
+    while (next < end && is_whitespace((char)*next)) {
+        next++;
+    }
+    if (next >= end || *next != '"') {
+        return false;
+    }
+    uint8_t *prev = pos;
+    while (prev > file_data && is_whitespace((char)prev[-1])) {
+        prev--;
+    }
+    return prev == file_data || prev[-1] == ',' || prev[-1] == '[';
+}
+
+uint8_t *find_row_start(uint8_t *pos, uint8_t *end) {
+    while (pos < end) {
+        pos = memchr(pos, '{', end - pos);
+        if (!pos) {
+            return end;
         }
-        LOG("Parsed x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f \n", X0, Y0, X1, Y1);
+        if (is_row_start(pos, end)) {
+            return pos;
+        }
+        pos++;
+    }
+    return end;
+}
 
-        if (preallocate_entries) {
-            // use preallocated array
-            struct data_item_s *item = &data_array[data_item_count];
-            item->x0 = X0;
-            item->y0 = Y0;
-            item->x1 = X1;
-            item->y1 = Y1;
-        } else {
-            // use linked list
-            struct list_item_s *item = malloc(sizeof(struct list_item_s));
-            if (!item) {
-                MY_ERROR("Failed to allocate [%zu]bytes for item", sizeof(struct list_item_s));
-            }
-            item->data_item.x0 = X0;
-            item->data_item.y0 = Y0;
-            item->data_item.x1 = X1;
-            item->data_item.y1 = Y1;
-            item->next_item = NULL;
-            // add to linked list
-            if (!list_head) {
-                // first item, it is both head and tail
-                list_head = item;
-                list_tail = item;
-            } else {
-                // there are already items in the list
-                // append to the tail
-                list_tail->next_item = item;
-                list_tail = item;
-            }
+/*
+ * Parse the rows that start in [start, limit) into the chunk slab, the last
+ * one may end past limit. stop is left on the next row start.
+ */
+void parse_chunk(struct parse_chunk *chunk) {
+    struct parse_cursor cur = {};
+    struct data_item_s row;
+    enum parse_row_result_e result;
+    uint8_t *file_end = file_data + file_size;
+
+    // size the slab exactly, every row starting in the range has its '{' in it
+    size_t range = chunk->limit > chunk->start ? chunk->limit - chunk->start : 0;
+    chunk->capacity = count_char(chunk->start, range, '{', structural_isa);
+    chunk->items = malloc((chunk->capacity ? chunk->capacity : 1) * sizeof(struct data_item_s));
+    if (!chunk->items) {
+        MY_ERROR("Failed to malloc [%zu]bytes for chunk slab\n", chunk->capacity * sizeof(struct data_item_s));
+    }
+    chunk->count = 0;
+
+    init_file_cursor(&cur, chunk->start, file_end - chunk->start);
+    cur.row_end = chunk->limit;
+
+    parse_tiers_start(&cur);
+    while ((result = parse_row(&cur, &row)) == ROW_PARSED) {
+        if (chunk->count == chunk->capacity) {
+            MY_ERROR("Chunk slab overflow at [%zu] items\n", chunk->capacity);
         }
-        data_item_count++;
+        chunk->items[chunk->count++] = row;
+    }
+    parse_tiers_stop(&cur);
+    chunk->stop = cur.ptr;
+    chunk->error = NULL;
+    if (result == ROW_INCOMPLETE) {
+        chunk->error = "file ends in the middle of a row";
+    } else if (result == ROW_ERROR) {
+        chunk->error = cur.error;
+    }
+    chunk->error_offset = cur.ptr - file_data;
+    chunk->verified_value_count = cur.verified_value_count;
+    memcpy(chunk->tiers, cur.tiers, sizeof(chunk->tiers));
+}
+
+int parse_chunk_thread(void *arg) {
+    struct parse_chunk *chunk = (struct parse_chunk *)arg;
+
+    // every thread resynchronizes on its own, only the first chunk is known
+    // to start on a row boundary
+    if (!chunk->start) {
+        chunk->start = find_row_start(chunk->split, file_data + file_size);
+    }
+    parse_chunk(chunk);
+    return 0;
+}
+
+/*
+ * Split the pairs array into thread_count byte ranges, a row is parsed by the
+ * range it starts in. The threads find their own first row, which can be
+ * wrong when a split lands inside a row with nested objects or strings. So
+ * after the join a chunk is only kept when it starts where the chunk before
+ * it stopped, going from the first chunk which is always right. A chunk that
+ * does not is parsed again on this thread from that stop.
+ */
+void parse_file_threaded(void) {
+    struct parse_cursor cur = {};
+    struct parse_chunk *chunks = calloc(thread_count, sizeof(struct parse_chunk));
+    thrd_t *threads = calloc(thread_count, sizeof(thrd_t));
+    if (!chunks || !threads) {
+        MY_ERROR("Failed to allocate chunks for [%d] threads\n", thread_count);
+    }
+
+    init_file_cursor(&cur, file_data, file_size);
+    if (!find_pairs_array(&cur)) {
+        MY_ERROR("Invalid json header, %s\n", cur.error);
+    }
+
+    uint8_t *array_start = cur.ptr;
+    uint8_t *file_end = file_data + file_size;
+    size_t array_size = file_end - array_start;
+
+    for (int i=0; i<thread_count; i++) {
+        chunks[i].split = array_start + (array_size / thread_count) * i;
+    }
+    for (int i=0; i<thread_count; i++) {
+        chunks[i].limit = (i == thread_count-1) ? file_end : chunks[i+1].split;
     }
+    chunks[0].start = array_start;
+
+    for (int i=0; i<thread_count; i++) {
+        if (thrd_create(&threads[i], parse_chunk_thread, &chunks[i]) != thrd_success) {
+            MY_ERROR("Failed to create parse thread [%d]\n", i);
+        }
+    }
+    for (int i=0; i<thread_count; i++) {
+        thrd_join(threads[i], NULL);
+    }
+
+    for (int i=0; i<thread_count; i++) {
+        if (i > 0 && chunks[i].start != chunks[i-1].stop) {
+            LOG("Chunk[%d] started at offset [%zu] instead of [%zu], parsing it again\n", i,
+                (size_t)(chunks[i].start - file_data), (size_t)(chunks[i-1].stop - file_data));
+            free(chunks[i].items);
+            chunks[i].start = chunks[i-1].stop;
+            parse_chunk(&chunks[i]);
+        }
+        if (chunks[i].error) {
+            MY_ERROR("Invalid row format, %s at offset [%zu]\n", chunks[i].error, chunks[i].error_offset);
+        }
+    }
+
+    TAG_BLOCK_START(BLOCK_CONCAT_SLABS, "ConcatSlabs");
+    size_t total_items = 0;
+    for (int i=0; i<thread_count; i++) {
+        total_items += chunks[i].count;
+    }
+    alloc_data_array(total_items);
+    for (int i=0; i<thread_count; i++) {
+        LOG("Chunk[%d] offset[%zu] size[%zu] items[%zu]\n", i, (size_t)(chunks[i].start - file_data),
+            (size_t)(chunks[i].stop - chunks[i].start), chunks[i].count);
+        if (chunks[i].count == 0) {
+            free(chunks[i].items);
+            continue;
+        }
+        memcpy(&data_array[data_item_count], chunks[i].items, chunks[i].count * sizeof(struct data_item_s));
+        data_item_count += chunks[i].count;
+        verified_value_count += chunks[i].verified_value_count;
+        add_parse_tiers(chunks[i].tiers);
+        free(chunks[i].items);
+    }
+    TAG_BLOCK_END(BLOCK_CONCAT_SLABS);
+
+    free(threads);
+    free(chunks);
     LOG("Total Parsed data items [%zu]\n", data_item_count);
 }
 
+/*
+ * Print the result and with -b compare it with the pair file, the count must
+ * match and the sum may only differ in the last bits when it was added with
+ * a different sum mode or a naive sum was split over blocks (-j)
+ */
+void report_haversine_sum(size_t count, double sum) {
+    printf("Count                 %zu items\n", count);
+    printf("sum H_DIST            %3.16f\n", sum);
+    printf("average H_DIST        %3.16f\n\n", sum/count);
+
+    if (reference_file) {
+        if (count != reference.count) {
+            MY_ERROR("Parsed [%zu] pairs but the pair file has [%" PRIu64 "]\n", count, reference.count);
+        }
+        if (!reference.legacy) {
+            printf("Reference sum         %3.16f (%s)\n", reference.header.expected_sum, float_sum_mode_name(reference.header.sum_mode));
+            printf("Difference            %3.16e\n\n", sum - reference.header.expected_sum);
+        }
+    }
+}
+
+/*
+ * Report a finished answer check, a block that differs is fatal
+ */
+void report_answer_check(struct pair_answer_check *check) {
+    bool ok = pair_answer_check_report(check);
+    pair_answer_check_free(check);
+    if (!ok) {
+        MY_ERROR("Parsed pairs do not match the answer file\n");
+    }
+}
+
+/*
+ * The JSON text has 16 decimals, below 1.0 that is less than a double holds,
+ * so a parsed value can be off by half a unit of the last decimal plus the
+ * rounding of the parse itself
+ */
+#define REFERENCE_TOLERANCE     2e-16
+
+static bool reference_differs(double parsed, double expected) {
+    return fabs(parsed - expected) > REFERENCE_TOLERANCE;
+}
+
+/*
+ * Reference rows are read REFERENCE_BATCH_ROWS at a time, which also
+ * dequantizes Q32 pair files
+ */
+#define REFERENCE_BATCH_ROWS    1024
+
+struct reference_batch {
+    size_t start;
+    size_t count;
+    double x0[REFERENCE_BATCH_ROWS];
+    double y0[REFERENCE_BATCH_ROWS];
+    double x1[REFERENCE_BATCH_ROWS];
+    double y1[REFERENCE_BATCH_ROWS];
+};
+
+static void check_reference_pair(struct reference_batch *batch, size_t i, double x0, double y0, double x1, double y1) {
+    if (i >= batch->start + batch->count) {
+        batch->start = i;
+        batch->count = reference.count - i < REFERENCE_BATCH_ROWS ? reference.count - i : REFERENCE_BATCH_ROWS;
+        pair_file_read_coordinates(&reference, batch->start, batch->count, batch->x0, batch->y0, batch->x1, batch->y1);
+    }
+    size_t at = i - batch->start;
+    if (reference_differs(x0, batch->x0[at]) || reference_differs(y0, batch->y0[at]) ||
+        reference_differs(x1, batch->x1[at]) || reference_differs(y1, batch->y1[at])) {
+        MY_ERROR("Pair [%zu] x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f does not match the pair file"
+                 " x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f\n", i, x0, y0, x1, y1,
+                 batch->x0[at], batch->y0[at], batch->x1[at], batch->y1[at]);
+    }
+}
+
+/*
+ * Compare every stored pair with the same row of the pair file
+ */
+void check_reference_pairs(bool preallocate_entries) {
+    static struct reference_batch batch;
+
+    TAG_DATA_BLOCK_START(BLOCK_CHECK_REFERENCE, "CheckReference", data_item_count*sizeof(struct data_item_s));
+
+    if (data_item_count != reference.count) {
+        MY_ERROR("Parsed [%zu] pairs but the pair file has [%" PRIu64 "]\n", data_item_count, reference.count);
+    }
+    batch.start = 0;
+    batch.count = 0;
+    if (soa_layout) {
+        for (size_t i=0; i<data_soa.count; i++) {
+            check_reference_pair(&batch, i, data_soa.x0[i], data_soa.y0[i], data_soa.x1[i], data_soa.y1[i]);
+        }
+    } else if (preallocate_entries || thread_count > 0) {
+        for (size_t i=0; i<data_item_count; i++) {
+            struct data_item_s *item = &data_array[i];
+            check_reference_pair(&batch, i, item->x0, item->y0, item->x1, item->y1);
+        }
+    } else {
+        size_t i = 0;
+        for (struct list_item_s *item = list_head; item; item = item->next_item) {
+            check_reference_pair(&batch, i++, item->data_item.x0, item->data_item.y0, item->data_item.x1, item->data_item.y1);
+        }
+    }
+    printf("Checked %zu pairs against the pair file\n", data_item_count);
+
+    TAG_BLOCK_END(BLOCK_CHECK_REFERENCE);
+}
+
+/*
+ * The SoA kernels only hand back the sum, with -c the distances are computed
+ * again in small batches with the same kernel. The polynomial kernel is not
+ * bit identical to ReferenceHaversine, so -K is checked approximately.
+ */
+static void check_answers_soa(struct pair_answer_check *check) {
+    double distances[ANSWER_BATCH_ROWS];
+
+    for (size_t start=0; start<data_soa.count; start+=ANSWER_BATCH_ROWS) {
+        size_t n = data_soa.count - start < ANSWER_BATCH_ROWS ? data_soa.count - start : ANSWER_BATCH_ROWS;
+        if (use_batch_kernel) {
+            haversine_batch(&data_soa.x0[start], &data_soa.y0[start], &data_soa.x1[start], &data_soa.y1[start],
+                            n, APPROX_EARTH_RADIUS, distances);
+        } else {
+            haversine_soa(&data_soa, start, n, APPROX_EARTH_RADIUS, distances);
+        }
+        for (size_t i=0; i<n; i++) {
+            pair_answer_check_row(check, data_soa.x0[start+i], data_soa.y0[start+i],
+                                  data_soa.x1[start+i], data_soa.y1[start+i], distances[i]);
+        }
+    }
+}
+
 void calculate_haversine_average(bool preallocate_entries) {
     double H_DIST = 0;
-    double sum = 0;
-    double average = 0;
+    struct float_sum sum;
+    struct pair_answer_check check;
     uint32_t count_values = 0;
 
     TAG_DATA_BLOCK_START(BLOCK_HAVERSINE, "Haversine", data_item_count*sizeof(struct data_item_s));
 
-    if (preallocate_entries) {
+    float_sum_init(&sum, sum_mode);
+    if (answer_file) {
+        pair_answer_check_init(&check, &answers, PAIR_ANSWER_JSON, soa_layout && use_batch_kernel, 0);
+    }
+    if (soa_layout) {
+        if (use_batch_kernel) {
+            haversine_batch_sum_soa(&data_soa, APPROX_EARTH_RADIUS, &sum);
+        } else {
+            haversine_sum_soa(&data_soa, APPROX_EARTH_RADIUS, &sum);
+        }
+        if (answer_file) {
+            check_answers_soa(&check);
+        }
+        count_values = data_soa.count;
+    } else if (preallocate_entries) {
         // use preallocated array
         for (size_t i=0; i<data_item_count; i++) {
             struct data_item_s *item = &data_array[i];
@@ -318,7 +703,10 @@ void calculate_haversine_average(bool preallocate_entries) {
             LOG("x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f | h_dist:%3.16f \n", 
                 item->x0, item->y0, item->x1, item->y1, H_DIST);
 
-            sum += H_DIST;
+            float_sum_add(&sum, H_DIST);
+            if (answer_file) {
+                pair_answer_check_row(&check, item->x0, item->y0, item->x1, item->y1, H_DIST);
+            }
             count_values++;
         }
     } else {
@@ -339,32 +727,385 @@ void calculate_haversine_average(bool preallocate_entries) {
                 item->data_item.y1,
                 H_DIST);
 
-            sum += H_DIST;
+            float_sum_add(&sum, H_DIST);
+            if (answer_file) {
+                pair_answer_check_row(&check, item->data_item.x0, item->data_item.y0,
+                                      item->data_item.x1, item->data_item.y1, H_DIST);
+            }
             count_values++;
 
             // move to next item
             item = item->next_item;
         }
     }
-    average = sum/count_values;
+    report_haversine_sum(count_values, float_sum_result(&sum));
+    if (answer_file) {
+        pair_answer_check_finish(&check);
+        report_answer_check(&check);
+    }
 
-    printf("Count                 %" PRIu32 " items\n", count_values);
-    printf("sum H_DIST            %3.16f\n", sum);
-    printf("average H_DIST        %3.16f\n\n", average);
+    TAG_BLOCK_END(BLOCK_HAVERSINE);
+}
+
+struct haversine_job {
+    size_t first_block;
+    size_t last_block;      // exclusive
+    struct float_sum *block_sums;
+    struct pair_answer_check check;
+};
+
+int haversine_thread(void *arg) {
+    struct haversine_job *job = (struct haversine_job *)arg;
+    for (size_t b=job->first_block; b<job->last_block; b++) {
+        size_t first = b * HAVERSINE_BLOCK_ROWS;
+        size_t last = first + HAVERSINE_BLOCK_ROWS;
+        if (last > data_item_count) {
+            last = data_item_count;
+        }
+        struct float_sum *sum = &job->block_sums[b];
+        float_sum_init(sum, sum_mode);
+        for (size_t i=first; i<last; i++) {
+            struct data_item_s *item = &data_array[i];
+            double distance = ReferenceHaversine(item->x0, item->y0, item->x1, item->y1, APPROX_EARTH_RADIUS);
+            float_sum_add(sum, distance);
+            if (answer_file) {
+                pair_answer_check_row(&job->check, item->x0, item->y0, item->x1, item->y1, distance);
+            }
+        }
+    }
+    if (answer_file) {
+        pair_answer_check_finish(&job->check);
+    }
+    return 0;
+}
+
+/*
+ * Sum data_array in fixed blocks of HAVERSINE_BLOCK_ROWS rows, each thread owns
+ * a contiguous range of blocks and the block sums are merged in block order
+ * so the result does not depend on the number of threads. A block is one
+ * float_sum block, so pairwise and kahan also match the sum without -j.
+ * With -c every thread checks its own blocks and the checks are merged in
+ * the same order.
+ */
+void calculate_haversine_average_threaded(void) {
+    struct float_sum sum;
+    size_t block_count = (data_item_count + HAVERSINE_BLOCK_ROWS - 1) / HAVERSINE_BLOCK_ROWS;
+
+    TAG_DATA_BLOCK_START(BLOCK_HAVERSINE, "Haversine", data_item_count*sizeof(struct data_item_s));
+
+    struct float_sum *block_sums = calloc(block_count ? block_count : 1, sizeof(struct float_sum));
+    struct haversine_job *jobs = calloc(thread_count, sizeof(struct haversine_job));
+    thrd_t *threads = calloc(thread_count, sizeof(thrd_t));
+    if (!block_sums || !jobs || !threads) {
+        MY_ERROR("Failed to allocate haversine jobs for [%d] threads\n", thread_count);
+    }
+
+    for (int i=0; i<thread_count; i++) {
+        jobs[i].first_block = block_count * i / thread_count;
+        jobs[i].last_block = block_count * (i+1) / thread_count;
+        jobs[i].block_sums = block_sums;
+        if (answer_file) {
+            pair_answer_check_init(&jobs[i].check, &answers, PAIR_ANSWER_JSON, false, jobs[i].first_block * HAVERSINE_BLOCK_ROWS);
+        }
+        if (thrd_create(&threads[i], haversine_thread, &jobs[i]) != thrd_success) {
+            MY_ERROR("Failed to create haversine thread [%d]\n", i);
+        }
+    }
+    for (int i=0; i<thread_count; i++) {
+        thrd_join(threads[i], NULL);
+    }
+
+    float_sum_init(&sum, sum_mode);
+    for (size_t b=0; b<block_count; b++) {
+        if (!float_sum_merge(&sum, &block_sums[b])) {
+            MY_ERROR("Failed to merge the sum of block [%zu]\n", b);
+        }
+    }
+
+    report_haversine_sum(data_item_count, float_sum_result(&sum));
+    if (answer_file) {
+        for (int i=1; i<thread_count; i++) {
+            pair_answer_check_merge(&jobs[0].check, &jobs[i].check);
+            pair_answer_check_free(&jobs[i].check);
+        }
+        report_answer_check(&jobs[0].check);
+    }
+
+    free(threads);
+    free(jobs);
+    free(block_sums);
 
     TAG_BLOCK_END(BLOCK_HAVERSINE);
 }
 
 /*
- * This will give us an estimate on how many data entries are in the file without
- * parsing it. This will always be off as we target the max case were all lines are
- * as small as possible, so the real item count will be lower than this, but this
- * gives us a ballpark figure
+ * Reader thread for the async ring, it keeps filling free blocks in order until
+ * it has posted the empty block that marks the end of the file
+ */
+int stream_reader_thread(void *arg) {
+    struct stream_ring *ring = (struct stream_ring *)arg;
+    bool done = false;
+
+    while (!done) {
+        struct stream_block *block = &ring->blocks[ring->read_block];
+
+        mtx_lock(&ring->lock);
+        while (ring->full[ring->read_block]) {
+            cnd_wait(&ring->block_released, &ring->lock);
+        }
+        mtx_unlock(&ring->lock);
+
+        size_t read_size = ring->file_remaining < STREAM_BLOCK_SIZE ? ring->file_remaining : STREAM_BLOCK_SIZE;
+        uint64_t start = GET_CPU_TICKS();
+        block->data_size = fread(block->buffer + STREAM_CARRY_SIZE, 1, read_size, ring->fp);
+        ring->read_ticks += GET_CPU_TICKS() - start;
+        ring->read_bytes += block->data_size;
+        ring->file_remaining -= read_size;
+
+        mtx_lock(&ring->lock);
+        if (block->data_size != read_size) {
+            // let the parser report it, it will see a short block
+            ring->read_error = true;
+            block->data_size = 0;
+        }
+        ring->full[ring->read_block] = true;
+        cnd_signal(&ring->block_filled);
+        mtx_unlock(&ring->lock);
+
+        done = (block->data_size == 0);
+        ring->read_block = (ring->read_block + 1) % STREAM_RING_BLOCKS;
+    }
+    return 0;
+}
+
+void stream_ring_init(struct stream_ring *ring, char *filename, size_t size, bool async) {
+    for (int i=0; i<STREAM_RING_BLOCKS; i++) {
+        ring->blocks[i].buffer = malloc(STREAM_CARRY_SIZE + STREAM_BLOCK_SIZE);
+        if (!ring->blocks[i].buffer) {
+            MY_ERROR("Malloc failed for size[%d]\n", STREAM_CARRY_SIZE + STREAM_BLOCK_SIZE);
+        }
+        ring->blocks[i].data_size = 0;
+        ring->full[i] = false;
+    }
+    ring->next_block = 0;
+    ring->read_block = 0;
+    ring->file_remaining = size;
+    ring->read_error = false;
+    ring->read_ticks = 0;
+    ring->read_bytes = 0;
+#ifdef _WIN32
+    ring->fp = fopen(filename, "rb");
+#else
+    ring->fp = fopen(filename, "r");
+#endif
+    if (!ring->fp) {
+        MY_ERROR("Failed to open file [%d][%s]\n", errno, strerror(errno));
+    }
+
+    ring->async = async;
+    if (async) {
+        if (mtx_init(&ring->lock, mtx_plain) != thrd_success ||
+            cnd_init(&ring->block_filled) != thrd_success ||
+            cnd_init(&ring->block_released) != thrd_success) {
+            MY_ERROR("Failed to init reader synchronization\n");
+        }
+        if (thrd_create(&ring->reader, stream_reader_thread, ring) != thrd_success) {
+            MY_ERROR("Failed to create reader thread\n");
+        }
+    }
+}
+
+void stream_ring_free(struct stream_ring *ring) {
+    if (ring->async) {
+        thrd_join(ring->reader, NULL);
+        cnd_destroy(&ring->block_released);
+        cnd_destroy(&ring->block_filled);
+        mtx_destroy(&ring->lock);
+    }
+    fclose(ring->fp);
+    for (int i=0; i<STREAM_RING_BLOCKS; i++) {
+        free(ring->blocks[i].buffer);
+        ring->blocks[i].buffer = NULL;
+    }
+}
+
+/*
+ * Get the next block of the file, in async mode wait for the reader to fill it
+ * otherwise read it here
  */
-size_t estimate_total_entries(off_t filesize) {
-    size_t data_bytes = filesize - JSON_OVERHEAD_SIZE;
-    size_t estimated_max_items = ceil((float)((float)data_bytes / (float)JSON_MIN_ROW_SIZE));
-    return estimated_max_items;
+struct stream_block *stream_ring_next(struct stream_ring *ring) {
+    int slot = ring->next_block;
+    struct stream_block *block = &ring->blocks[slot];
+    ring->next_block = (ring->next_block + 1) % STREAM_RING_BLOCKS;
+
+    if (ring->async) {
+        TAG_BLOCK_START(BLOCK_STREAM_WAIT, "StreamWait");
+        mtx_lock(&ring->lock);
+        while (!ring->full[slot]) {
+            cnd_wait(&ring->block_filled, &ring->lock);
+        }
+        bool read_error = ring->read_error;
+        mtx_unlock(&ring->lock);
+        TAG_BLOCK_END(BLOCK_STREAM_WAIT);
+
+        if (read_error && block->data_size == 0) {
+            MY_ERROR("Failed to read file [%d][%s]\n", errno, strerror(errno));
+        }
+        return block;
+    }
+
+    size_t read_size = ring->file_remaining < STREAM_BLOCK_SIZE ? ring->file_remaining : STREAM_BLOCK_SIZE;
+
+    TAG_DATA_BLOCK_START(BLOCK_STREAM_READ, "StreamRead", read_size);
+    block->data_size = fread(block->buffer + STREAM_CARRY_SIZE, 1, read_size, ring->fp);
+    TAG_BLOCK_END(BLOCK_STREAM_READ);
+
+    if (block->data_size != read_size) {
+        MY_ERROR("Failed to read file [%d][%s]\n", errno, strerror(errno));
+    }
+    ring->file_remaining -= read_size;
+    return block;
+}
+
+/*
+ * Hand a block the parser is done with back to the reader
+ */
+void stream_ring_release(struct stream_ring *ring, struct stream_block *block) {
+    if (!ring->async) {
+        return;
+    }
+    int slot = block - ring->blocks;
+    mtx_lock(&ring->lock);
+    ring->full[slot] = false;
+    cnd_signal(&ring->block_released);
+    mtx_unlock(&ring->lock);
+}
+
+/*
+ * Point cur at the carried partial row plus the data of block
+ */
+void stream_cursor_init(struct parse_cursor *cur, struct stream_block *block, size_t carry) {
+    cur->base = block->buffer + STREAM_CARRY_SIZE - carry;
+    cur->ptr = cur->base;
+    cur->remaining = carry + block->data_size;
+    cur->index = NULL;
+    cur->row_end = cur->ptr + cur->remaining;
+    cur->verify_values = verify_values;
+    cur->verbose = verbose;
+}
+
+void stream_parse_and_reduce(char *filename, size_t size) {
+    struct stream_ring ring = {};
+    struct parse_cursor cur = {};
+    struct data_item_s batch[STREAM_BATCH_ROWS];
+    struct float_sum sum;
+    struct pair_answer_check check;
+    size_t count = 0;
+    bool done = false;
+
+    TAG_DATA_BLOCK_START(BLOCK_STREAM, "StreamParseAndReduce", size);
+
+    float_sum_init(&sum, sum_mode);
+    if (answer_file) {
+        pair_answer_check_init(&check, &answers, PAIR_ANSWER_JSON, false, 0);
+    }
+    stream_ring_init(&ring, filename, size, stream_async);
+    struct stream_block *block = stream_ring_next(&ring);
+    stream_cursor_init(&cur, block, 0);
+    if (!find_pairs_array(&cur)) {
+        MY_ERROR("Invalid json header, %s\n", cur.error);
+    }
+
+    while (!done) {
+        size_t batch_count = 0;
+
+        TAG_BLOCK_START(BLOCK_STREAM_PARSE, "StreamParse");
+        parse_tiers_start(&cur);
+        while (batch_count < STREAM_BATCH_ROWS) {
+            uint8_t *row_start = cur.ptr;
+            size_t row_remaining = cur.remaining;
+            enum parse_row_result_e result = parse_row(&cur, &batch[batch_count]);
+            if (result == ROW_PARSED) {
+                batch_count++;
+                continue;
+            }
+            if (result == ROW_ERROR) {
+                MY_ERROR("Invalid row format, %s\n", cur.error);
+            }
+            // end of the current block
+            if (block->data_size == 0) {
+                if (result == ROW_INCOMPLETE) {
+                    MY_ERROR("Invalid row format, file ends in the middle of a row\n");
+                }
+                done = true;
+                break;
+            }
+            // the wait for the next block is not parse time
+            parse_tiers_stop(&cur);
+            size_t carry = 0;
+            if (result == ROW_INCOMPLETE) {
+                carry = row_remaining;
+                if (carry > STREAM_CARRY_SIZE) {
+                    MY_ERROR("Row of [%zu] bytes does not fit the carry space\n", carry);
+                }
+            }
+            struct stream_block *prev_block = block;
+            block = stream_ring_next(&ring);
+            memcpy(block->buffer + STREAM_CARRY_SIZE - carry, row_start, carry);
+            stream_ring_release(&ring, prev_block);
+            stream_cursor_init(&cur, block, carry);
+            parse_tiers_start(&cur);
+        }
+        parse_tiers_stop(&cur);
+        TAG_BLOCK_END(BLOCK_STREAM_PARSE);
+
+        TAG_DATA_BLOCK_START(BLOCK_STREAM_HAVERSINE, "StreamHaversine", batch_count*sizeof(struct data_item_s));
+        for (size_t i=0; i<batch_count; i++) {
+            struct data_item_s *item = &batch[i];
+            double distance = ReferenceHaversine(item->x0, item->y0, item->x1, item->y1, APPROX_EARTH_RADIUS);
+            float_sum_add(&sum, distance);
+            if (answer_file) {
+                pair_answer_check_row(&check, item->x0, item->y0, item->x1, item->y1, distance);
+            }
+        }
+        count += batch_count;
+        TAG_BLOCK_END(BLOCK_STREAM_HAVERSINE);
+    }
+
+    verified_value_count += cur.verified_value_count;
+    add_parse_tiers(cur.tiers);
+    stream_ring_release(&ring, block);
+    stream_ring_free(&ring);
+
+    report_haversine_sum(count, float_sum_result(&sum));
+    if (answer_file) {
+        pair_answer_check_finish(&check);
+        report_answer_check(&check);
+    }
+
+    if (ring.async) {
+        // the parser only stalls in StreamWait, the rest of the reader time ran in parallel
+        uint64_t wait_ticks = profile_data[BLOCK_STREAM_WAIT].total_ticks;
+        uint64_t hidden_ticks = ring.read_ticks > wait_ticks ? ring.read_ticks - wait_ticks : 0;
+        TAG_DATA_BLOCK_RECORD(BLOCK_READER_IO, "ReaderIO", ring.read_ticks, ring.read_bytes);
+        printf("Reader IO             %" PRIu64 " ticks (%" PRIu64 " ms)\n", ring.read_ticks, get_ms_from_cpu_ticks(ring.read_ticks));
+        printf("Parser waited         %" PRIu64 " ticks (%" PRIu64 " ms)\n", wait_ticks, get_ms_from_cpu_ticks(wait_ticks));
+        if (ring.read_ticks > 0) {
+            printf("IO hidden by parsing  %.2f%%\n\n", 100.0*(double)hidden_ticks/(double)ring.read_ticks);
+        }
+    }
+
+    TAG_BLOCK_END(BLOCK_STREAM);
+}
+
+/*
+ * Count the rows of the loaded file so the -p array can be sized exactly
+ * instead of from JSON_MIN_ROW_SIZE, every row has one '{' and the outer
+ * object adds one more
+ */
+size_t count_file_rows(void) {
+    size_t braces = count_char(file_data, file_size, '{', structural_isa);
+    return braces > 0 ? braces - 1 : 0;
 }
 
 size_t read_file_to_memory(char *filename, size_t size) {
@@ -373,13 +1114,12 @@ size_t read_file_to_memory(char *filename, size_t size) {
     TAG_DATA_BLOCK_START(BLOCK_FILE_READ, "FileReadToMemory", size);
 
     file_size = size;
-    file_data = (uint8_t *)malloc(file_size);
-    if (!file_data) {
-        MY_ERROR("Malloc failed for size[%zu]\n", file_size);
+    if (!page_alloc(&file_pages, file_size, map_hugepage, map_populate)) {
+        MY_ERROR("Failed to allocate [%zu]bytes for the file\n", file_size);
     }
-
-    file_data_ptr = file_data;
-    file_data_remaining = size;
+    file_data = file_pages.ptr;
+    LOG("Read buffer [%s] pages, populated [%s]\n", page_backing_name(file_pages.backing),
+        file_pages.populated ? "True" : "False");
 
 #ifdef _WIN32
     json_fp = fopen(filename, "rb");
@@ -407,18 +1147,116 @@ size_t read_file_to_memory(char *filename, size_t size) {
     return file_size;
 }
 
+size_t map_file_to_memory(char *filename, size_t size) {
+    TAG_DATA_BLOCK_START(BLOCK_MAP_FILE, "MapFile", size);
+
+    file_size = size;
+
+#ifdef _WIN32
+    HANDLE file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                     map_sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        MY_ERROR("Failed to open file [%lu]\n", GetLastError());
+    }
+    HANDLE map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!map_handle) {
+        MY_ERROR("Failed to create file mapping [%lu]\n", GetLastError());
+    }
+    file_data = (uint8_t *)MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+    if (!file_data) {
+        MY_ERROR("Failed to map view of file [%lu]\n", GetLastError());
+    }
+    // the view keeps the mapping alive
+    CloseHandle(map_handle);
+    CloseHandle(file_handle);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        MY_ERROR("Failed to open file [%d][%s]\n", errno, strerror(errno));
+    }
+
+    int flags = MAP_PRIVATE;
+    if (map_populate) {
+        flags |= MAP_POPULATE;
+    }
+    void *mapping = mmap(NULL, file_size, PROT_READ, flags, fd, 0);
+    if (mapping == MAP_FAILED) {
+        MY_ERROR("mmap failed for size[%zu] [%d][%s]\n", file_size, errno, strerror(errno));
+    }
+    // the mapping keeps its own reference to the file
+    close(fd);
+
+    if (map_sequential) {
+        if (madvise(mapping, file_size, MADV_SEQUENTIAL) != 0) {
+            printf("madvise(MADV_SEQUENTIAL) failed [%d][%s]\n", errno, strerror(errno));
+        }
+    }
+    if (map_hugepage) {
+        if (madvise(mapping, file_size, MADV_HUGEPAGE) != 0) {
+            printf("madvise(MADV_HUGEPAGE) failed [%d][%s]\n", errno, strerror(errno));
+        }
+    }
+    file_data = (uint8_t *)mapping;
+#endif
+
+    TAG_BLOCK_END(BLOCK_MAP_FILE);
+
+    return file_size;
+}
+
+/*
+ * Unmap or free the file buffer of map_file_to_memory or read_file_to_memory
+ */
+void release_file_data(bool mapped) {
+    if (mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(file_data);
+#else
+        munmap(file_data, file_size);
+#endif
+    } else {
+        page_free(&file_pages);
+    }
+    file_data = NULL;
+}
+
 void usage(void) {
-    fprintf(stderr, "Data Generator Binary Reader:\n");
+    fprintf(stderr, "JSON Data Parser Usage:\n");
     fprintf(stderr, "-h            This help dialog.\n");
-    fprintf(stderr, "-i <bin_file> Path to binary file.\n");
-    fprintf(stderr, "-p            Estimate Max Item count and preallocate a memory for all items,\n");
-    fprintf(stderr, "              default is to malloc each item and use a linked list.\n");
+    fprintf(stderr, "-i <file>     Path to the JSON file.\n");
+    fprintf(stderr, "-b <bin_file> Compare the parsed pairs and sum with the data_gen pair file.\n");
+    fprintf(stderr, "-c <answers>  Check the pairs and distances block by block against the data_gen\n");
+    fprintf(stderr, "              answer file and report the first block that differs.\n");
+    fprintf(stderr, "-m            Memory map the input file instead of reading it into a buffer.\n");
+    fprintf(stderr, "-P            Pre-fault the -m mapping, the read buffer and the pair array (MAP_POPULATE).\n");
+    fprintf(stderr, "-S            With -m, advise sequential access (MADV_SEQUENTIAL).\n");
+    fprintf(stderr, "-H            Back the read buffer, the pair array and the linked list arena with 2MB\n");
+    fprintf(stderr, "              pages (MAP_HUGETLB, else MADV_HUGEPAGE), advise them for the -m mapping.\n");
+    fprintf(stderr, "-x            Build a SIMD structural index and jump between structural chars,\n");
+    fprintf(stderr, "              default is the scalar byte by byte parser. Uses AVX2 when available.\n");
+    fprintf(stderr, "-X            Same as -x but force the SSE2 implementation.\n");
+    fprintf(stderr, "-D            Cut the file into tokens with the table driven DFA tokenizer and build\n");
+    fprintf(stderr, "              the rows from them, default is the row parser.\n");
+    fprintf(stderr, "-j <threads>  Split the file in <threads> byte ranges and parse them in parallel,\n");
+    fprintf(stderr, "              the haversine sum is also computed in parallel over fixed blocks.\n");
+    fprintf(stderr, "-s            Stream the file through a small ring of blocks and reduce every row\n");
+    fprintf(stderr, "              as soon as it is parsed, the pairs are never stored.\n");
+    fprintf(stderr, "-a            With -s, fill the ring from a reader thread so file reads overlap parsing.\n");
+    fprintf(stderr, "-p            Count the rows with a SIMD pass and preallocate memory for all items,\n");
+    fprintf(stderr, "              default is to arena allocate each item and use a linked list.\n");
+    fprintf(stderr, "-A            Like -p but store the pairs as four aligned arrays (SoA) and run\n");
+    fprintf(stderr, "              the lane based haversine kernel over them.\n");
+    fprintf(stderr, "-K            With -A, use the AVX2/AVX-512 polynomial haversine_batch kernel.\n");
+    fprintf(stderr, "-r <sum>      Add up the distances as pairwise (default) or kahan, the result is the\n");
+    fprintf(stderr, "              same with or without -j, -s or -A. naive adds them one after the other.\n");
+    fprintf(stderr, "-V            Verify every parsed value against strtod.\n");
     fprintf(stderr, "-v            Enable Verbose Output.\n");
 }
 
 int main (int argc, char *argv[]) {
     int opt;
     bool preallocate_entries = false;
+    bool map_file = false;
     char *input_file = NULL;
     int ret;
     struct stat statbuf = {};
@@ -447,14 +1285,75 @@ int main (int argc, char *argv[]) {
             input_file = strdup(argv[index+1]);
             // since we consume the next parameter then skip it
             ++index;
+        } else if (strcmp(argv[index], "-b")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing pair file\n");
+                usage();
+                exit(1);
+            }
+            reference_file = strdup(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-c")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing answer file\n");
+                usage();
+                exit(1);
+            }
+            answer_file = strdup(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-m")==0) {
+            map_file = true;
+        } else if (strcmp(argv[index], "-P")==0) {
+            map_populate = true;
+        } else if (strcmp(argv[index], "-S")==0) {
+            map_sequential = true;
+        } else if (strcmp(argv[index], "-H")==0) {
+            map_hugepage = true;
+        } else if (strcmp(argv[index], "-D")==0) {
+            use_dfa = true;
+        } else if (strcmp(argv[index], "-x")==0) {
+            use_structural_index = true;
+        } else if (strcmp(argv[index], "-X")==0) {
+            use_structural_index = true;
+            structural_isa = JSON_SCAN_SSE2;
+        } else if (strcmp(argv[index], "-j")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing thread count\n");
+                usage();
+                exit(1);
+            }
+            thread_count = atoi(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-s")==0) {
+            stream_mode = true;
+        } else if (strcmp(argv[index], "-a")==0) {
+            stream_async = true;
         } else if (strcmp(argv[index], "-p")==0) {
             preallocate_entries = true;
+        } else if (strcmp(argv[index], "-A")==0) {
+            soa_layout = true;
+        } else if (strcmp(argv[index], "-K")==0) {
+            use_batch_kernel = true;
+        } else if (strcmp(argv[index], "-r")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing sum mode\n");
+                usage();
+                exit(1);
+            }
+            if (!float_sum_mode_parse(argv[index+1], &sum_mode)) {
+                printf("ERROR: unknown sum mode [%s]\n", argv[index+1]);
+                usage();
+                exit(1);
+            }
+            ++index;
+        } else if (strcmp(argv[index], "-V")==0) {
+            verify_values = true;
         } else if (strcmp(argv[index], "-v")==0) {
             verbose = true;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "hi:p")) != -1) {
+    while( (opt = getopt(argc, argv, "hi:b:c:mPSHDxXj:sapAKr:Vv")) != -1) {
         switch (opt) {
             case 'h':
                 usage();
@@ -464,11 +1363,80 @@ int main (int argc, char *argv[]) {
             case 'i':
                 input_file = strdup(optarg);
                 break;
+
+            case 'b':
+                reference_file = strdup(optarg);
+                break;
+
+            case 'c':
+                answer_file = strdup(optarg);
+                break;
+
+            case 'm':
+                map_file = true;
+                break;
+
+            case 'P':
+                map_populate = true;
+                break;
+
+            case 'S':
+                map_sequential = true;
+                break;
+
+            case 'H':
+                map_hugepage = true;
+                break;
             
+            case 'D':
+                use_dfa = true;
+                break;
+
+            case 'x':
+                use_structural_index = true;
+                break;
+
+            case 'X':
+                use_structural_index = true;
+                structural_isa = JSON_SCAN_SSE2;
+                break;
+
+            case 'j':
+                thread_count = atoi(optarg);
+                break;
+
+            case 's':
+                stream_mode = true;
+                break;
+
+            case 'a':
+                stream_async = true;
+                break;
+
             case 'p':
                 preallocate_entries = true;
                 break;
 
+            case 'A':
+                soa_layout = true;
+                break;
+
+            case 'K':
+                use_batch_kernel = true;
+                break;
+
+            case 'r':
+                if (!float_sum_mode_parse(optarg, &sum_mode)) {
+                    fprintf(stderr, "ERROR unknown sum mode [%s]\n", optarg);
+                    usage();
+                    exit(1);
+                }
+                break;
+
+            case 'V':
+                verify_values = true;
+                break;
+
             case 'v':
                 verbose = true;
                 break;
@@ -486,6 +1454,40 @@ int main (int argc, char *argv[]) {
         usage();
         exit(1);
     }
+    if (thread_count < 0) {
+        fprintf(stderr, "ERROR invalid thread count [%d]\n", thread_count);
+        usage();
+        exit(1);
+    }
+    if (stream_async && !stream_mode) {
+        fprintf(stderr, "ERROR -a requires -s\n");
+        usage();
+        exit(1);
+    }
+    if (soa_layout && (stream_mode || thread_count > 0)) {
+        fprintf(stderr, "ERROR -A can not be combined with -s or -j\n");
+        usage();
+        exit(1);
+    }
+    if (use_dfa && (stream_mode || thread_count > 0 || use_structural_index || verify_values)) {
+        fprintf(stderr, "ERROR -D can not be combined with -s, -j, -x or -V\n");
+        usage();
+        exit(1);
+    }
+    if (use_batch_kernel && !soa_layout) {
+        fprintf(stderr, "ERROR -K requires -A\n");
+        usage();
+        exit(1);
+    }
+    if (soa_layout) {
+        // SoA is a preallocated layout
+        preallocate_entries = true;
+    }
+    if (stream_mode && (map_file || use_structural_index || thread_count > 0 || preallocate_entries)) {
+        fprintf(stderr, "ERROR -s can not be combined with -m, -x, -j or -p\n");
+        usage();
+        exit(1);
+    }
 
     printf("================\n");
     printf("JSON Data Parser\n");
@@ -496,39 +1498,149 @@ int main (int argc, char *argv[]) {
     if (ret != 0) {
         MY_ERROR("Unable to get filestats[%d][%s]\n", errno, strerror(errno));
     }
-    printf("PreAllocating entries         [%s]\n", preallocate_entries ? "True" : "False");
+    if (stream_mode) {
+        printf("Streaming parse and reduce    [%d] blocks of [%d] bytes\n", STREAM_RING_BLOCKS, STREAM_BLOCK_SIZE);
+        printf("  Async reader thread         [%s]\n", stream_async ? "True" : "False");
+    } else if (thread_count > 0) {
+        // the threaded path always parses into per thread slabs
+        preallocate_entries = false;
+        printf("Parsing threads               [%d]\n", thread_count);
+    } else {
+        printf("PreAllocating entries         [%s]\n", preallocate_entries ? "True" : "False");
+        printf("  Pair storage layout         [%s]\n", soa_layout ? "SoA" : (preallocate_entries ? "AoS" : "List"));
+        if (use_batch_kernel) {
+            printf("  Haversine batch kernel      [%s]\n", haversine_isa_name(haversine_batch_select(HAVERSINE_AUTO)));
+        }
+        if (!preallocate_entries) {
+            printf("  List arena huge pages       [%s]\n", map_hugepage ? "True" : "False");
+        }
+    }
+    printf("Memory Map input file         [%s]\n", map_file ? "True" : "False");
+    if (map_file) {
+        printf("  MAP_POPULATE                [%s]\n", map_populate ? "True" : "False");
+        printf("  MADV_SEQUENTIAL             [%s]\n", map_sequential ? "True" : "False");
+        printf("  MADV_HUGEPAGE               [%s]\n", map_hugepage ? "True" : "False");
+    }
+    printf("Huge page buffers             [%s]\n", map_hugepage ? "True" : "False");
+    printf("Pre-fault buffers             [%s]\n", map_populate ? "True" : "False");
+    printf("SIMD Structural Index         [%s]\n", use_structural_index ? "True" : "False");
+    printf("DFA tokenizer                 [%s]\n", use_dfa ? "True" : "False");
+    printf("Verify values with strtod     [%s]\n", verify_values ? "True" : "False");
+    printf("Sum mode                      [%s]\n", float_sum_mode_name(sum_mode));
+    if (reference_file) {
+        pair_file_open(&reference, reference_file);
+        printf("Reference pair file           [%s]\n", reference_file);
+        printf("  Version                     [%u]\n", reference.header.version);
+        printf("  Layout                      [%s]\n", pair_file_layout_name(reference.header.layout));
+        printf("  Count                       [%" PRIu64 "]\n", reference.count);
+    }
+    if (answer_file) {
+        pair_answers_load(&answers, answer_file);
+        printf("Answer file                   [%s]\n", answer_file);
+        printf("  Blocks                      [%" PRIu64 "] of [%" PRIu64 "] rows\n", answers.header.block_count, answers.header.block_rows);
+        printf("  Sum mode                    [%s]\n", float_sum_mode_name(answers.header.sum_mode));
+        printf("  Count                       [%" PRIu64 "]\n", answers.header.count);
+    }
     printf("  File Size                   [%lu] bytes\n", statbuf.st_size);
 #ifndef _WIN32
     printf("  IO Block Size               [%lu] bytes\n", statbuf.st_blksize);
     printf("  Allocated 512B Blocks       [%lu]\n", statbuf.st_blocks);
 #endif
-    size_t item_estimate = estimate_total_entries(statbuf.st_size);
-    printf("  Estimated Items             [%zu]\n", item_estimate);
     printf("\n\n");
 
-    if (preallocate_entries) {
-        data_array = malloc(item_estimate * sizeof(struct data_item_s));
-        if (!data_array) {
-            MY_ERROR("Failed to malloc [%zu]bytes for data array\n", item_estimate * sizeof(struct data_item_s));
-        }
+    if (!preallocate_entries) {
+        arena_init(&list_arena, ARENA_DEFAULT_BLOCK_SIZE, map_hugepage);
     }
 
     TAG_BLOCK_END(BLOCK_INIT);
 
-    size_t bytes_read = read_file_to_memory(input_file, statbuf.st_size);
-    if (bytes_read != statbuf.st_size) {
-        MY_ERROR("Failed to read expected bytes\n");
-    }
-    printf("Read %zu bytes\n", statbuf.st_size);
+    if (stream_mode) {
+        printf("Start Streaming File\n");
+        printf("--------------------\n");
+
+        stream_parse_and_reduce(input_file, statbuf.st_size);
+
+        report_parse_tiers();
+        if (verify_values) {
+            printf("Verified %zu values against strtod\n", verified_value_count);
+        }
+    } else {
+        size_t bytes_read;
+        if (map_file) {
+            bytes_read = map_file_to_memory(input_file, statbuf.st_size);
+        } else {
+            bytes_read = read_file_to_memory(input_file, statbuf.st_size);
+        }
+        if (bytes_read != statbuf.st_size) {
+            MY_ERROR("Failed to read expected bytes\n");
+        }
+        printf("%s %zu bytes\n", map_file ? "Mapped" : "Read", statbuf.st_size);
+
+        if (use_structural_index) {
+            TAG_DATA_BLOCK_START(BLOCK_STRUCTURAL_INDEX, "StructuralIndex", (uint64_t)statbuf.st_size);
+            if (!build_structural_index(&file_index, file_data, statbuf.st_size, structural_isa)) {
+                MY_ERROR("Failed to allocate structural index for [%zu]bytes\n", statbuf.st_size);
+            }
+            TAG_BLOCK_END(BLOCK_STRUCTURAL_INDEX);
+            printf("Built %s structural index of %zu words\n", file_index.isa_name, file_index.word_count);
+        }
+
+        if (preallocate_entries) {
+            TAG_DATA_BLOCK_START(BLOCK_COUNT_ROWS, "CountRows", (uint64_t)statbuf.st_size);
+            data_array_capacity = count_file_rows();
+            TAG_BLOCK_END(BLOCK_COUNT_ROWS);
+            printf("Counted %zu rows\n", data_array_capacity);
 
-    printf("Start Parsing File\n");
-    printf("------------------\n");
+            if (soa_layout) {
+                pair_soa_alloc(&data_soa, data_array_capacity);
+            } else {
+                alloc_data_array(data_array_capacity);
+            }
+        }
 
-    TAG_DATA_BLOCK_START(BLOCK_PARSE_DATA_FILE, "ParseFileData", (uint64_t)statbuf.st_size);
-    parse_file(preallocate_entries);
-    TAG_BLOCK_END(BLOCK_PARSE_DATA_FILE);
+        printf("Start Parsing File\n");
+        printf("------------------\n");
+
+        TAG_DATA_BLOCK_START(BLOCK_PARSE_DATA_FILE, "ParseFileData", (uint64_t)statbuf.st_size);
+        if (thread_count > 0) {
+            parse_file_threaded();
+        } else {
+            parse_file(preallocate_entries);
+        }
+        TAG_BLOCK_END(BLOCK_PARSE_DATA_FILE);
 
-    calculate_haversine_average(preallocate_entries);
+        report_parse_tiers();
+        if (verify_values) {
+            printf("Verified %zu values against strtod\n", verified_value_count);
+        }
+
+        if (reference_file) {
+            check_reference_pairs(preallocate_entries);
+        }
+
+        if (thread_count > 0) {
+            calculate_haversine_average_threaded();
+        } else {
+            calculate_haversine_average(preallocate_entries);
+        }
+    }
+
+    if (list_arena.block_count > 0) {
+        printf("List arena used [%zu] blocks, [%zu] of [%zu] bytes\n", list_arena.block_count, list_arena.allocated_bytes, list_arena.reserved_bytes);
+        arena_free(&list_arena);
+    }
+    release_file_data(map_file);
+    if (use_structural_index) {
+        free_structural_index(&file_index);
+    }
+    page_free(&data_array_pages);
+
+    if (reference_file) {
+        pair_file_close(&reference);
+    }
+    if (answer_file) {
+        pair_answers_free(&answers);
+    }
 
     TAG_PROGRAM_END();
 
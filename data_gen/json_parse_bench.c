@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "json_row.h"
+#include "json_dfa.h"
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+/*
+ * JSON parser benchmark
+ *
+ * Parses the same data_gen JSON file held in memory with:
+ *  - Rows_General, the branchy parse_row_general walk (advance_until, key
+ *    dispatch and value separators byte by byte)
+ *  - Rows_Tiered, parse_row with the data_gen fast path in front of it
+ *  - DFA_Tokens, only the table driven json_dfa tokenizer, every token is
+ *    read back from the ring
+ *  - DFA_Rows, the tokenizer plus building the rows from the tokens
+ * The row tests store the rows into the same preallocated array, speeds are
+ * JSON bytes over time. All row tests must produce the same rows.
+ */
+enum parse_test_e {
+    PARSE_TEST_GENERAL,
+    PARSE_TEST_TIERED,
+    PARSE_TEST_DFA_TOKENS,
+    PARSE_TEST_DFA_ROWS,
+    MAX_TESTS,
+};
+
+struct test_context {
+    char *name;
+    enum parse_test_e test;
+    const uint8_t *data;
+    size_t size;
+    struct data_item_s *rows;
+    size_t capacity;
+    size_t count;               // rows, or tokens for DFA_Tokens
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+static struct json_tokenizer tok;
+
+static size_t parse_rows(struct test_context *ctx) {
+    struct parse_cursor cur = {};
+    enum parse_row_result_e result;
+    size_t count = 0;
+
+    cur.ptr = (uint8_t *)ctx->data;
+    cur.base = cur.ptr;
+    cur.remaining = ctx->size;
+    cur.row_end = cur.ptr + cur.remaining;
+    if (!find_pairs_array(&cur)) {
+        MY_ERROR("Invalid json header, %s\n", cur.error);
+    }
+    for (;;) {
+        if (count == ctx->capacity) {
+            MY_ERROR("More than [%zu] rows\n", ctx->capacity);
+        }
+        if (ctx->test == PARSE_TEST_GENERAL) {
+            result = parse_row_general(&cur, &ctx->rows[count]);
+        } else {
+            result = parse_row(&cur, &ctx->rows[count]);
+        }
+        if (result != ROW_PARSED) {
+            break;
+        }
+        count++;
+    }
+    if (result == ROW_INCOMPLETE) {
+        MY_ERROR("Invalid row format, file ends in the middle of a row\n");
+    }
+    if (result == ROW_ERROR) {
+        MY_ERROR("Invalid row format, %s at offset [%zu]\n", cur.error, (size_t)(cur.ptr - cur.base));
+    }
+    return count;
+}
+
+static size_t dfa_tokens(struct test_context *ctx) {
+    struct json_token token;
+    size_t count = 0;
+
+    json_tokenizer_init(&tok, ctx->data, ctx->size);
+    while (json_tokenizer_next(&tok, &token)) {
+        count++;
+    }
+    return count;
+}
+
+static size_t dfa_rows(struct test_context *ctx) {
+    size_t count = 0;
+
+    json_tokenizer_init(&tok, ctx->data, ctx->size);
+    if (!json_dfa_find_pairs(&tok)) {
+        MY_ERROR("Invalid json header, %s at offset [%zu]\n", tok.error, tok.error_pos);
+    }
+    for (;;) {
+        if (count == ctx->capacity) {
+            MY_ERROR("More than [%zu] rows\n", ctx->capacity);
+        }
+        if (!json_dfa_next_row(&tok, &ctx->rows[count])) {
+            break;
+        }
+        count++;
+    }
+    if (tok.error) {
+        MY_ERROR("Invalid row format, %s at offset [%zu]\n", tok.error, tok.error_pos);
+    }
+    return count;
+}
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+
+    uint64_t start = GET_CPU_TICKS();
+    switch (ctx->test) {
+        case PARSE_TEST_DFA_TOKENS:
+            ctx->count = dfa_tokens(ctx);
+            break;
+        case PARSE_TEST_DFA_ROWS:
+            ctx->count = dfa_rows(ctx);
+            break;
+        default:
+            ctx->count = parse_rows(ctx);
+            break;
+    }
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(ctx->size, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(ctx->size, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+
+    printf("[%s] name[%s] %s[%zu]\n", __FUNCTION__, ctx->name,
+           ctx->test == PARSE_TEST_DFA_TOKENS ? "tokens" : "rows", ctx->count);
+    printf("\n");
+
+    printf("[%s] Slowest Speed", __FUNCTION__);
+    print_data_speed(ctx->size, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Speed", __FUNCTION__);
+    print_data_speed(ctx->size, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+static uint8_t *read_file(const char *filename, size_t *size) {
+    struct stat statbuf = {};
+
+    if (stat(filename, &statbuf) != 0) {
+        MY_ERROR("Unable to get filestats[%d][%s]\n", errno, strerror(errno));
+    }
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        MY_ERROR("Failed to open [%s] [%d][%s]\n", filename, errno, strerror(errno));
+    }
+    uint8_t *data = malloc(statbuf.st_size ? statbuf.st_size : 1);
+    if (!data) {
+        MY_ERROR("Malloc failed for size[%zu]\n", (size_t)statbuf.st_size);
+    }
+    if (fread(data, 1, statbuf.st_size, fp) != (size_t)statbuf.st_size) {
+        MY_ERROR("Failed to read [%s]\n", filename);
+    }
+    fclose(fp);
+    *size = statbuf.st_size;
+    return data;
+}
+
+void usage(void) {
+    fprintf(stderr, "JSON Parser Benchmark Usage:\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+    fprintf(stderr, "-i <json_file> data_gen JSON file to parse.\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    char *input_file = NULL;
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-i")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing json file parameter\n");
+                usage();
+                exit(1);
+            }
+            input_file = strdup(argv[index+1]);
+            ++index;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "ht:i:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            case 'i':
+                input_file = strdup(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    if (!input_file) {
+        usage();
+        exit(1);
+    }
+
+    printf("=====================\n");
+    printf("JSON Parser Benchmark\n");
+    printf("=====================\n");
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Using input     [%s]\n", input_file);
+
+    size_t size;
+    uint8_t *data = read_file(input_file, &size);
+    // every row has a '{', so that many rows always fit
+    size_t capacity = 1;
+    for (size_t i=0; i<size; i++) {
+        capacity += data[i] == '{';
+    }
+
+    char *names[MAX_TESTS] = { "Rows_General", "Rows_Tiered", "DFA_Tokens", "DFA_Rows" };
+    struct test_context contexts[MAX_TESTS] = {};
+    struct rep_tester_config tests[MAX_TESTS] = {};
+    for (int i=0; i<MAX_TESTS; i++) {
+        contexts[i].name = names[i];
+        contexts[i].test = i;
+        contexts[i].data = data;
+        contexts[i].size = size;
+        contexts[i].capacity = capacity;
+        if (i != PARSE_TEST_DFA_TOKENS) {
+            contexts[i].rows = malloc(capacity * sizeof(struct data_item_s));
+            if (!contexts[i].rows) {
+                MY_ERROR("Malloc failed for [%zu] rows\n", capacity);
+            }
+        }
+
+        tests[i].test_name = contexts[i].name;
+        tests[i].test_main = test_main;
+        tests[i].print_stats = print_stats;
+        tests[i].test_runtime_seconds = runtime;
+        tests[i].silent = true;
+        tests[i].context = &contexts[i];
+    }
+
+    printf("\n\n");
+    rep_tester_run(tests, MAX_TESTS);
+
+    for (int i=0; i<MAX_TESTS; i++) {
+        if (i == PARSE_TEST_DFA_TOKENS || i == PARSE_TEST_GENERAL) {
+            continue;
+        }
+        if (contexts[i].count != contexts[PARSE_TEST_GENERAL].count ||
+            memcmp(contexts[i].rows, contexts[PARSE_TEST_GENERAL].rows, contexts[i].count * sizeof(struct data_item_s)) != 0) {
+            MY_ERROR("[%s] rows differ from [%s]\n", contexts[i].name, contexts[PARSE_TEST_GENERAL].name);
+        }
+    }
+    printf("All parsers produced the same [%zu] rows\n", contexts[PARSE_TEST_GENERAL].count);
+
+    for (int i=0; i<MAX_TESTS; i++) {
+        free(contexts[i].rows);
+    }
+    free(data);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "pair_answers.h"
+#include "pair_file.h"
+#include "float_sum.h"
+
+#define MY_ERROR(...) {                    \
+        fprintf(stderr, "[%s:%d]", __FUNCTION__, __LINE__);      \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+void pair_answer_add(struct pair_answer *answer, struct float_sum *sum, uint64_t row,
+                     double x0, double y0, double x1, double y1, double distance) {
+    double pair[4] = {x0, y0, x1, y1};
+    float_sum_add(sum, distance);
+    answer->distance_hash += pair_file_checksum(&distance, sizeof(double), row * sizeof(double));
+    answer->pair_hash += pair_file_checksum(pair, sizeof(pair), row * sizeof(pair));
+}
+
+void pair_answers_load(struct pair_answers *answers, const char *filename) {
+    struct pair_answers_header *header = &answers->header;
+
+    memset(answers, 0, sizeof(struct pair_answers));
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        MY_ERROR("Failed to open answer file [%s] [%d][%s]\n", filename, errno, strerror(errno));
+    }
+    if (fread(header, sizeof(struct pair_answers_header), 1, fp) != 1) {
+        MY_ERROR("Answer file [%s] is too short for its header\n", filename);
+    }
+    if (memcmp(header->magic, PAIR_ANSWERS_MAGIC, sizeof(PAIR_ANSWERS_MAGIC)) != 0 || header->version != PAIR_ANSWERS_VERSION) {
+        MY_ERROR("[%s] is not a version [%d] answer file\n", filename, PAIR_ANSWERS_VERSION);
+    }
+    if (header->block_rows == 0 || header->block_count != (header->count + header->block_rows - 1) / header->block_rows ||
+        header->sum_mode > FLOAT_SUM_KAHAN) {
+        MY_ERROR("Answer file [%s] has [%" PRIu64 "] blocks of [%" PRIu64 "] rows for [%" PRIu64 "] rows\n", filename,
+                 header->block_count, header->block_rows, header->count);
+    }
+
+    answers->blocks = malloc((header->block_count ? header->block_count : 1) * sizeof(struct pair_answer_block));
+    if (!answers->blocks) {
+        MY_ERROR("Failed to allocate [%" PRIu64 "] answer blocks\n", header->block_count);
+    }
+    if (fread(answers->blocks, sizeof(struct pair_answer_block), header->block_count, fp) != header->block_count) {
+        MY_ERROR("Answer file [%s] is truncated\n", filename);
+    }
+    for (uint64_t b=0; b<header->block_count; b++) {
+        uint64_t first_row = b * header->block_rows;
+        uint64_t rows = header->count - first_row < header->block_rows ? header->count - first_row : header->block_rows;
+        if (answers->blocks[b].first_row != first_row || answers->blocks[b].rows != rows) {
+            MY_ERROR("Answer block [%" PRIu64 "] does not match the block layout\n", b);
+        }
+    }
+    fclose(fp);
+}
+
+void pair_answers_free(struct pair_answers *answers) {
+    free(answers->blocks);
+    answers->blocks = NULL;
+}
+
+static bool answer_matches(const struct pair_answer_check *check, const struct pair_answer *computed,
+                           const struct pair_answer *expected) {
+    if (computed->pair_hash != expected->pair_hash) {
+        return false;
+    }
+    if (check->approximate) {
+        return fabs(computed->sum - expected->sum) <= PAIR_ANSWER_TOLERANCE * fabs(expected->sum);
+    }
+    return computed->sum == expected->sum && computed->distance_hash == expected->distance_hash;
+}
+
+static void check_block(struct pair_answer_check *check, uint64_t rows) {
+    const struct pair_answer_block *block = &check->answers->blocks[check->block];
+
+    check->current.sum = float_sum_result(check->sum);
+    check->checked_blocks++;
+    if (rows != block->rows || !answer_matches(check, &check->current, &block->answer[check->source])) {
+        check->bad_blocks++;
+        if (check->first_bad_block == UINT64_MAX) {
+            check->first_bad_block = check->block;
+            check->first_bad = check->current;
+            check->first_bad_rows = rows;
+        }
+    }
+    memset(&check->current, 0, sizeof(struct pair_answer));
+    float_sum_init(check->sum, check->answers->header.sum_mode);
+}
+
+void pair_answer_check_init(struct pair_answer_check *check, const struct pair_answers *answers,
+                            enum pair_answer_source_e source, bool approximate, uint64_t first_row) {
+    memset(check, 0, sizeof(struct pair_answer_check));
+    if (first_row % answers->header.block_rows != 0) {
+        MY_ERROR("Answer check starts at row [%" PRIu64 "], not on a block of [%" PRIu64 "] rows\n",
+                 first_row, answers->header.block_rows);
+    }
+    check->answers = answers;
+    check->source = source;
+    check->approximate = approximate;
+    check->row = first_row;
+    check->block = first_row / answers->header.block_rows;
+    check->first_bad_block = UINT64_MAX;
+    check->sum = malloc(sizeof(struct float_sum));
+    if (!check->sum) {
+        MY_ERROR("Failed to allocate the answer check sum\n");
+    }
+    float_sum_init(check->sum, answers->header.sum_mode);
+}
+
+void pair_answer_check_row(struct pair_answer_check *check, double x0, double y0, double x1, double y1, double distance) {
+    if (check->block >= check->answers->header.block_count) {
+        check->extra_rows++;
+        return;
+    }
+    pair_answer_add(&check->current, check->sum, check->row, x0, y0, x1, y1, distance);
+    check->row++;
+
+    const struct pair_answer_block *block = &check->answers->blocks[check->block];
+    if (check->row == block->first_row + block->rows) {
+        check_block(check, block->rows);
+        check->block++;
+    }
+}
+
+void pair_answer_check_finish(struct pair_answer_check *check) {
+    if (check->block < check->answers->header.block_count) {
+        uint64_t rows = check->row - check->answers->blocks[check->block].first_row;
+        if (rows > 0) {
+            check_block(check, rows);
+        }
+    }
+}
+
+void pair_answer_check_free(struct pair_answer_check *check) {
+    free(check->sum);
+    check->sum = NULL;
+}
+
+void pair_answer_check_merge(struct pair_answer_check *check, const struct pair_answer_check *later) {
+    check->checked_blocks += later->checked_blocks;
+    check->bad_blocks += later->bad_blocks;
+    check->extra_rows += later->extra_rows;
+    if (check->first_bad_block == UINT64_MAX && later->first_bad_block != UINT64_MAX) {
+        check->first_bad_block = later->first_bad_block;
+        check->first_bad = later->first_bad;
+        check->first_bad_rows = later->first_bad_rows;
+    }
+}
+
+bool pair_answer_check_report(const struct pair_answer_check *check) {
+    const struct pair_answers_header *header = &check->answers->header;
+    bool ok = check->bad_blocks == 0 && check->extra_rows == 0 && check->checked_blocks == header->block_count;
+
+    printf("Answer check [%s%s] blocks checked [%" PRIu64 "] of [%" PRIu64 "] differing [%" PRIu64 "] extra rows [%" PRIu64 "] %s\n",
+           pair_answer_source_name(check->source), check->approximate ? ", approximate" : "",
+           check->checked_blocks, header->block_count, check->bad_blocks, check->extra_rows, ok ? "[OK]" : "[FAILED]");
+    if (check->first_bad_block != UINT64_MAX) {
+        const struct pair_answer_block *block = &check->answers->blocks[check->first_bad_block];
+        const struct pair_answer *expected = &block->answer[check->source];
+        printf("  First divergent block [%" PRIu64 "] rows [%" PRIu64 ", %" PRIu64 ") got [%" PRIu64 "] rows\n",
+               check->first_bad_block, block->first_row, block->first_row + block->rows, check->first_bad_rows);
+        printf("  Block sum             %3.16f expected %3.16f\n", check->first_bad.sum, expected->sum);
+        printf("  Distance hash         [%016" PRIx64 "] expected [%016" PRIx64 "]\n", check->first_bad.distance_hash, expected->distance_hash);
+        printf("  Pair hash             [%016" PRIx64 "] expected [%016" PRIx64 "]\n", check->first_bad.pair_hash, expected->pair_hash);
+    }
+    return ok;
+}
+
+const char *pair_answer_source_name(uint32_t source) {
+    switch (source) {
+        case PAIR_ANSWER_BINARY:
+            return "binary";
+        case PAIR_ANSWER_JSON:
+            return "json";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Answer file
+ *
+ * data_gen writes next to the JSON and pair file the expected results of
+ * every block_rows rows, its 64K row generator blocks:
+ *
+ *   [pair_answers_header][pair_answer_block * block_count]
+ *
+ * Every block has one answer for the pairs of the pair file and one for the
+ * pairs a JSON reader gets back from the 16 decimal text, those differ when
+ * a coordinate below 1.0 does not round trip. An answer is the sum of the
+ * block distances added alone as sum_mode (float_sum) and two position
+ * dependent hashes (pair_file_checksum) of the distance and x0, y0, x1, y1
+ * bits of every row.
+ *
+ * Readers feed the rows they computed to a pair_answer_check in row order.
+ * Every finished block is compared right away, and a check can start at any
+ * block so parallel readers check their own blocks and merge the results.
+ * The first block that differs is kept, with what was computed for it.
+ *
+ * An approximate check is for distances from a kernel that is not bit
+ * identical to ReferenceHaversine (haversine_batch), the coordinates must
+ * still hash the same and the sum must be within PAIR_ANSWER_TOLERANCE.
+ */
+
+#define PAIR_ANSWERS_MAGIC      "HVANSWR"
+#define PAIR_ANSWERS_VERSION    1
+#define PAIR_ANSWER_TOLERANCE   1e-12   // relative, of an approximate block sum
+
+enum pair_answer_source_e {
+    PAIR_ANSWER_BINARY,
+    PAIR_ANSWER_JSON,
+    PAIR_ANSWER_SOURCES,
+};
+
+struct pair_answer {
+    double sum;
+    uint64_t distance_hash;             // distance of row r hashed at offset r*8
+    uint64_t pair_hash;                 // x0, y0, x1, y1 of row r hashed at offset r*32
+};
+
+struct pair_answer_block {
+    uint64_t first_row;
+    uint64_t rows;
+    struct pair_answer answer[PAIR_ANSWER_SOURCES];
+};
+
+struct pair_answers_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sum_mode;                  // float_sum_mode_e of the block sums
+    uint64_t count;
+    uint64_t seed;
+    uint64_t block_rows;
+    uint64_t block_count;
+    double sum[PAIR_ANSWER_SOURCES];    // block sums merged in block order
+};
+
+struct pair_answers {
+    struct pair_answers_header header;
+    struct pair_answer_block *blocks;
+};
+
+struct float_sum;
+
+/*
+ * Fold one row into answer, sum is the float_sum of the answer block
+ */
+void pair_answer_add(struct pair_answer *answer, struct float_sum *sum, uint64_t row,
+                     double x0, double y0, double x1, double y1, double distance);
+
+/*
+ * Read and validate an answer file, exits on error
+ */
+void pair_answers_load(struct pair_answers *answers, const char *filename);
+void pair_answers_free(struct pair_answers *answers);
+
+struct pair_answer_check {
+    const struct pair_answers *answers;
+    enum pair_answer_source_e source;
+    bool approximate;
+    uint64_t row;                       // next row to feed
+    uint64_t block;                     // block of row
+    struct pair_answer current;
+    struct float_sum *sum;
+    uint64_t checked_blocks;
+    uint64_t bad_blocks;
+    uint64_t extra_rows;                // rows past the end of the answers
+    uint64_t first_bad_block;           // UINT64_MAX when every checked block matched
+    struct pair_answer first_bad;       // what was computed for first_bad_block
+    uint64_t first_bad_rows;
+};
+
+/*
+ * Start checking at first_row, which must be the first row of a block
+ */
+void pair_answer_check_init(struct pair_answer_check *check, const struct pair_answers *answers,
+                            enum pair_answer_source_e source, bool approximate, uint64_t first_row);
+void pair_answer_check_row(struct pair_answer_check *check, double x0, double y0, double x1, double y1, double distance);
+
+/*
+ * End of the checked rows, a started block that did not get all of its rows
+ * counts as different
+ */
+void pair_answer_check_finish(struct pair_answer_check *check);
+void pair_answer_check_free(struct pair_answer_check *check);
+
+/*
+ * Add the results of a check of later rows to check, the first bad block
+ * is the first of both
+ */
+void pair_answer_check_merge(struct pair_answer_check *check, const struct pair_answer_check *later);
+
+/*
+ * Print the result, returns true when every block of the file was checked
+ * and matched
+ */
+bool pair_answer_check_report(const struct pair_answer_check *check);
+
+const char *pair_answer_source_name(uint32_t source);
@@ -0,0 +1,422 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <immintrin.h>
+
+#include "pair_codec.h"
+
+/*
+ * Block format, for every column:
+ *   uint8 column flags (CODEC_DELTA)
+ *   value_size planes of { uint8 plane mode, uint32 plane size, plane bytes }
+ *
+ * LZ planes are LZ4 style sequences: a token with the literal count in the
+ * high nibble and match length - LZ_MIN_MATCH in the low nibble, a nibble of
+ * 15 continues in extra bytes added until one is below 255, then the
+ * literals, then a 16 bit little endian offset. The last sequence has only
+ * literals and ends the plane.
+ */
+#define CODEC_DELTA             0x01
+#define PLANE_RAW               0
+#define PLANE_LZ                1
+#define PLANE_HEADER_SIZE       5
+
+#define LZ_MIN_MATCH            4
+#define LZ_HASH_BITS            14
+#define LZ_MAX_OFFSET           65535
+#define LZ_LAST_LITERALS        8       // no match starts this close to the end of a plane
+#define LZ_SKIP_SHIFT           6       // skip faster over data that does not match
+
+static uint32_t load32(const uint8_t *ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static size_t lz_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static uint8_t *lz_put_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+static uint8_t *lz_put_sequence(uint8_t *op, const uint8_t *literals, size_t literal_count,
+                                size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    uint8_t *token = op++;
+    *token = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (literal_count >= 15) {
+        op = lz_put_length(op, literal_count - 15);
+    }
+    memcpy(op, literals, literal_count);
+    op += literal_count;
+    if (match_length) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if (match_code >= 15) {
+            op = lz_put_length(op, match_code - 15);
+        }
+    }
+    return op;
+}
+
+static size_t lz_compress(const uint8_t *in, size_t size, uint8_t *out) {
+    uint32_t table[1 << LZ_HASH_BITS] = {};
+    uint8_t *op = out;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    if (size > LZ_LAST_LITERALS + LZ_MIN_MATCH) {
+        size_t limit = size - LZ_LAST_LITERALS - LZ_MIN_MATCH;
+        while (i < limit) {
+            uint32_t sequence = load32(in + i);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+            size_t candidate = table[hash];
+            table[hash] = (uint32_t)i;
+            if (candidate < i && i - candidate <= LZ_MAX_OFFSET && load32(in + candidate) == sequence) {
+                size_t length = LZ_MIN_MATCH;
+                while (i + length < size - LZ_LAST_LITERALS && in[candidate + length] == in[i + length]) {
+                    length++;
+                }
+                op = lz_put_sequence(op, in + anchor, i - anchor, i - candidate, length);
+                i += length;
+                anchor = i;
+            } else {
+                i += 1 + ((i - anchor) >> LZ_SKIP_SHIFT);
+            }
+        }
+    }
+    op = lz_put_sequence(op, in + anchor, size - anchor, 0, 0);
+    return op - out;
+}
+
+static bool lz_get_length(const uint8_t **ip, const uint8_t *in_end, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= in_end) {
+            return false;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+static bool lz_decompress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size) {
+    const uint8_t *ip = in;
+    const uint8_t *in_end = in + in_size;
+    uint8_t *op = out;
+    uint8_t *out_end = out + out_size;
+
+    while (ip < in_end) {
+        uint8_t token = *ip++;
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !lz_get_length(&ip, in_end, &literal_count)) {
+            return false;
+        }
+        if (literal_count > (size_t)(in_end - ip) || literal_count > (size_t)(out_end - op)) {
+            return false;
+        }
+        memcpy(op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+        if (ip == in_end) {
+            break;
+        }
+
+        if (in_end - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !lz_get_length(&ip, in_end, &length)) {
+            return false;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || length > (size_t)(out_end - op)) {
+            return false;
+        }
+        const uint8_t *match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // overlapping match repeats the last offset bytes
+            for (size_t k=0; k<length; k++) {
+                *op++ = match[k];
+            }
+        }
+    }
+    return op == out_end;
+}
+
+/*
+ * Split a column into value_size byte planes, optionally storing the
+ * zigzag mapped difference from the previous value instead of the value.
+ * value_size is a constant at every call so the loop specializes.
+ */
+static inline void shuffle_column(const uint8_t *in, size_t count, const size_t value_size, bool delta, uint8_t *planes) {
+    const int bits = (int)value_size * 8;
+    const uint64_t mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    uint64_t previous = 0;
+    for (size_t i=0; i<count; i++) {
+        uint64_t value = 0;
+        memcpy(&value, in + i*value_size, value_size);
+        uint64_t coded = value;
+        if (delta) {
+            uint64_t difference = (value - previous) & mask;
+            uint64_t negative = (difference >> (bits - 1)) & 1;
+            coded = ((difference << 1) ^ (0 - negative)) & mask;
+            previous = value;
+        }
+        for (size_t k=0; k<value_size; k++) {
+            planes[k*count + i] = (uint8_t)(coded >> (8*k));
+        }
+    }
+}
+
+static void shuffle(const uint8_t *in, size_t count, size_t value_size, bool delta, uint8_t *planes) {
+    if (value_size == 8) {
+        shuffle_column(in, count, 8, delta, planes);
+    } else if (value_size == 4) {
+        shuffle_column(in, count, 4, delta, planes);
+    } else {
+        shuffle_column(in, count, value_size, delta, planes);
+    }
+}
+
+/*
+ * Interleave the planes back into values, 16 values per step with the
+ * SSE2 unpack ladder
+ */
+static void transpose8(const uint8_t *const *planes, size_t count, uint8_t *out) {
+    const uint8_t *p0 = planes[0], *p1 = planes[1], *p2 = planes[2], *p3 = planes[3];
+    const uint8_t *p4 = planes[4], *p5 = planes[5], *p6 = planes[6], *p7 = planes[7];
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(p0 + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(p2 + i));
+        __m128i b3 = _mm_loadu_si128((const __m128i *)(p3 + i));
+        __m128i b4 = _mm_loadu_si128((const __m128i *)(p4 + i));
+        __m128i b5 = _mm_loadu_si128((const __m128i *)(p5 + i));
+        __m128i b6 = _mm_loadu_si128((const __m128i *)(p6 + i));
+        __m128i b7 = _mm_loadu_si128((const __m128i *)(p7 + i));
+        __m128i w01[2] = { _mm_unpacklo_epi8(b0, b1), _mm_unpackhi_epi8(b0, b1) };
+        __m128i w23[2] = { _mm_unpacklo_epi8(b2, b3), _mm_unpackhi_epi8(b2, b3) };
+        __m128i w45[2] = { _mm_unpacklo_epi8(b4, b5), _mm_unpackhi_epi8(b4, b5) };
+        __m128i w67[2] = { _mm_unpacklo_epi8(b6, b7), _mm_unpackhi_epi8(b6, b7) };
+        for (int h=0; h<2; h++) {
+            __m128i low_first = _mm_unpacklo_epi16(w01[h], w23[h]);
+            __m128i low_second = _mm_unpackhi_epi16(w01[h], w23[h]);
+            __m128i high_first = _mm_unpacklo_epi16(w45[h], w67[h]);
+            __m128i high_second = _mm_unpackhi_epi16(w45[h], w67[h]);
+            __m128i *dst = (__m128i *)(out + (i + 8*h) * 8);
+            _mm_storeu_si128(dst + 0, _mm_unpacklo_epi32(low_first, high_first));
+            _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(low_first, high_first));
+            _mm_storeu_si128(dst + 2, _mm_unpacklo_epi32(low_second, high_second));
+            _mm_storeu_si128(dst + 3, _mm_unpackhi_epi32(low_second, high_second));
+        }
+    }
+    for (; i<count; i++) {
+        for (int k=0; k<8; k++) {
+            out[i*8 + k] = planes[k][i];
+        }
+    }
+}
+
+static void transpose4(const uint8_t *const *planes, size_t count, uint8_t *out) {
+    const uint8_t *p0 = planes[0], *p1 = planes[1], *p2 = planes[2], *p3 = planes[3];
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(p0 + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(p2 + i));
+        __m128i b3 = _mm_loadu_si128((const __m128i *)(p3 + i));
+        __m128i w01_low = _mm_unpacklo_epi8(b0, b1);
+        __m128i w01_high = _mm_unpackhi_epi8(b0, b1);
+        __m128i w23_low = _mm_unpacklo_epi8(b2, b3);
+        __m128i w23_high = _mm_unpackhi_epi8(b2, b3);
+        __m128i *dst = (__m128i *)(out + i * 4);
+        _mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(w01_low, w23_low));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(w01_low, w23_low));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(w01_high, w23_high));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(w01_high, w23_high));
+    }
+    for (; i<count; i++) {
+        for (int k=0; k<4; k++) {
+            out[i*4 + k] = planes[k][i];
+        }
+    }
+}
+
+/*
+ * Undo the zigzag delta in place, a running sum over the values
+ */
+static void undelta8(uint8_t *data, size_t count) {
+    uint64_t previous = 0;
+    for (size_t i=0; i<count; i++) {
+        uint64_t coded;
+        memcpy(&coded, data + i*8, sizeof(coded));
+        previous += (coded >> 1) ^ (0 - (coded & 1));
+        memcpy(data + i*8, &previous, sizeof(previous));
+    }
+}
+
+static void undelta4(uint8_t *data, size_t count) {
+    uint32_t previous = 0;
+    for (size_t i=0; i<count; i++) {
+        uint32_t coded;
+        memcpy(&coded, data + i*4, sizeof(coded));
+        previous += (coded >> 1) ^ (0 - (coded & 1));
+        memcpy(data + i*4, &previous, sizeof(previous));
+    }
+}
+
+static void unshuffle(const uint8_t *const *planes, size_t count, size_t value_size, bool delta, uint8_t *out) {
+    if (value_size == 8) {
+        transpose8(planes, count, out);
+        if (delta) {
+            undelta8(out, count);
+        }
+        return;
+    }
+    if (value_size == 4) {
+        transpose4(planes, count, out);
+        if (delta) {
+            undelta4(out, count);
+        }
+        return;
+    }
+    const uint64_t mask = (1ULL << (value_size * 8)) - 1;
+    uint64_t previous = 0;
+    for (size_t i=0; i<count; i++) {
+        uint64_t value = 0;
+        for (size_t k=0; k<value_size; k++) {
+            value |= (uint64_t)planes[k][i] << (8*k);
+        }
+        if (delta) {
+            value = (previous + ((value >> 1) ^ (0 - (value & 1)))) & mask;
+            previous = value;
+        }
+        memcpy(out + i*value_size, &value, value_size);
+    }
+}
+
+/*
+ * Every plane is stored LZ compressed when that is smaller, raw otherwise
+ */
+static size_t encode_planes(const uint8_t *planes, size_t count, size_t value_size, uint8_t *out) {
+    uint8_t *op = out;
+    for (size_t k=0; k<value_size; k++) {
+        const uint8_t *plane = planes + k*count;
+        uint8_t *body = op + PLANE_HEADER_SIZE;
+        uint32_t size = (uint32_t)lz_compress(plane, count, body);
+        uint8_t mode = PLANE_LZ;
+        if (size >= count) {
+            mode = PLANE_RAW;
+            size = (uint32_t)count;
+            memcpy(body, plane, count);
+        }
+        op[0] = mode;
+        memcpy(op + 1, &size, sizeof(size));
+        op = body + size;
+    }
+    return op - out;
+}
+
+size_t pair_codec_bound(size_t column_count, size_t value_count, size_t value_size) {
+    return column_count * (1 + value_size * (PLANE_HEADER_SIZE + lz_bound(value_count)));
+}
+
+size_t pair_codec_compress(const void *columns, size_t column_count, size_t value_count, size_t value_size,
+                           uint8_t *out) {
+    size_t column_bytes = value_count * value_size;
+    uint8_t *planes = malloc(column_bytes ? column_bytes : 1);
+    uint8_t *delta_out = malloc(pair_codec_bound(1, value_count, value_size));
+    if (!planes || !delta_out) {
+        free(planes);
+        free(delta_out);
+        return 0;
+    }
+
+    uint8_t *op = out;
+    for (size_t c=0; c<column_count; c++) {
+        const uint8_t *column = (const uint8_t *)columns + c*column_bytes;
+
+        shuffle(column, value_count, value_size, false, planes);
+        size_t plain_size = encode_planes(planes, value_count, value_size, op + 1);
+        shuffle(column, value_count, value_size, true, planes);
+        size_t delta_size = encode_planes(planes, value_count, value_size, delta_out);
+
+        if (delta_size < plain_size) {
+            op[0] = CODEC_DELTA;
+            memcpy(op + 1, delta_out, delta_size);
+            op += 1 + delta_size;
+        } else {
+            op[0] = 0;
+            op += 1 + plain_size;
+        }
+    }
+
+    free(planes);
+    free(delta_out);
+    return op - out;
+}
+
+bool pair_codec_decompress(const uint8_t *in, size_t in_size, void *columns,
+                           size_t column_count, size_t value_count, size_t value_size, void *scratch) {
+    const uint8_t *ip = in;
+    const uint8_t *in_end = in + in_size;
+    size_t column_bytes = value_count * value_size;
+    const uint8_t *planes[8];
+
+    if (value_size > sizeof(planes)/sizeof(planes[0])) {
+        return false;
+    }
+    for (size_t c=0; c<column_count; c++) {
+        if (ip >= in_end) {
+            return false;
+        }
+        uint8_t flags = *ip++;
+        if (flags & ~CODEC_DELTA) {
+            return false;
+        }
+        for (size_t k=0; k<value_size; k++) {
+            if (in_end - ip < PLANE_HEADER_SIZE) {
+                return false;
+            }
+            uint8_t mode = ip[0];
+            uint32_t size;
+            memcpy(&size, ip + 1, sizeof(size));
+            ip += PLANE_HEADER_SIZE;
+            if (size > (size_t)(in_end - ip)) {
+                return false;
+            }
+            // raw planes are read in place, LZ planes are expanded into scratch
+            if (mode == PLANE_RAW) {
+                if (size != value_count) {
+                    return false;
+                }
+                planes[k] = ip;
+            } else {
+                uint8_t *plane = (uint8_t *)scratch + k*value_count;
+                if (mode != PLANE_LZ || !lz_decompress(ip, size, plane, value_count)) {
+                    return false;
+                }
+                planes[k] = plane;
+            }
+            ip += size;
+        }
+        unshuffle(planes, value_count, value_size, flags & CODEC_DELTA, (uint8_t *)columns + c*column_bytes);
+    }
+    return ip == in_end;
+}
@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Column block codec for pair files
+ *
+ * A block is column_count columns of value_count values of value_size bytes,
+ * one column after the other. Every column is optionally delta coded (the
+ * difference of the integer bit pattern from the previous value, zigzag
+ * mapped), then byte shuffled so byte k of every value lands in plane k.
+ * Each plane is compressed with a small LZ77 (LZ4 style sequences, 64KB
+ * window) or stored raw when that does not help.
+ *
+ * The high planes carry the sign and exponent (doubles) or the top bits of
+ * the fixed point values (Q32), those repeat a lot and compress. The low
+ * planes of random coordinates do not and are stored raw. Delta coding is
+ * picked per column when it gives a smaller result, which is the case once
+ * the pairs are sorted by position.
+ *
+ * Blocks are independent so they can be compressed and decompressed on
+ * separate threads.
+ */
+
+/*
+ * Worst case compressed size of a block
+ */
+size_t pair_codec_bound(size_t column_count, size_t value_count, size_t value_size);
+
+/*
+ * Returns the compressed size written to out, out must have room for
+ * pair_codec_bound bytes. Returns 0 when the work buffers can not be
+ * allocated.
+ */
+size_t pair_codec_compress(const void *columns, size_t column_count, size_t value_count, size_t value_size,
+                           uint8_t *out);
+
+/*
+ * Returns false when the compressed data is corrupt or does not decode to
+ * exactly column_count * value_count * value_size bytes. scratch holds one
+ * column, value_count * value_size bytes. value_size is at most 8.
+ */
+bool pair_codec_decompress(const uint8_t *in, size_t in_size, void *columns,
+                           size_t column_count, size_t value_count, size_t value_size, void *scratch);
@@ -0,0 +1,497 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <immintrin.h>
+
+#include "pair_file.h"
+#include "pair_codec.h"
+
+#define MY_ERROR(...) {                    \
+        fprintf(stderr, "[%s:%d]", __FUNCTION__, __LINE__);      \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+#define ROW_BYTES               (PAIR_FILE_COLUMNS * sizeof(double))
+#define Q32_COLUMNS             4
+
+static uint64_t align_up(uint64_t value) {
+    return (value + PAIR_FILE_ALIGNMENT - 1) & ~(uint64_t)(PAIR_FILE_ALIGNMENT - 1);
+}
+
+void pair_file_header_init(struct pair_file_header *header, uint64_t count, uint64_t seed,
+                           enum pair_file_distribution_e distribution, enum pair_file_layout_e layout) {
+    memset(header, 0, sizeof(struct pair_file_header));
+    memcpy(header->magic, PAIR_FILE_MAGIC, sizeof(PAIR_FILE_MAGIC));
+    header->version = PAIR_FILE_VERSION;
+    header->header_size = PAIR_FILE_HEADER_SIZE;
+    header->count = count;
+    header->seed = seed;
+    header->distribution = distribution;
+    header->layout = layout;
+
+    uint64_t offset = PAIR_FILE_HEADER_SIZE;
+    if (layout == PAIR_LAYOUT_Q32) {
+        header->column_stride = sizeof(int32_t);
+        header->coordinate_step = 1.0 / PAIR_FILE_Q32_STEPS;
+        for (int c=0; c<Q32_COLUMNS; c++) {
+            header->column_offset[c] = offset;
+            offset = align_up(offset + count * sizeof(int32_t));
+        }
+    } else if (layout == PAIR_LAYOUT_SOA) {
+        header->column_stride = sizeof(double);
+        for (int c=0; c<PAIR_FILE_COLUMNS; c++) {
+            header->column_offset[c] = offset;
+            offset = align_up(offset + count * sizeof(double));
+        }
+    } else {
+        header->column_stride = ROW_BYTES;
+        for (int c=0; c<PAIR_FILE_COLUMNS; c++) {
+            header->column_offset[c] = offset + c * sizeof(double);
+        }
+        offset = align_up(offset + count * ROW_BYTES);
+    }
+    header->footer_offset = offset;
+}
+
+void pair_file_header_use_blocks(struct pair_file_header *header, uint32_t block_rows) {
+    header->compression = PAIR_COMPRESSION_BLOCKS;
+    header->block_rows = block_rows;
+    header->block_count = (header->count + block_rows - 1) / block_rows;
+    header->block_table_offset = PAIR_FILE_HEADER_SIZE;
+    header->block_data_offset = align_up(header->block_table_offset + header->block_count * sizeof(struct pair_file_block));
+    memset(header->column_offset, 0, sizeof(header->column_offset));
+    header->footer_offset = 0;
+}
+
+/*
+ * Columns held by a compressed block of the layout and their value size
+ */
+static void block_columns(uint32_t layout, size_t *column_count, size_t *value_size) {
+    if (layout == PAIR_LAYOUT_Q32) {
+        *column_count = Q32_COLUMNS;
+        *value_size = sizeof(int32_t);
+    } else {
+        *column_count = PAIR_FILE_COLUMNS;
+        *value_size = sizeof(double);
+    }
+}
+
+/*
+ * splitmix64 finalizer of the word mixed with its position, the words are
+ * independent so the loop vectorizes and ranges can be summed separately
+ */
+uint64_t pair_file_checksum(const void *data, size_t size, uint64_t offset) {
+    const uint8_t *bytes = data;
+    uint64_t position = offset / sizeof(uint64_t);
+    uint64_t sum = 0;
+    for (size_t i=0; i<size/sizeof(uint64_t); i++) {
+        uint64_t word;
+        memcpy(&word, bytes + i*sizeof(uint64_t), sizeof(word));
+        uint64_t v = word ^ ((position + i) * 0x9e3779b97f4a7c15);
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9;
+        v = (v ^ (v >> 27)) * 0x94d049bb133111eb;
+        sum += v ^ (v >> 31);
+    }
+    size_t tail = size % sizeof(uint64_t);
+    if (tail) {
+        uint64_t word = 0;
+        memcpy(&word, bytes + size - tail, tail);
+        uint64_t v = word ^ ((position + size/sizeof(uint64_t)) * 0x9e3779b97f4a7c15);
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9;
+        v = (v ^ (v >> 27)) * 0x94d049bb133111eb;
+        sum += v ^ (v >> 31);
+    }
+    return sum;
+}
+
+int32_t pair_file_quantize(double degrees) {
+    return (int32_t)lrint(degrees * PAIR_FILE_Q32_STEPS);
+}
+
+__attribute__((target("avx2")))
+static void dequantize_avx2(const int32_t *in, size_t n, double step, double *out) {
+    __m256d scale = _mm256_set1_pd(step);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i q = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(q));
+        __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(q, 1));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(lo, scale));
+        _mm256_storeu_pd(out + i + 4, _mm256_mul_pd(hi, scale));
+    }
+    for (; i<n; i++) {
+        out[i] = in[i] * step;
+    }
+}
+
+void pair_file_dequantize(const int32_t *in, size_t n, double step, double *out) {
+    // no cached flag, the bindata_reader verify threads call this concurrently
+    if (__builtin_cpu_supports("avx2")) {
+        dequantize_avx2(in, n, step, out);
+        return;
+    }
+    for (size_t i=0; i<n; i++) {
+        out[i] = in[i] * step;
+    }
+}
+
+static void map_whole_file(struct pair_file *file, const char *filename) {
+#ifdef _WIN32
+    HANDLE file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                     FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        MY_ERROR("Failed to open pair file [%s] [%lu]\n", filename, GetLastError());
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_handle, &size)) {
+        MY_ERROR("Failed to get pair file size [%lu]\n", GetLastError());
+    }
+    file->mapping_size = (size_t)size.QuadPart;
+    file->mapping = NULL;
+    if (file->mapping_size > 0) {
+        HANDLE map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!map_handle) {
+            MY_ERROR("Failed to create pair file mapping [%lu]\n", GetLastError());
+        }
+        file->mapping = MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!file->mapping) {
+            MY_ERROR("Failed to map view of pair file [%lu]\n", GetLastError());
+        }
+        // the view keeps the mapping alive
+        CloseHandle(map_handle);
+    }
+    CloseHandle(file_handle);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        MY_ERROR("Failed to open pair file [%s] [%d][%s]\n", filename, errno, strerror(errno));
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0) {
+        MY_ERROR("Failed to stat pair file [%d][%s]\n", errno, strerror(errno));
+    }
+    file->mapping_size = statbuf.st_size;
+    file->mapping = NULL;
+    if (file->mapping_size > 0) {
+        file->mapping = mmap(NULL, file->mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->mapping == MAP_FAILED) {
+            MY_ERROR("mmap failed for size[%zu] [%d][%s]\n", file->mapping_size, errno, strerror(errno));
+        }
+    }
+    // the mapping keeps its own reference to the file
+    close(fd);
+#endif
+}
+
+/*
+ * The block table and every block must lie between the header and the
+ * footer, with the row counts the header promises
+ */
+static void validate_blocks(const struct pair_file *file) {
+    const struct pair_file_header *header = &file->header;
+    if (header->layout == PAIR_LAYOUT_AOS) {
+        MY_ERROR("Compressed pair files hold SoA or Q32 columns, not AoS rows\n");
+    }
+    if (header->block_rows == 0) {
+        MY_ERROR("Compressed pair file with 0 rows per block\n");
+    }
+    struct pair_file_header expected;
+    pair_file_header_init(&expected, header->count, header->seed, header->distribution, header->layout);
+    pair_file_header_use_blocks(&expected, header->block_rows);
+    if (memcmp(expected.column_offset, header->column_offset, sizeof(expected.column_offset)) != 0 ||
+        expected.column_stride != header->column_stride || expected.coordinate_step != header->coordinate_step ||
+        expected.block_count != header->block_count || expected.block_table_offset != header->block_table_offset ||
+        expected.block_data_offset != header->block_data_offset) {
+        MY_ERROR("Compressed pair file layout does not match its count [%" PRIu64 "]\n", header->count);
+    }
+    if (header->footer_offset < header->block_data_offset || header->footer_offset % PAIR_FILE_ALIGNMENT != 0 ||
+        header->footer_offset + sizeof(struct pair_file_footer) > file->mapping_size) {
+        MY_ERROR("Compressed pair file footer offset [%" PRIu64 "] outside the file\n", header->footer_offset);
+    }
+
+    const struct pair_file_block *blocks = (const struct pair_file_block *)((const uint8_t *)file->mapping + header->block_table_offset);
+    for (uint64_t b=0; b<header->block_count; b++) {
+        uint64_t first_row = b * header->block_rows;
+        uint64_t rows = header->count - first_row < header->block_rows ? header->count - first_row : header->block_rows;
+        if (blocks[b].rows != rows || blocks[b].offset % sizeof(uint64_t) != 0 ||
+            blocks[b].offset < header->block_data_offset || blocks[b].offset > header->footer_offset ||
+            blocks[b].size > header->footer_offset - blocks[b].offset) {
+            MY_ERROR("Compressed pair file block [%" PRIu64 "] does not fit the file\n", b);
+        }
+    }
+}
+
+void pair_file_open(struct pair_file *file, const char *filename) {
+    memset(file, 0, sizeof(struct pair_file));
+    map_whole_file(file, filename);
+
+    const uint8_t *base = file->mapping;
+    struct pair_file_header *header = &file->header;
+
+    if (file->mapping_size >= PAIR_FILE_HEADER_SIZE && memcmp(base, PAIR_FILE_MAGIC, sizeof(PAIR_FILE_MAGIC)) == 0) {
+        memcpy(header, base, sizeof(struct pair_file_header));
+        if (header->version != PAIR_FILE_VERSION || header->header_size != PAIR_FILE_HEADER_SIZE) {
+            MY_ERROR("Unsupported pair file version [%u] header size [%u]\n", header->version, header->header_size);
+        }
+        if (header->layout != PAIR_LAYOUT_AOS && header->layout != PAIR_LAYOUT_SOA && header->layout != PAIR_LAYOUT_Q32) {
+            MY_ERROR("Unknown pair file layout [%u]\n", header->layout);
+        }
+        if (header->compression == PAIR_COMPRESSION_BLOCKS) {
+            validate_blocks(file);
+        } else if (header->compression != PAIR_COMPRESSION_NONE) {
+            MY_ERROR("Unknown pair file compression [%u]\n", header->compression);
+        } else {
+            // recompute the layout from the count so corrupt offsets can not point outside the file
+            struct pair_file_header expected;
+            pair_file_header_init(&expected, header->count, header->seed, header->distribution, header->layout);
+            if (memcmp(expected.column_offset, header->column_offset, sizeof(expected.column_offset)) != 0 ||
+                expected.column_stride != header->column_stride || expected.footer_offset != header->footer_offset ||
+                expected.coordinate_step != header->coordinate_step) {
+                MY_ERROR("Pair file layout does not match its count [%" PRIu64 "]\n", header->count);
+            }
+        }
+        if (header->footer_offset + sizeof(struct pair_file_footer) > file->mapping_size) {
+            MY_ERROR("Pair file truncated, [%zu] bytes but footer at [%" PRIu64 "]\n", file->mapping_size, header->footer_offset);
+        }
+        if (memcmp(base + header->footer_offset, PAIR_FILE_FOOTER_MAGIC, sizeof(PAIR_FILE_FOOTER_MAGIC)) != 0) {
+            MY_ERROR("Pair file footer magic not found\n");
+        }
+        file->legacy = false;
+    } else {
+        // version 1, raw rows and nothing else
+        if (file->mapping_size % ROW_BYTES != 0) {
+            MY_ERROR("File size [%zu] is not a pair file v2 nor a multiple of a v1 row\n", file->mapping_size);
+        }
+        memset(header, 0, sizeof(struct pair_file_header));
+        header->version = 1;
+        header->count = file->mapping_size / ROW_BYTES;
+        header->distribution = PAIR_DIST_UNKNOWN;
+        header->layout = PAIR_LAYOUT_AOS;
+        header->expected_sum = NAN;
+        header->column_stride = ROW_BYTES;
+        for (int c=0; c<PAIR_FILE_COLUMNS; c++) {
+            header->column_offset[c] = c * sizeof(double);
+        }
+        header->footer_offset = file->mapping_size;
+        file->legacy = true;
+    }
+
+    file->count = header->count;
+    if (header->compression == PAIR_COMPRESSION_BLOCKS) {
+        file->stride = 1;
+        file->blocks = (const struct pair_file_block *)(base + header->block_table_offset);
+        file->cache = malloc(sizeof(struct pair_file_block_buffer));
+        if (!file->cache) {
+            MY_ERROR("Failed to allocate the pair file block cache\n");
+        }
+        pair_file_block_buffer_init(file, file->cache);
+        return;
+    }
+    if (header->layout == PAIR_LAYOUT_Q32) {
+        file->stride = 1;
+        file->qx0 = (const int32_t *)(base + header->column_offset[0]);
+        file->qy0 = (const int32_t *)(base + header->column_offset[1]);
+        file->qx1 = (const int32_t *)(base + header->column_offset[2]);
+        file->qy1 = (const int32_t *)(base + header->column_offset[3]);
+        return;
+    }
+    file->stride = header->column_stride / sizeof(double);
+    file->x0 = (const double *)(base + header->column_offset[0]);
+    file->y0 = (const double *)(base + header->column_offset[1]);
+    file->x1 = (const double *)(base + header->column_offset[2]);
+    file->y1 = (const double *)(base + header->column_offset[3]);
+    file->haversine = (const double *)(base + header->column_offset[4]);
+}
+
+void pair_file_close(struct pair_file *file) {
+    if (file->cache) {
+        pair_file_block_buffer_free(file->cache);
+        free(file->cache);
+    }
+    if (file->mapping) {
+#ifdef _WIN32
+        UnmapViewOfFile(file->mapping);
+#else
+        munmap(file->mapping, file->mapping_size);
+#endif
+    }
+    memset(file, 0, sizeof(struct pair_file));
+}
+
+size_t pair_file_block_bytes(const struct pair_file *file) {
+    size_t column_count;
+    size_t value_size;
+    block_columns(file->header.layout, &column_count, &value_size);
+    uint64_t rows = file->header.compression == PAIR_COMPRESSION_BLOCKS ? file->header.block_rows : PAIR_FILE_BLOCK_ROWS;
+    return column_count * value_size * rows;
+}
+
+void pair_file_block_buffer_init(const struct pair_file *file, struct pair_file_block_buffer *buffer) {
+    size_t column_count;
+    size_t value_size;
+    block_columns(file->header.layout, &column_count, &value_size);
+    buffer->block = UINT64_MAX;
+    buffer->first_row = 0;
+    buffer->rows = 0;
+    buffer->columns = malloc(pair_file_block_bytes(file));
+    buffer->scratch = malloc(pair_file_block_bytes(file) / column_count);
+    if (!buffer->columns || !buffer->scratch) {
+        MY_ERROR("Failed to allocate a block buffer of [%zu] bytes\n", pair_file_block_bytes(file));
+    }
+}
+
+void pair_file_block_buffer_free(struct pair_file_block_buffer *buffer) {
+    free(buffer->columns);
+    free(buffer->scratch);
+    memset(buffer, 0, sizeof(struct pair_file_block_buffer));
+}
+
+void pair_file_load_block(const struct pair_file *file, struct pair_file_block_buffer *buffer, uint64_t row) {
+    uint64_t b = row / file->header.block_rows;
+    if (b == buffer->block) {
+        return;
+    }
+    size_t column_count;
+    size_t value_size;
+    block_columns(file->header.layout, &column_count, &value_size);
+    const struct pair_file_block *block = &file->blocks[b];
+    if (!pair_codec_decompress((const uint8_t *)file->mapping + block->offset, block->size, buffer->columns,
+                               column_count, block->rows, value_size, buffer->scratch)) {
+        MY_ERROR("Pair file block [%" PRIu64 "] does not decode\n", b);
+    }
+    buffer->block = b;
+    buffer->first_row = b * file->header.block_rows;
+    buffer->rows = block->rows;
+}
+
+void pair_file_read_coordinates(const struct pair_file *file, uint64_t start, size_t n,
+                                double *x0, double *y0, double *x1, double *y1) {
+    if (file->header.compression == PAIR_COMPRESSION_BLOCKS) {
+        struct pair_file_block_buffer *cache = file->cache;
+        while (n > 0) {
+            pair_file_load_block(file, cache, start);
+            size_t at = start - cache->first_row;
+            size_t take = cache->rows - at < n ? cache->rows - at : n;
+            if (file->header.layout == PAIR_LAYOUT_Q32) {
+                const int32_t *q = cache->columns;
+                double step = file->header.coordinate_step;
+                pair_file_dequantize(q + at, take, step, x0);
+                pair_file_dequantize(q + cache->rows + at, take, step, y0);
+                pair_file_dequantize(q + 2*cache->rows + at, take, step, x1);
+                pair_file_dequantize(q + 3*cache->rows + at, take, step, y1);
+            } else {
+                const double *columns = cache->columns;
+                memcpy(x0, columns + at, take * sizeof(double));
+                memcpy(y0, columns + cache->rows + at, take * sizeof(double));
+                memcpy(x1, columns + 2*cache->rows + at, take * sizeof(double));
+                memcpy(y1, columns + 3*cache->rows + at, take * sizeof(double));
+            }
+            start += take;
+            n -= take;
+            x0 += take;
+            y0 += take;
+            x1 += take;
+            y1 += take;
+        }
+        return;
+    }
+    if (file->header.layout == PAIR_LAYOUT_Q32) {
+        double step = file->header.coordinate_step;
+        pair_file_dequantize(file->qx0 + start, n, step, x0);
+        pair_file_dequantize(file->qy0 + start, n, step, y0);
+        pair_file_dequantize(file->qx1 + start, n, step, x1);
+        pair_file_dequantize(file->qy1 + start, n, step, y1);
+    } else if (file->stride == 1) {
+        memcpy(x0, file->x0 + start, n * sizeof(double));
+        memcpy(y0, file->y0 + start, n * sizeof(double));
+        memcpy(x1, file->x1 + start, n * sizeof(double));
+        memcpy(y1, file->y1 + start, n * sizeof(double));
+    } else {
+        for (size_t i=0; i<n; i++) {
+            size_t at = (start + i) * file->stride;
+            x0[i] = file->x0[at];
+            y0[i] = file->y0[at];
+            x1[i] = file->x1[at];
+            y1[i] = file->y1[at];
+        }
+    }
+}
+
+bool pair_file_verify_checksum(const struct pair_file *file) {
+    if (file->legacy) {
+        return true;
+    }
+    const struct pair_file_header *header = &file->header;
+    const uint8_t *base = file->mapping;
+    uint64_t checksum = 0;
+
+    if (header->compression == PAIR_COMPRESSION_BLOCKS) {
+        size_t table_size = header->block_count * sizeof(struct pair_file_block);
+        checksum = pair_file_checksum(base + header->block_table_offset, table_size, header->block_table_offset);
+        for (uint64_t b=0; b<header->block_count; b++) {
+            checksum += pair_file_checksum(base + file->blocks[b].offset, file->blocks[b].size, file->blocks[b].offset);
+        }
+    } else if (header->layout == PAIR_LAYOUT_Q32) {
+        for (int c=0; c<Q32_COLUMNS; c++) {
+            checksum += pair_file_checksum(base + header->column_offset[c], header->count * sizeof(int32_t), header->column_offset[c]);
+        }
+    } else if (header->layout == PAIR_LAYOUT_SOA) {
+        for (int c=0; c<PAIR_FILE_COLUMNS; c++) {
+            checksum += pair_file_checksum(base + header->column_offset[c], header->count * sizeof(double), header->column_offset[c]);
+        }
+    } else {
+        checksum = pair_file_checksum(base + header->column_offset[0], header->count * ROW_BYTES, header->column_offset[0]);
+    }
+
+    struct pair_file_footer footer;
+    memcpy(&footer, base + header->footer_offset, sizeof(footer));
+    return footer.checksum == checksum;
+}
+
+const char *pair_file_layout_name(uint32_t layout) {
+    switch (layout) {
+        case PAIR_LAYOUT_AOS:
+            return "AoS";
+        case PAIR_LAYOUT_SOA:
+            return "SoA";
+        case PAIR_LAYOUT_Q32:
+            return "Q32";
+        default:
+            return "Unknown";
+    }
+}
+
+const char *pair_file_compression_name(uint32_t compression) {
+    switch (compression) {
+        case PAIR_COMPRESSION_NONE:
+            return "None";
+        case PAIR_COMPRESSION_BLOCKS:
+            return "Blocks";
+        default:
+            return "Unknown";
+    }
+}
+
+const char *pair_file_distribution_name(uint32_t distribution) {
+    switch (distribution) {
+        case PAIR_DIST_UNIFORM:
+            return "Uniform";
+        case PAIR_DIST_CLUSTERED:
+            return "Clustered";
+        default:
+            return "Unknown";
+    }
+}
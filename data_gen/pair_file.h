@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Binary pair file, format version 2
+ *
+ * The first version was a raw stream of x0, y0, x1, y1, haversine doubles
+ * per row with nothing to validate it against. Version 2 starts with a
+ * PAIR_FILE_HEADER_SIZE header, then the five columns, then a footer:
+ *
+ *   [header, zero padded to 4KB]
+ *   AoS: [x0 y0 x1 y1 haversine] * count
+ *   SoA: [x0 * count][pad to 4KB][y0 * count][pad]...[haversine * count]
+ *   Q32: [int32 x0 * count][pad to 4KB]...[int32 y1 * count], no haversine
+ *   [pad to 4KB][footer]
+ *
+ * Every column starts on a 4KB boundary so a mapping of the file can be
+ * used in place, for SoA each column is a plain aligned double array.
+ * The footer checksum covers the column data and is the sum of a per word
+ * hash that includes the word position, so it can be computed on any split
+ * of the data in any order and the partial results added.
+ *
+ * The Q32 layout stores the coordinates as fixed point int32 with
+ * PAIR_FILE_Q32_STEPS steps per degree, 16 bytes per pair instead of 40.
+ * The steps are a power of two so dequantizing is exact and the file
+ * describes exactly the pairs that data_gen wrote to the JSON file, the
+ * expected sum is over those dequantized pairs.
+ *
+ * Readers also accept version 1 files, detected by the missing magic.
+ *
+ * A SoA or Q32 file can instead hold its columns in independently
+ * compressed blocks of block_rows rows (pair_codec), every block holding
+ * the layout's columns for its rows one after the other:
+ *
+ *   [header, zero padded to 4KB]
+ *   [block table, block_count pair_file_block entries][pad to 4KB]
+ *   [block 0][pad to 8]...[block n][pad to 4KB][footer]
+ *
+ * The column offsets are 0, the checksum covers the block table and the
+ * compressed blocks. Files written before compression existed read the
+ * new header fields as 0, which is PAIR_COMPRESSION_NONE.
+ */
+
+#define PAIR_FILE_MAGIC         "HVPAIRS"
+#define PAIR_FILE_FOOTER_MAGIC  "HVPEND"
+#define PAIR_FILE_VERSION       2
+#define PAIR_FILE_HEADER_SIZE   4096
+#define PAIR_FILE_ALIGNMENT     4096
+#define PAIR_FILE_COLUMNS       5       // x0, y0, x1, y1, haversine
+#define PAIR_FILE_Q32_STEPS     8388608.0   // 2^23 steps per degree, +-225 degrees still fits an int32
+#define PAIR_FILE_BLOCK_ROWS    65536
+
+enum pair_file_layout_e {
+    PAIR_LAYOUT_AOS,
+    PAIR_LAYOUT_SOA,
+    PAIR_LAYOUT_Q32,
+};
+
+enum pair_file_compression_e {
+    PAIR_COMPRESSION_NONE,
+    PAIR_COMPRESSION_BLOCKS,
+};
+
+enum pair_file_distribution_e {
+    PAIR_DIST_UNIFORM,
+    PAIR_DIST_CLUSTERED,
+    PAIR_DIST_UNKNOWN,      // version 1 files
+};
+
+struct pair_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t count;
+    uint64_t seed;
+    uint32_t distribution;
+    uint32_t layout;
+    double expected_sum;                            // haversine sum of the rows in row order, added as sum_mode
+    uint64_t column_offset[PAIR_FILE_COLUMNS];      // file offset of the first value of each column
+    uint64_t column_stride;                         // bytes from one row to the next in a column
+    uint64_t footer_offset;
+    double coordinate_step;                         // Q32 degrees per integer step, 0 otherwise
+    uint32_t compression;
+    uint32_t block_rows;                            // rows per compressed block, the last one may be short
+    uint64_t block_count;
+    uint64_t block_table_offset;
+    uint64_t block_data_offset;                     // file offset of the first compressed block
+    uint32_t order;                                 // pair_order_e, 0 is generation order
+    uint32_t sum_mode;                              // float_sum_mode_e, 0 is one after the other
+};
+
+struct pair_file_block {
+    uint64_t offset;                                // file offset, multiple of 8
+    uint32_t size;                                  // compressed bytes
+    uint32_t rows;
+};
+
+struct pair_file_footer {
+    char magic[8];
+    uint64_t checksum;
+};
+
+/*
+ * Fill in a version 2 header for count rows, expected_sum is left to 0
+ */
+void pair_file_header_init(struct pair_file_header *header, uint64_t count, uint64_t seed,
+                           enum pair_file_distribution_e distribution, enum pair_file_layout_e layout);
+
+/*
+ * Turn an initialized SoA or Q32 header into a block compressed one, the
+ * footer offset is only known once the blocks are written
+ */
+void pair_file_header_use_blocks(struct pair_file_header *header, uint32_t block_rows);
+
+/*
+ * Checksum of size bytes of column data placed at file offset, offset is a
+ * multiple of 8. A last partial word counts as zero padded, so a range can
+ * only be split at multiples of 8. Checksums of separate ranges are added.
+ */
+uint64_t pair_file_checksum(const void *data, size_t size, uint64_t offset);
+
+int32_t pair_file_quantize(double degrees);
+
+/*
+ * out[i] = in[i] * step for n values, AVX2 when the CPU has it
+ */
+void pair_file_dequantize(const int32_t *in, size_t n, double step, double *out);
+
+/*
+ * One decoded block of a compressed file, column c of the block starts at
+ * value c * rows of columns. Readers decoding in parallel use one each.
+ */
+struct pair_file_block_buffer {
+    uint64_t block;                     // UINT64_MAX when nothing is decoded yet
+    uint64_t first_row;
+    uint64_t rows;
+    void *columns;
+    void *scratch;
+};
+
+/*
+ * Mapped pair file, the column pointers point into the mapping and value i
+ * of a column is column[i*stride]. Q32 files have the q columns instead and
+ * no haversine column. Compressed files have no column pointers, their
+ * blocks are decoded with pair_file_load_block.
+ */
+struct pair_file {
+    struct pair_file_header header;     // synthesized for version 1 files
+    bool legacy;
+    uint64_t count;
+    size_t stride;                      // in doubles, 5 for AoS and 1 for SoA
+    const double *x0;
+    const double *y0;
+    const double *x1;
+    const double *y1;
+    const double *haversine;
+    const int32_t *qx0;
+    const int32_t *qy0;
+    const int32_t *qx1;
+    const int32_t *qy1;
+    const struct pair_file_block *blocks;
+    struct pair_file_block_buffer *cache;   // used by pair_file_read_coordinates on compressed files
+    void *mapping;
+    size_t mapping_size;
+};
+
+void pair_file_open(struct pair_file *file, const char *filename);
+void pair_file_close(struct pair_file *file);
+
+/*
+ * Bytes of column data in one decoded block, also the size of the raw
+ * columns for block_rows rows of an uncompressed file
+ */
+size_t pair_file_block_bytes(const struct pair_file *file);
+
+void pair_file_block_buffer_init(const struct pair_file *file, struct pair_file_block_buffer *buffer);
+void pair_file_block_buffer_free(struct pair_file_block_buffer *buffer);
+
+/*
+ * Decode the block holding row into buffer, nothing to do when it is
+ * already there. A block that does not decode is a fatal error.
+ */
+void pair_file_load_block(const struct pair_file *file, struct pair_file_block_buffer *buffer, uint64_t row);
+
+/*
+ * Copy the coordinates of rows [start, start+n) into four arrays, for any
+ * layout. Compressed files decode through the single block cache of the
+ * file so this is not thread safe for them.
+ */
+void pair_file_read_coordinates(const struct pair_file *file, uint64_t start, size_t n,
+                                double *x0, double *y0, double *x1, double *y1);
+
+/*
+ * Recompute the checksum of the mapped columns, or block table and blocks,
+ * and compare it with the footer, always true for version 1 files
+ */
+bool pair_file_verify_checksum(const struct pair_file *file);
+
+const char *pair_file_layout_name(uint32_t layout);
+const char *pair_file_compression_name(uint32_t compression);
+const char *pair_file_distribution_name(uint32_t distribution);
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <threads.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "pair_file.h"
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+/*
+ * Pair file read benchmark
+ *
+ * Opens a pair file, hands every column value to a consumer and closes it
+ * again, once for an uncompressed SoA or Q32 file and once for a block
+ * compressed file with the same pairs (data_gen -S / -S -z, or -q / -q -z).
+ * The consumer adds up the value bits so every byte is read, for the
+ * compressed file it runs on the decoded block buffer. The rows are split
+ * on PAIR_FILE_BLOCK_ROWS blocks over -j threads like bindata_reader does.
+ *
+ * Speeds are effective, decoded column bytes over time, so the two tests
+ * compare directly. Both files must produce the same value sum.
+ */
+#define MAX_TESTS               2
+
+struct test_context {
+    char *name;
+    char *filename;
+    int thread_count;
+    uint64_t count;
+    uint64_t decoded_bytes;
+    uint64_t file_bytes;
+    uint64_t value_sum;
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+struct read_job {
+    const struct pair_file *pairs;
+    uint64_t first_row;
+    uint64_t last_row;      // exclusive
+    uint64_t value_sum;
+};
+
+static uint64_t sum_values(const void *data, size_t count, size_t value_size) {
+    uint64_t sum = 0;
+    if (value_size == sizeof(uint64_t)) {
+        const uint64_t *values = data;
+        for (size_t i=0; i<count; i++) {
+            sum += values[i];
+        }
+    } else {
+        const uint32_t *values = data;
+        for (size_t i=0; i<count; i++) {
+            sum += values[i];
+        }
+    }
+    return sum;
+}
+
+int read_thread(void *arg) {
+    struct read_job *job = (struct read_job *)arg;
+    const struct pair_file *pairs = job->pairs;
+    bool is_q32 = pairs->header.layout == PAIR_LAYOUT_Q32;
+    size_t column_count = is_q32 ? 4 : PAIR_FILE_COLUMNS;
+    size_t value_size = is_q32 ? sizeof(int32_t) : sizeof(double);
+
+    if (pairs->header.compression == PAIR_COMPRESSION_BLOCKS) {
+        struct pair_file_block_buffer buffer;
+        pair_file_block_buffer_init(pairs, &buffer);
+        for (uint64_t row=job->first_row; row<job->last_row; row+=buffer.rows) {
+            pair_file_load_block(pairs, &buffer, row);
+            job->value_sum += sum_values(buffer.columns, column_count * buffer.rows, value_size);
+        }
+        pair_file_block_buffer_free(&buffer);
+        return 0;
+    }
+
+    const void *columns[PAIR_FILE_COLUMNS] = {
+        pairs->x0, pairs->y0, pairs->x1, pairs->y1, pairs->haversine,
+    };
+    if (is_q32) {
+        columns[0] = pairs->qx0;
+        columns[1] = pairs->qy0;
+        columns[2] = pairs->qx1;
+        columns[3] = pairs->qy1;
+    }
+    for (size_t c=0; c<column_count; c++) {
+        const uint8_t *first = (const uint8_t *)columns[c] + job->first_row * value_size;
+        job->value_sum += sum_values(first, job->last_row - job->first_row, value_size);
+    }
+    return 0;
+}
+
+static uint64_t read_pair_file(const char *filename, int thread_count) {
+    struct pair_file pairs;
+    pair_file_open(&pairs, filename);
+
+    uint64_t block_count = (pairs.count + PAIR_FILE_BLOCK_ROWS - 1) / PAIR_FILE_BLOCK_ROWS;
+    struct read_job jobs[thread_count];
+    thrd_t threads[thread_count];
+    for (int t=0; t<thread_count; t++) {
+        uint64_t first_block = block_count * t / thread_count;
+        uint64_t last_block = block_count * (t+1) / thread_count;
+        jobs[t].pairs = &pairs;
+        jobs[t].first_row = first_block * PAIR_FILE_BLOCK_ROWS;
+        jobs[t].last_row = last_block * PAIR_FILE_BLOCK_ROWS < pairs.count ? last_block * PAIR_FILE_BLOCK_ROWS : pairs.count;
+        jobs[t].value_sum = 0;
+        if (thrd_create(&threads[t], read_thread, &jobs[t]) != thrd_success) {
+            MY_ERROR("Failed to create read thread [%d]\n", t);
+        }
+    }
+    uint64_t value_sum = 0;
+    for (int t=0; t<thread_count; t++) {
+        thrd_join(threads[t], NULL);
+        value_sum += jobs[t].value_sum;
+    }
+
+    pair_file_close(&pairs);
+    return value_sum;
+}
+
+void env_setup(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    struct pair_file pairs;
+
+    pair_file_open(&pairs, ctx->filename);
+    if (pairs.header.layout == PAIR_LAYOUT_AOS) {
+        MY_ERROR("[%s] is an AoS pair file, the benchmark reads SoA or Q32 columns\n", ctx->filename);
+    }
+    if (pairs.header.compression == PAIR_COMPRESSION_BLOCKS && pairs.header.block_rows != PAIR_FILE_BLOCK_ROWS) {
+        MY_ERROR("[%s] has blocks of [%u] rows, expected [%d]\n", ctx->filename, pairs.header.block_rows, PAIR_FILE_BLOCK_ROWS);
+    }
+    if (!pair_file_verify_checksum(&pairs)) {
+        MY_ERROR("[%s] checksum does not match its footer\n", ctx->filename);
+    }
+    bool is_q32 = pairs.header.layout == PAIR_LAYOUT_Q32;
+    ctx->count = pairs.count;
+    ctx->decoded_bytes = pairs.count * (is_q32 ? 4 * sizeof(int32_t) : PAIR_FILE_COLUMNS * sizeof(double));
+    ctx->file_bytes = pairs.mapping_size;
+
+    printf("[%s] name[%s] file[%s] layout[%s] compression[%s] rows[%" PRIu64 "] file bytes[%" PRIu64 "] column bytes[%" PRIu64 "]\n",
+           __FUNCTION__, ctx->name, ctx->filename, pair_file_layout_name(pairs.header.layout),
+           pair_file_compression_name(pairs.header.compression), ctx->count, ctx->file_bytes, ctx->decoded_bytes);
+    pair_file_close(&pairs);
+}
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+
+    uint64_t start = GET_CPU_TICKS();
+    ctx->value_sum = read_pair_file(ctx->filename, ctx->thread_count);
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(ctx->decoded_bytes, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(ctx->decoded_bytes, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+
+    printf("[%s] name[%s] rows[%" PRIu64 "] threads[%d] value sum[%016" PRIx64 "]\n", __FUNCTION__, ctx->name,
+           ctx->count, ctx->thread_count, ctx->value_sum);
+    printf("\n");
+
+    printf("[%s] Slowest Effective Speed", __FUNCTION__);
+    print_data_speed(ctx->decoded_bytes, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Effective Speed", __FUNCTION__);
+    print_data_speed(ctx->decoded_bytes, ctx->min_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest File Speed", __FUNCTION__);
+    print_data_speed(ctx->file_bytes, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+void usage(void) {
+    fprintf(stderr, "Pair File Read Benchmark Usage:\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+    fprintf(stderr, "-r <bin_file>  Uncompressed SoA or Q32 pair file (data_gen -S or -q).\n");
+    fprintf(stderr, "-z <bin_file>  Block compressed pair file with the same pairs (data_gen -S -z or -q -z).\n");
+    fprintf(stderr, "-j <threads>   Read and decompress with <threads> threads (default 1).\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    int thread_count = 1;
+    char *raw_file = NULL;
+    char *compressed_file = NULL;
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-r")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing raw pair file parameter\n");
+                usage();
+                exit(1);
+            }
+            raw_file = strdup(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-z")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing compressed pair file parameter\n");
+                usage();
+                exit(1);
+            }
+            compressed_file = strdup(argv[index+1]);
+            ++index;
+        } else if (strcmp(argv[index], "-j")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing thread count\n");
+                usage();
+                exit(1);
+            }
+            thread_count = atoi(argv[index+1]);
+            ++index;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "ht:r:z:j:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            case 'r':
+                raw_file = strdup(optarg);
+                break;
+
+            case 'z':
+                compressed_file = strdup(optarg);
+                break;
+
+            case 'j':
+                thread_count = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    if (!raw_file && !compressed_file) {
+        usage();
+        exit(1);
+    }
+    if (thread_count < 1) {
+        fprintf(stderr, "ERROR invalid thread count [%d]\n", thread_count);
+        usage();
+        exit(1);
+    }
+
+    printf("========================\n");
+    printf("Pair File Read Benchmark\n");
+    printf("========================\n");
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Using threads   [%d]\n", thread_count);
+
+    struct test_context contexts[MAX_TESTS] = {};
+    int test_count = 0;
+    if (raw_file) {
+        contexts[test_count].name = "Read_Raw";
+        contexts[test_count++].filename = raw_file;
+    }
+    if (compressed_file) {
+        contexts[test_count].name = "Read_Compressed";
+        contexts[test_count++].filename = compressed_file;
+    }
+
+    struct rep_tester_config tests[MAX_TESTS] = {};
+    for (int i=0; i<test_count; i++) {
+        contexts[i].thread_count = thread_count;
+
+        tests[i].test_name = contexts[i].name;
+        tests[i].env_setup = env_setup;
+        tests[i].test_main = test_main;
+        tests[i].print_stats = print_stats;
+        tests[i].test_runtime_seconds = runtime;
+        tests[i].silent = true;
+        tests[i].context = &contexts[i];
+    }
+
+    printf("\n\n");
+    rep_tester_run(tests, test_count);
+
+    if (test_count == MAX_TESTS) {
+        if (contexts[0].value_sum != contexts[1].value_sum || contexts[0].count != contexts[1].count) {
+            MY_ERROR("Raw and compressed files do not hold the same pairs\n");
+        }
+        printf("Raw and compressed files hold the same pairs, compressed file is %.4f of the raw file\n",
+               (double)contexts[1].file_bytes / (double)contexts[0].file_bytes);
+    }
+
+    printf("\n\n");
+
+    free(raw_file);
+    free(compressed_file);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pair_order.h"
+
+/*
+ * Clustered points reach a quarter radius past the +-180, +-90 degrees of
+ * the uniform distribution
+ */
+#define GRID_X_RADIUS           225.0
+#define GRID_Y_RADIUS           112.5
+#define GRID_CELLS              (1U << PAIR_ORDER_BITS)
+#define RADIX_BITS              8
+#define RADIX_PASSES            (32 / RADIX_BITS)
+
+static uint32_t grid_cell(double value, double radius) {
+    double cell = (value + radius) * (GRID_CELLS / (2.0 * radius));
+    if (!(cell > 0)) {
+        return 0;
+    }
+    if (cell >= GRID_CELLS - 1) {
+        return GRID_CELLS - 1;
+    }
+    return (uint32_t)cell;
+}
+
+/*
+ * Spread the low 16 bits of value to the even bits
+ */
+static uint32_t spread_bits(uint32_t value) {
+    value &= 0xffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+uint32_t pair_order_morton(uint32_t x, uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+uint32_t pair_order_hilbert(uint32_t x, uint32_t y) {
+    uint32_t d = 0;
+    for (uint32_t s=GRID_CELLS/2; s>0; s/=2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        // rotate the quadrant so the sub curve starts where the last one ended
+        if (ry == 0) {
+            if (rx == 1) {
+                x = GRID_CELLS - 1 - x;
+                y = GRID_CELLS - 1 - y;
+            }
+            uint32_t t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+uint32_t pair_order_key(enum pair_order_e order, double x, double y) {
+    uint32_t cell_x = grid_cell(x, GRID_X_RADIUS);
+    uint32_t cell_y = grid_cell(y, GRID_Y_RADIUS);
+    switch (order) {
+        case PAIR_ORDER_MORTON:
+            return pair_order_morton(cell_x, cell_y);
+        case PAIR_ORDER_HILBERT:
+            return pair_order_hilbert(cell_x, cell_y);
+        default:
+            return 0;
+    }
+}
+
+/*
+ * LSD radix sort of key << 32 | index on the key bytes, every pass is
+ * stable so equal keys stay in generation order
+ */
+bool pair_order_sort(enum pair_order_e order, const double *x, const double *y, uint64_t count, uint32_t *permutation) {
+    uint64_t *entries = malloc((count ? count : 1) * sizeof(uint64_t));
+    uint64_t *scratch = malloc((count ? count : 1) * sizeof(uint64_t));
+    uint64_t histogram[RADIX_PASSES][1 << RADIX_BITS] = {};
+    if (!entries || !scratch) {
+        free(entries);
+        free(scratch);
+        return false;
+    }
+
+    for (uint64_t i=0; i<count; i++) {
+        uint64_t key = pair_order_key(order, x[i], y[i]);
+        entries[i] = (key << 32) | i;
+        for (int p=0; p<RADIX_PASSES; p++) {
+            histogram[p][(key >> (p*RADIX_BITS)) & ((1 << RADIX_BITS) - 1)]++;
+        }
+    }
+
+    for (int p=0; p<RADIX_PASSES; p++) {
+        uint64_t offset = 0;
+        for (int b=0; b<(1 << RADIX_BITS); b++) {
+            uint64_t bucket = histogram[p][b];
+            histogram[p][b] = offset;
+            offset += bucket;
+        }
+        int shift = 32 + p*RADIX_BITS;
+        for (uint64_t i=0; i<count; i++) {
+            uint64_t entry = entries[i];
+            scratch[histogram[p][(entry >> shift) & ((1 << RADIX_BITS) - 1)]++] = entry;
+        }
+        uint64_t *swap = entries;
+        entries = scratch;
+        scratch = swap;
+    }
+
+    for (uint64_t i=0; i<count; i++) {
+        permutation[i] = (uint32_t)entries[i];
+    }
+    free(entries);
+    free(scratch);
+    return true;
+}
+
+bool pair_order_parse(const char *name, enum pair_order_e *order) {
+    for (uint32_t o=PAIR_ORDER_GENERATED; o<=PAIR_ORDER_HILBERT; o++) {
+        if (strcmp(name, pair_order_name(o)) == 0) {
+            *order = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *pair_order_name(uint32_t order) {
+    switch (order) {
+        case PAIR_ORDER_GENERATED:
+            return "generated";
+        case PAIR_ORDER_MORTON:
+            return "morton";
+        case PAIR_ORDER_HILBERT:
+            return "hilbert";
+        default:
+            return "unknown";
+    }
+}
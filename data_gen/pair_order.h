@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Space filling curve order of pairs
+ *
+ * data_gen emits pairs in generation order, which scatters consecutive
+ * rows over the whole globe. Sorting the pairs by the curve index of their
+ * first point (x0, y0) puts rows that are close on the map close in the
+ * file. Both curves index a 2^16 x 2^16 grid over the coordinate range,
+ * Morton interleaves the bits of the cell x and y, Hilbert follows a
+ * continuous path so consecutive cells are always neighbours.
+ */
+
+enum pair_order_e {
+    PAIR_ORDER_GENERATED,
+    PAIR_ORDER_MORTON,
+    PAIR_ORDER_HILBERT,
+};
+
+#define PAIR_ORDER_BITS         16
+
+uint32_t pair_order_morton(uint32_t x, uint32_t y);
+uint32_t pair_order_hilbert(uint32_t x, uint32_t y);
+
+/*
+ * Curve index of the point, coordinates outside the grid are clamped to it
+ */
+uint32_t pair_order_key(enum pair_order_e order, double x, double y);
+
+/*
+ * Stable sort of count points by curve index, permutation[i] is the index
+ * of the point that goes to position i. count must fit a uint32_t.
+ * Returns false when the sort buffers can not be allocated.
+ */
+bool pair_order_sort(enum pair_order_e order, const double *x, const double *y, uint64_t count, uint32_t *permutation);
+
+/*
+ * Parse "generated", "morton" or "hilbert"
+ */
+bool pair_order_parse(const char *name, enum pair_order_e *order);
+const char *pair_order_name(uint32_t order);
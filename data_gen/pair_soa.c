@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "haversine.h"
+#include "pair_soa.h"
+#include "haversine_batch.h"
+#include "float_sum.h"
+
+#define MY_ERROR(...) {                    \
+        fprintf(stderr, "[%s:%d]", __FUNCTION__, __LINE__);      \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+#define RADIANS_PER_DEGREE      0.01745329251994329577
+#define SUM_BATCH_PAIRS         1024
+
+static double *alloc_column(size_t capacity) {
+    // aligned_alloc wants a multiple of the alignment
+    size_t size = (capacity * sizeof(double) + PAIR_SOA_ALIGNMENT - 1) & ~(size_t)(PAIR_SOA_ALIGNMENT - 1);
+    if (size == 0) {
+        size = PAIR_SOA_ALIGNMENT;
+    }
+#ifdef _WIN32
+    double *column = _aligned_malloc(size, PAIR_SOA_ALIGNMENT);
+#else
+    double *column = aligned_alloc(PAIR_SOA_ALIGNMENT, size);
+#endif
+    if (!column) {
+        MY_ERROR("Failed to allocate [%zu]bytes for pair column\n", size);
+    }
+    return column;
+}
+
+static void free_column(double *column) {
+#ifdef _WIN32
+    _aligned_free(column);
+#else
+    free(column);
+#endif
+}
+
+void pair_soa_alloc(struct pair_soa *pairs, size_t capacity) {
+    pairs->x0 = alloc_column(capacity);
+    pairs->y0 = alloc_column(capacity);
+    pairs->x1 = alloc_column(capacity);
+    pairs->y1 = alloc_column(capacity);
+    pairs->count = 0;
+    pairs->capacity = capacity;
+}
+
+void pair_soa_free(struct pair_soa *pairs) {
+    free_column(pairs->x0);
+    free_column(pairs->y0);
+    free_column(pairs->x1);
+    free_column(pairs->y1);
+    memset(pairs, 0, sizeof(struct pair_soa));
+}
+
+void pair_soa_append(struct pair_soa *pairs, double x0, double y0, double x1, double y1) {
+    if (pairs->count == pairs->capacity) {
+        MY_ERROR("Pair arrays overflow at [%zu] items\n", pairs->capacity);
+    }
+    pairs->x0[pairs->count] = x0;
+    pairs->y0[pairs->count] = y0;
+    pairs->x1[pairs->count] = x1;
+    pairs->y1[pairs->count] = y1;
+    pairs->count++;
+}
+
+/*
+ * Same math as ReferenceHaversine, one stage at a time over HAVERSINE_LANES
+ * pairs so every inner loop is a straight run over contiguous lanes
+ */
+void haversine_soa(const struct pair_soa *pairs, size_t start, size_t n, double earth_radius, double *out) {
+    const double *x0 = pairs->x0 + start;
+    const double *y0 = pairs->y0 + start;
+    const double *x1 = pairs->x1 + start;
+    const double *y1 = pairs->y1 + start;
+    size_t i = 0;
+
+    for (; i + HAVERSINE_LANES <= n; i += HAVERSINE_LANES) {
+        double d_lat[HAVERSINE_LANES];
+        double d_lon[HAVERSINE_LANES];
+        double lat1[HAVERSINE_LANES];
+        double lat2[HAVERSINE_LANES];
+        double a[HAVERSINE_LANES];
+
+        for (int l=0; l<HAVERSINE_LANES; l++) {
+            d_lat[l] = RADIANS_PER_DEGREE * (y1[i+l] - y0[i+l]);
+            d_lon[l] = RADIANS_PER_DEGREE * (x1[i+l] - x0[i+l]);
+            lat1[l] = RADIANS_PER_DEGREE * y0[i+l];
+            lat2[l] = RADIANS_PER_DEGREE * y1[i+l];
+        }
+        for (int l=0; l<HAVERSINE_LANES; l++) {
+            double sin_lat = sin(d_lat[l]/2.0);
+            double sin_lon = sin(d_lon[l]/2);
+            a[l] = (sin_lat*sin_lat) + cos(lat1[l])*cos(lat2[l])*(sin_lon*sin_lon);
+        }
+        for (int l=0; l<HAVERSINE_LANES; l++) {
+            out[i+l] = earth_radius * (2.0*asin(sqrt(a[l])));
+        }
+    }
+    for (; i<n; i++) {
+        out[i] = ReferenceHaversine(x0[i], y0[i], x1[i], y1[i], earth_radius);
+    }
+}
+
+void haversine_sum_soa(const struct pair_soa *pairs, double earth_radius, struct float_sum *sum) {
+    double distances[SUM_BATCH_PAIRS];
+
+    for (size_t start=0; start<pairs->count; start+=SUM_BATCH_PAIRS) {
+        size_t n = pairs->count - start < SUM_BATCH_PAIRS ? pairs->count - start : SUM_BATCH_PAIRS;
+        haversine_soa(pairs, start, n, earth_radius, distances);
+        float_sum_add_array(sum, distances, n);
+    }
+}
+
+void haversine_batch_sum_soa(const struct pair_soa *pairs, double earth_radius, struct float_sum *sum) {
+    double distances[SUM_BATCH_PAIRS];
+
+    for (size_t start=0; start<pairs->count; start+=SUM_BATCH_PAIRS) {
+        size_t n = pairs->count - start < SUM_BATCH_PAIRS ? pairs->count - start : SUM_BATCH_PAIRS;
+        haversine_batch(pairs->x0 + start, pairs->y0 + start, pairs->x1 + start, pairs->y1 + start,
+                        n, earth_radius, distances);
+        float_sum_add_array(sum, distances, n);
+    }
+}
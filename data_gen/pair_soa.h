@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Structure of arrays storage for haversine pairs
+ *
+ * Instead of interleaving x0,y0,x1,y1 per pair (struct data_item_s) every
+ * coordinate lives in its own 64 byte aligned array, so a kernel can load
+ * HAVERSINE_LANES consecutive values of one coordinate with a single
+ * aligned vector load and no shuffles.
+ */
+
+#define PAIR_SOA_ALIGNMENT      64
+
+/*
+ * Number of pairs the SoA kernel works on per step. The kernel is written
+ * per lane so the compiler (or an intrinsics version) can map it to any
+ * vector width, 8 doubles fill one AVX-512 register or two AVX2 ones.
+ */
+#define HAVERSINE_LANES         8
+
+struct pair_soa {
+    double *x0;
+    double *y0;
+    double *x1;
+    double *y1;
+    size_t count;
+    size_t capacity;
+};
+
+void pair_soa_alloc(struct pair_soa *pairs, size_t capacity);
+void pair_soa_free(struct pair_soa *pairs);
+void pair_soa_append(struct pair_soa *pairs, double x0, double y0, double x1, double y1);
+
+/*
+ * Compute the haversine distance of pairs [start, start+n) into out,
+ * results are bit identical to ReferenceHaversine
+ */
+void haversine_soa(const struct pair_soa *pairs, size_t start, size_t n, double earth_radius, double *out);
+
+struct float_sum;
+
+/*
+ * Add the haversine distance of all pairs to sum, in pair order
+ */
+void haversine_sum_soa(const struct pair_soa *pairs, double earth_radius, struct float_sum *sum);
+
+/*
+ * Same as haversine_sum_soa but with the vectorized haversine_batch kernel
+ */
+void haversine_batch_sum_soa(const struct pair_soa *pairs, double earth_radius, struct float_sum *sum);
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "rng.h"
+
+static inline uint64_t rotl(const uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void rng_seed(struct rng_state *rng, uint64_t seed) {
+    uint64_t z = seed;
+    for (int i=0; i<4; i++) {
+        z += 0x9e3779b97f4a7c15;
+        uint64_t v = z;
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9;
+        v = (v ^ (v >> 27)) * 0x94d049bb133111eb;
+        rng->s[i] = v ^ (v >> 31);
+    }
+}
+
+uint64_t rng_next(struct rng_state *rng) {
+    uint64_t *s = rng->s;
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+double rng_uniform(struct rng_state *rng, double radius) {
+    // top 53 bits give every double in [0, 1) with the same spacing
+    double unit = (double)(rng_next(rng) >> 11) * 0x1.0p-53;
+    return (unit*2.0 - 1.0) * radius;
+}
+
+static void rng_jump_by(struct rng_state *rng, const uint64_t jump[4]) {
+    uint64_t s[4] = {};
+    for (int i=0; i<4; i++) {
+        for (int b=0; b<64; b++) {
+            if (jump[i] & ((uint64_t)1 << b)) {
+                s[0] ^= rng->s[0];
+                s[1] ^= rng->s[1];
+                s[2] ^= rng->s[2];
+                s[3] ^= rng->s[3];
+            }
+            rng_next(rng);
+        }
+    }
+    memcpy(rng->s, s, sizeof(s));
+}
+
+void rng_jump(struct rng_state *rng) {
+    static const uint64_t jump[4] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+    rng_jump_by(rng, jump);
+}
+
+void rng_long_jump(struct rng_state *rng) {
+    static const uint64_t long_jump[4] = { 0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635 };
+    rng_jump_by(rng, long_jump);
+}
+
+void rng_lanes_init(struct rng_lanes *lanes, const struct rng_state *rng) {
+    struct rng_state lane = *rng;
+    for (int l=0; l<RNG_LANES; l++) {
+        for (int i=0; i<4; i++) {
+            lanes->s[i][l] = lane.s[i];
+        }
+        rng_long_jump(&lane);
+    }
+}
+
+void rng_fill_uniform(struct rng_lanes *lanes, double *out, size_t count,
+                      const double radius[RNG_LANES], struct value_range *range) {
+    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+    double scale[RNG_LANES], pos_min[RNG_LANES], pos_max[RNG_LANES], neg_min[RNG_LANES], neg_max[RNG_LANES];
+
+    for (int l=0; l<RNG_LANES; l++) {
+        s0[l] = lanes->s[0][l];
+        s1[l] = lanes->s[1][l];
+        s2[l] = lanes->s[2][l];
+        s3[l] = lanes->s[3][l];
+        scale[l] = radius[l];
+        pos_min[l] = HUGE_VAL;
+        pos_max[l] = 0;
+        neg_min[l] = -HUGE_VAL;
+        neg_max[l] = 0;
+    }
+
+    for (size_t i=0; i<count; i+=RNG_LANES) {
+        for (int l=0; l<RNG_LANES; l++) {
+            // s1*5 and *9 as shift + add, there is no 64 bit SIMD multiply before AVX-512
+            uint64_t m = (s1[l] << 2) + s1[l];
+            m = (m << 7) | (m >> 57);
+            uint64_t result = (m << 3) + m;
+            uint64_t t = s1[l] << 17;
+
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = (s3[l] << 45) | (s3[l] >> 19);
+
+            // top 52 bits as the mantissa of a double in [1, 2), avoids the u64 to double convert
+            uint64_t bits = (result >> 12) | 0x3ff0000000000000;
+            double unit;
+            memcpy(&unit, &bits, sizeof(unit));
+            double value = (unit*2.0 - 3.0) * scale[l];
+            out[i + l] = value;
+
+            // 0 is neither positive nor negative, same as the old per draw branches
+            double pos = value > 0 ? value : HUGE_VAL;
+            double neg = value < 0 ? value : -HUGE_VAL;
+            pos_min[l] = pos < pos_min[l] ? pos : pos_min[l];
+            pos_max[l] = value > pos_max[l] ? value : pos_max[l];
+            neg_min[l] = neg > neg_min[l] ? neg : neg_min[l];
+            neg_max[l] = value < neg_max[l] ? value : neg_max[l];
+        }
+    }
+
+    for (int l=0; l<RNG_LANES; l++) {
+        lanes->s[0][l] = s0[l];
+        lanes->s[1][l] = s1[l];
+        lanes->s[2][l] = s2[l];
+        lanes->s[3][l] = s3[l];
+
+        if (pos_max[l] > range->pos_max) {
+            range->pos_max = pos_max[l];
+        }
+        if (pos_min[l] != HUGE_VAL && (range->pos_min == 0 || pos_min[l] < range->pos_min)) {
+            range->pos_min = pos_min[l];
+        }
+        if (neg_max[l] < range->neg_max) {
+            range->neg_max = neg_max[l];
+        }
+        if (neg_min[l] != -HUGE_VAL && (range->neg_min == 0 || neg_min[l] > range->neg_min)) {
+            range->neg_min = neg_min[l];
+        }
+    }
+}
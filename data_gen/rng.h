@@ -0,0 +1,64 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * xoshiro256** pseudo random number generator
+ *
+ * Same sequence for a given seed on every platform, unlike rand() whose
+ * RAND_MAX and algorithm depend on the libc. The jump functions advance a
+ * state by 2^128 and 2^192 draws, which splits one seed into independent,
+ * non overlapping streams (for example one per block of rows).
+ */
+
+struct rng_state {
+    uint64_t s[4];
+};
+
+/*
+ * Expand a 64 bit seed into the 256 bit state with splitmix64
+ */
+void rng_seed(struct rng_state *rng, uint64_t seed);
+uint64_t rng_next(struct rng_state *rng);
+
+/*
+ * Uniform double in [-radius, radius)
+ */
+double rng_uniform(struct rng_state *rng, double radius);
+
+void rng_jump(struct rng_state *rng);
+void rng_long_jump(struct rng_state *rng);
+
+/*
+ * Bulk fill
+ *
+ * RNG_LANES independent xoshiro256** states stored lane by lane so one
+ * step of all lanes is plain 64 bit shifts, adds and xors that the
+ * compiler turns into SIMD. Lane 0 is the state given to rng_lanes_init,
+ * lane k the same state long jumped k times. Output i comes from lane
+ * i % RNG_LANES, which maps one lane to each of x0, y0, x1, y1 of a pair.
+ */
+#define RNG_LANES       4
+
+struct rng_lanes {
+    uint64_t s[4][RNG_LANES];
+};
+
+/*
+ * Smallest and largest positive and negative value drawn, 0 when none
+ */
+struct value_range {
+    double pos_min;
+    double pos_max;
+    double neg_min;
+    double neg_max;
+};
+
+void rng_lanes_init(struct rng_lanes *lanes, const struct rng_state *rng);
+
+/*
+ * Fill out with count values (a multiple of RNG_LANES), value i uniform in
+ * [-radius[i % RNG_LANES], radius[i % RNG_LANES]) on a 2^-52 grid. The
+ * drawn values are folded into range in the same pass, without branches.
+ */
+void rng_fill_uniform(struct rng_lanes *lanes, double *out, size_t count,
+                      const double radius[RNG_LANES], struct value_range *range);
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "haversine_batch.h"
+#include "float_sum.h"
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+#define APPROX_EARTH_RADIUS     6372.8
+#define BENCH_SEED              1234
+#define MAX_TESTS               4
+#define MAX_TEST_NAME           64
+#define DISTANCE_BATCH          4096
+
+/*
+ * Haversine sum benchmark
+ *
+ * Adds up the same haversine distances of random pairs with every float_sum
+ * mode and reports the GB/s of distances consumed, for 10M and 100M pairs
+ * by default:
+ *  - naive, one after the other like the parsers used to
+ *  - pairwise and kahan over the whole array
+ *  - pairwise over FLOAT_SUM_BLOCK_VALUES blocks merged in block order, the
+ *    way the -j paths split the work over threads
+ * It then checks that pairwise gives bit for bit the same sum one value at a
+ * time, as a whole array and as merged blocks, and prints how far naive and
+ * pairwise are from the kahan sum.
+ */
+enum sum_test_e {
+    SUM_TEST_NAIVE,
+    SUM_TEST_PAIRWISE,
+    SUM_TEST_KAHAN,
+    SUM_TEST_PAIRWISE_BLOCKS,
+};
+
+struct test_context {
+    char name[MAX_TEST_NAME];
+    enum sum_test_e test;
+    const double *values;
+    size_t count;
+    double sum;
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+/*
+ * Small xorshift, the same distances for a given count on every run
+ */
+static uint64_t rng_state;
+
+static double random_degrees(double range) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((double)(rng_state >> 11) / (double)(1ULL << 53)) * 2.0 * range - range;
+}
+
+static double *make_distances(size_t count) {
+    double x0[DISTANCE_BATCH], y0[DISTANCE_BATCH], x1[DISTANCE_BATCH], y1[DISTANCE_BATCH];
+    double *values = malloc((count ? count : 1) * sizeof(double));
+    if (!values) {
+        MY_ERROR("Malloc failed for size[%zu]\n", count * sizeof(double));
+    }
+
+    rng_state = BENCH_SEED;
+    for (size_t start=0; start<count; start+=DISTANCE_BATCH) {
+        size_t n = count - start < DISTANCE_BATCH ? count - start : DISTANCE_BATCH;
+        for (size_t i=0; i<n; i++) {
+            x0[i] = random_degrees(180);
+            y0[i] = random_degrees(90);
+            x1[i] = random_degrees(180);
+            y1[i] = random_degrees(90);
+        }
+        haversine_batch(x0, y0, x1, y1, n, APPROX_EARTH_RADIUS, &values[start]);
+    }
+    return values;
+}
+
+static double sum_blocks(enum float_sum_mode_e mode, const double *values, size_t count) {
+    struct float_sum sum;
+    struct float_sum part;
+
+    float_sum_init(&sum, mode);
+    for (size_t start=0; start<count; start+=FLOAT_SUM_BLOCK_VALUES) {
+        size_t n = count - start < FLOAT_SUM_BLOCK_VALUES ? count - start : FLOAT_SUM_BLOCK_VALUES;
+        float_sum_init(&part, mode);
+        float_sum_add_array(&part, &values[start], n);
+        if (!float_sum_merge(&sum, &part)) {
+            MY_ERROR("Failed to merge the sum of the block at [%zu]\n", start);
+        }
+    }
+    return float_sum_result(&sum);
+}
+
+static double sum_array(enum float_sum_mode_e mode, const double *values, size_t count) {
+    struct float_sum sum;
+    float_sum_init(&sum, mode);
+    float_sum_add_array(&sum, values, count);
+    return float_sum_result(&sum);
+}
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+    double sum;
+
+    uint64_t start = GET_CPU_TICKS();
+    switch (ctx->test) {
+        case SUM_TEST_NAIVE:
+            sum = sum_array(FLOAT_SUM_NAIVE, ctx->values, ctx->count);
+            break;
+        case SUM_TEST_PAIRWISE:
+            sum = sum_array(FLOAT_SUM_PAIRWISE, ctx->values, ctx->count);
+            break;
+        case SUM_TEST_KAHAN:
+            sum = sum_array(FLOAT_SUM_KAHAN, ctx->values, ctx->count);
+            break;
+        default:
+            sum = sum_blocks(FLOAT_SUM_PAIRWISE, ctx->values, ctx->count);
+            break;
+    }
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+    ctx->sum = sum;
+
+    size_t data_size = ctx->count * sizeof(double);
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(data_size, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(data_size, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    size_t data_size = ctx->count * sizeof(double);
+
+    printf("[%s] name[%s] items[%zu] sum[%3.16f]\n", __FUNCTION__, ctx->name, ctx->count, ctx->sum);
+    printf("\n");
+
+    printf("[%s] Slowest Speed", __FUNCTION__);
+    print_data_speed(data_size, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Speed", __FUNCTION__);
+    print_data_speed(data_size, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+/*
+ * Pairwise must not depend on how the values were handed over, and naive
+ * and pairwise are compared with the kahan sum
+ */
+static void check_sums(const double *values, size_t count) {
+    struct float_sum one_by_one;
+
+    float_sum_init(&one_by_one, FLOAT_SUM_PAIRWISE);
+    for (size_t i=0; i<count; i++) {
+        float_sum_add(&one_by_one, values[i]);
+    }
+    double pairwise = sum_array(FLOAT_SUM_PAIRWISE, values, count);
+    double blocks = sum_blocks(FLOAT_SUM_PAIRWISE, values, count);
+    double naive = sum_array(FLOAT_SUM_NAIVE, values, count);
+    double naive_blocks = sum_blocks(FLOAT_SUM_NAIVE, values, count);
+    double kahan = sum_array(FLOAT_SUM_KAHAN, values, count);
+    double kahan_blocks = sum_blocks(FLOAT_SUM_KAHAN, values, count);
+
+    if (float_sum_result(&one_by_one) != pairwise || blocks != pairwise || kahan_blocks != kahan) {
+        MY_ERROR("Pairwise sums differ, one by one [%3.16f] array [%3.16f] blocks [%3.16f], kahan [%3.16f] blocks [%3.16f]\n",
+                 float_sum_result(&one_by_one), pairwise, blocks, kahan, kahan_blocks);
+    }
+    printf("Pairwise one by one, array and blocks match  [%3.16f]\n", pairwise);
+    printf("Kahan array and blocks match                 [%3.16f]\n", kahan);
+    printf("Naive error against kahan                    [%3.16e] (relative %3.4e)\n", naive - kahan, (naive - kahan) / kahan);
+    printf("Naive blocks error against kahan             [%3.16e] (relative %3.4e)\n", naive_blocks - kahan, (naive_blocks - kahan) / kahan);
+    printf("Pairwise error against kahan                 [%3.16e] (relative %3.4e)\n", pairwise - kahan, (pairwise - kahan) / kahan);
+}
+
+void usage(void) {
+    fprintf(stderr, "Haversine Sum Benchmark Usage:\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+    fprintf(stderr, "-n <count>     Sum <count> distances (default 10M and 100M).\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    size_t counts[] = { 10000000, 100000000 };
+    int count_total = sizeof(counts)/sizeof(counts[0]);
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-n")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing count parameter\n");
+                usage();
+                exit(1);
+            }
+            counts[0] = strtoull(argv[index+1], NULL, 10);
+            count_total = 1;
+            ++index;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "ht:n:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            case 'n':
+                counts[0] = strtoull(optarg, NULL, 10);
+                count_total = 1;
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    printf("=======================\n");
+    printf("Haversine Sum Benchmark\n");
+    printf("=======================\n");
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+
+    for (int c=0; c<count_total; c++) {
+        size_t count = counts[c];
+        printf("Distances [%zu] kernel [%s]\n", count, haversine_isa_name(haversine_batch_select(HAVERSINE_AUTO)));
+        double *values = make_distances(count);
+
+        struct test_context contexts[MAX_TESTS] = {};
+        snprintf(contexts[SUM_TEST_NAIVE].name, MAX_TEST_NAME, "Sum_Naive_%zu", count);
+        snprintf(contexts[SUM_TEST_PAIRWISE].name, MAX_TEST_NAME, "Sum_Pairwise_%zu", count);
+        snprintf(contexts[SUM_TEST_KAHAN].name, MAX_TEST_NAME, "Sum_Kahan_%zu", count);
+        snprintf(contexts[SUM_TEST_PAIRWISE_BLOCKS].name, MAX_TEST_NAME, "Sum_Pairwise_Blocks_%zu", count);
+
+        struct rep_tester_config tests[MAX_TESTS] = {};
+        for (int i=0; i<MAX_TESTS; i++) {
+            contexts[i].test = i;
+            contexts[i].values = values;
+            contexts[i].count = count;
+
+            tests[i].test_name = contexts[i].name;
+            tests[i].test_main = test_main;
+            tests[i].print_stats = print_stats;
+            tests[i].test_runtime_seconds = runtime;
+            tests[i].silent = true;
+            tests[i].context = &contexts[i];
+        }
+
+        printf("\n\n");
+        rep_tester_run(tests, MAX_TESTS);
+
+        check_sums(values, count);
+        printf("\n\n");
+
+        free(values);
+    }
+
+    return 0;
+}
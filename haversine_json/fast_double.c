@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "fast_double.h"
+#include "fast_double_table.h"
+
+/*
+ * Fast path based on the Eisel-Lemire algorithm:
+ * - Accumulate up to 19 significant digits into a 64 bit integer w and
+ *   track the decimal exponent q so that value = w * 10^q
+ * - If w fits in 53 bits and |q| <= 22 both w and 10^q are exact doubles and
+ *   a single multiply or divide is correctly rounded (Clinger fast path)
+ * - Otherwise multiply w by a truncated 128 bit approximation of 5^q, when
+ *   the product is far enough from a rounding boundary the top 54 bits give
+ *   the correctly rounded mantissa
+ * - When that can not be decided (or the exponent is out of the table range)
+ *   fall back to strtod on a local copy, this is very rare in practice
+ */
+
+#define MAX_MANTISSA_DIGITS     19
+#define MAX_EXACT_POW10         22
+#define SLOW_PATH_BUFFER_LEN    128
+
+static const double exact_pow10[MAX_EXACT_POW10+1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline void full_multiplication(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low) {
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *high = (uint64_t)(r >> 64);
+    *low = (uint64_t)r;
+}
+
+/*
+ * w * 10^q for w != 0, returns false when the result can not be decided
+ * with the 128 bit approximation or is out of the normal double range
+ */
+static bool eisel_lemire(uint64_t w, int64_t q, bool negative, double *value) {
+    if (q < FAST_DOUBLE_SMALLEST_POWER || q > FAST_DOUBLE_LARGEST_POWER) {
+        return false;
+    }
+    const uint64_t *factor = power_of_five_128[q - FAST_DOUBLE_SMALLEST_POWER];
+
+    // binary exponent, ((152170 + 65536) * q) >> 16 is floor(q * log2(10))
+    int64_t exponent = (((152170 + 65536) * q) >> 16) + 1024 + 63;
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    uint64_t upper, lower;
+    full_multiplication(w, factor[0], &upper, &lower);
+
+    if ((upper & 0x1FF) == 0x1FF && (lower + w < lower)) {
+        // the truncated high part is not enough, bring in the low 64 bits of 5^q
+        uint64_t product_high, product_low;
+        full_multiplication(w, factor[1], &product_high, &product_low);
+        uint64_t product_middle = lower + product_high;
+        if (product_middle < lower) {
+            upper++;
+        }
+        if ((product_middle + 1 == 0) && ((upper & 0x1FF) == 0x1FF) && (product_low + w < product_low)) {
+            return false;
+        }
+        lower = product_middle;
+    }
+
+    // keep 54 bits with a leading 1, the extra bit is used for rounding
+    uint64_t upperbit = upper >> 63;
+    uint64_t mantissa = upper >> (upperbit + 9);
+    lz += (int)(1 ^ upperbit);
+
+    // we may be exactly between two doubles, round to even needs more precision
+    if ((upper == (mantissa << (upperbit + 9))) || ((lower == 0) && ((mantissa & 3) == 1))) {
+        return false;
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((uint64_t)1 << 53)) {
+        // rounding overflowed into the next power of two
+        mantissa = (uint64_t)1 << 52;
+        lz--;
+    }
+    mantissa &= ~((uint64_t)1 << 52);
+
+    int64_t real_exponent = exponent - lz;
+    if (real_exponent < 1 || real_exponent > 2046) {
+        // subnormal or overflow
+        return false;
+    }
+
+    uint64_t bits = mantissa | ((uint64_t)real_exponent << 52) | ((uint64_t)negative << 63);
+    memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+static bool slow_path(const char *ptr, size_t len, double *value) {
+    char buffer[SLOW_PATH_BUFFER_LEN];
+    char *copy = buffer;
+    if (len >= SLOW_PATH_BUFFER_LEN) {
+        copy = malloc(len + 1);
+        if (!copy) {
+            return false;
+        }
+    }
+    memcpy(copy, ptr, len);
+    copy[len] = 0;
+    *value = strtod(copy, NULL);
+    if (copy != buffer) {
+        free(copy);
+    }
+    return true;
+}
+
+size_t parse_double(const char *ptr, const char *end, double *value) {
+    const char *start = ptr;
+    bool negative = false;
+
+    if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+        negative = (*ptr == '-');
+        ptr++;
+    }
+
+    uint64_t w = 0;
+    int digit_count = 0;        // significant digits stored in w
+    int64_t exponent = 0;       // decimal exponent adjustment from the digits
+    bool truncated = false;     // more than MAX_MANTISSA_DIGITS significant digits
+    bool any_digit = false;
+
+    // integer part
+    for (; ptr < end && is_digit(*ptr); ptr++) {
+        any_digit = true;
+        if (digit_count < MAX_MANTISSA_DIGITS) {
+            w = w*10 + (uint64_t)(*ptr - '0');
+            if (w) {
+                digit_count++;
+            }
+        } else {
+            exponent++;
+            if (*ptr != '0') {
+                truncated = true;
+            }
+        }
+    }
+    // fractional part
+    if (ptr < end && *ptr == '.') {
+        ptr++;
+        for (; ptr < end && is_digit(*ptr); ptr++) {
+            any_digit = true;
+            if (digit_count < MAX_MANTISSA_DIGITS) {
+                w = w*10 + (uint64_t)(*ptr - '0');
+                if (w) {
+                    digit_count++;
+                }
+                exponent--;
+            } else if (*ptr != '0') {
+                truncated = true;
+            }
+        }
+    }
+    if (!any_digit) {
+        return 0;
+    }
+    // exponent part, only consumed if it has at least one digit
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        const char *exp_ptr = ptr + 1;
+        bool exp_negative = false;
+        if (exp_ptr < end && (*exp_ptr == '-' || *exp_ptr == '+')) {
+            exp_negative = (*exp_ptr == '-');
+            exp_ptr++;
+        }
+        if (exp_ptr < end && is_digit(*exp_ptr)) {
+            int64_t exp_value = 0;
+            for (; exp_ptr < end && is_digit(*exp_ptr); exp_ptr++) {
+                // clamp, anything this big is already 0 or inf
+                if (exp_value < 100000) {
+                    exp_value = exp_value*10 + (*exp_ptr - '0');
+                }
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+            ptr = exp_ptr;
+        }
+    }
+    size_t consumed = ptr - start;
+
+    if (w == 0) {
+        *value = negative ? -0.0 : 0.0;
+        return consumed;
+    }
+
+    if (!truncated) {
+        if (w <= ((uint64_t)1 << 53) && exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10) {
+            double d = (double)w;
+            if (exponent < 0) {
+                d = d / exact_pow10[-exponent];
+            } else {
+                d = d * exact_pow10[exponent];
+            }
+            *value = negative ? -d : d;
+            return consumed;
+        }
+        if (eisel_lemire(w, exponent, negative, value)) {
+            return consumed;
+        }
+    } else {
+        // the real value is in [w, w+1) * 10^exponent, if both ends round
+        // to the same double then that is the answer
+        double low, high;
+        if (eisel_lemire(w, exponent, negative, &low) &&
+            eisel_lemire(w + 1, exponent, negative, &high) &&
+            low == high) {
+            *value = low;
+            return consumed;
+        }
+    }
+
+    if (!slow_path(start, consumed, value)) {
+        return 0;
+    }
+    return consumed;
+}
@@ -0,0 +1,12 @@
+#include <stddef.h>
+
+/*
+ * Decimal to double conversion that parses in place, no copy to a side
+ * buffer and no locale handling. Rounds exactly like strtod.
+ *
+ * Parses [+-]digits[.digits][(e|E)[+-]digits] starting at ptr and never reads
+ * at or past end. Returns the number of bytes consumed or 0 if there is no
+ * number at ptr, or if a number too long for the stack buffer of the strtod
+ * fallback can not get a heap copy.
+ */
+size_t parse_double(const char *ptr, const char *end, double *value);
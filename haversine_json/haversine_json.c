@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "json_row.h"
+#include "json_dfa.h"
+#include "haversine_json.h"
+
+bool haversine_json_init(struct haversine_json *ctx, const uint8_t *data, size_t size,
+                         const struct haversine_json_options *options) {
+    ctx->data = data;
+    ctx->size = size;
+    if (options) {
+        ctx->options = *options;
+    } else {
+        memset(&ctx->options, 0, sizeof(ctx->options));
+    }
+    memset(&ctx->cur, 0, sizeof(ctx->cur));
+    return haversine_json_rewind(ctx);
+}
+
+/*
+ * Take the error of the parser in use, NULL when it just ran out of rows
+ */
+static void set_error(struct haversine_json *ctx) {
+    if (ctx->options.parser == HAVERSINE_JSON_DFA) {
+        ctx->error = ctx->tok.error;
+        ctx->error_pos = ctx->tok.error_pos;
+    } else {
+        ctx->error = ctx->cur.error;
+        ctx->error_pos = (size_t)(ctx->cur.ptr - ctx->cur.base);
+    }
+}
+
+bool haversine_json_rewind(struct haversine_json *ctx) {
+    ctx->rows = 0;
+    ctx->done = false;
+    ctx->incomplete = false;
+    ctx->error = NULL;
+    ctx->error_pos = 0;
+
+    if (ctx->options.parser == HAVERSINE_JSON_DFA) {
+        json_tokenizer_init(&ctx->tok, ctx->data, ctx->size);
+        if (!json_dfa_find_pairs(&ctx->tok)) {
+            set_error(ctx);
+            ctx->done = true;
+            return false;
+        }
+        return true;
+    }
+
+    // the cursor never writes to the buffer
+    ctx->cur.base = (uint8_t *)ctx->data;
+    ctx->cur.ptr = ctx->cur.base;
+    ctx->cur.remaining = ctx->size;
+    ctx->cur.row_end = ctx->cur.base + ctx->size;
+    ctx->cur.error = NULL;
+    ctx->cur.index = ctx->options.index;
+    ctx->cur.verify_values = ctx->options.verify_values;
+    ctx->cur.verbose = ctx->options.verbose;
+    if (!find_pairs_array(&ctx->cur)) {
+        set_error(ctx);
+        ctx->done = true;
+        return false;
+    }
+    return true;
+}
+
+size_t haversine_json_next_batch(struct haversine_json *ctx, struct data_item_s *out, size_t max_rows) {
+    size_t count = 0;
+
+    if (ctx->done) {
+        return 0;
+    }
+    if (ctx->options.parser == HAVERSINE_JSON_DFA) {
+        while (count < max_rows) {
+            if (!json_dfa_next_row(&ctx->tok, &out[count])) {
+                set_error(ctx);
+                ctx->done = true;
+                break;
+            }
+            count++;
+        }
+    } else {
+        parse_tiers_start(&ctx->cur);
+        while (count < max_rows) {
+            enum parse_row_result_e result = parse_row(&ctx->cur, &out[count]);
+            if (result != ROW_PARSED) {
+                ctx->incomplete = result == ROW_INCOMPLETE;
+                if (result == ROW_ERROR) {
+                    set_error(ctx);
+                }
+                ctx->done = true;
+                break;
+            }
+            count++;
+        }
+        parse_tiers_stop(&ctx->cur);
+    }
+    ctx->rows += count;
+    return count;
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * libhaversine_json, pull based reader of the data_gen JSON pairs file
+ *
+ * All the parsing state lives in a haversine_json context, so any number of
+ * files or passes over the same buffer can be parsed in one process. The
+ * caller owns the buffer and pulls the rows a batch at a time:
+ *
+ *   struct haversine_json ctx;
+ *   struct data_item_s rows[1024];
+ *   if (!haversine_json_init(&ctx, data, size, NULL)) {
+ *       ... ctx.error, ctx.error_pos
+ *   }
+ *   while ((n = haversine_json_next_batch(&ctx, rows, 1024)) > 0) {
+ *       ...
+ *   }
+ *   if (ctx.error || ctx.incomplete) {
+ *       ...
+ *   }
+ *
+ * The library never exits, a malformed header or row ends the rows and
+ * leaves a message in error and its offset in the buffer in error_pos.
+ * With HAVERSINE_JSON_ROWS a row cut short by the end of the buffer only
+ * ends the rows and sets incomplete.
+ *
+ * The context holds a parse_cursor and a json_tokenizer, include json_row.h
+ * and json_dfa.h first.
+ */
+
+enum haversine_json_parser_e {
+    HAVERSINE_JSON_ROWS,        // parse_row, fast path plus general parser
+    HAVERSINE_JSON_DFA,         // json_dfa tokenizer and token row builder
+};
+
+struct haversine_json_options {
+    enum haversine_json_parser_e parser;
+    const struct structural_index *index;   // of the whole buffer, HAVERSINE_JSON_ROWS only, NULL for the scalar walk
+    bool verify_values;                     // cross check every value against strtod, HAVERSINE_JSON_ROWS only
+    bool verbose;
+};
+
+struct haversine_json {
+    const uint8_t *data;
+    size_t size;
+    struct haversine_json_options options;
+    struct parse_cursor cur;
+    struct json_tokenizer tok;
+    size_t rows;                // rows returned since the last rewind
+    bool done;
+    bool incomplete;            // the buffer ends inside a row
+    const char *error;          // malformed data, NULL if there is none
+    size_t error_pos;           // offset of the error in data
+};
+
+/*
+ * Start reading the buffer, options can be NULL for the default parser.
+ * The buffer and the index must outlive the context. Returns false with
+ * error set if the header up to the pairs array is malformed.
+ */
+bool haversine_json_init(struct haversine_json *ctx, const uint8_t *data, size_t size,
+                         const struct haversine_json_options *options);
+
+/*
+ * Go back to the first row, the tier stats of the cursor are kept. Returns
+ * false like haversine_json_init.
+ */
+bool haversine_json_rewind(struct haversine_json *ctx);
+
+/*
+ * Parse up to max_rows rows into out, returns how many, 0 after the last
+ * row. A short count ends the rows, check error and incomplete.
+ */
+size_t haversine_json_next_batch(struct haversine_json *ctx, struct data_item_s *out, size_t max_rows);
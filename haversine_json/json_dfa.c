@@ -0,0 +1,334 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "json_dfa.h"
+#include "json_row.h"
+#include "fast_double.h"
+
+#define JSON_TOKEN_RING_MASK    (JSON_TOKEN_RING_SIZE - 1)
+
+enum json_dfa_class_e {
+    CLASS_OTHER,
+    CLASS_SPACE,
+    CLASS_STRUCTURAL,
+    CLASS_QUOTE,
+    CLASS_BACKSLASH,
+    CLASS_COUNT,
+};
+
+/*
+ * A transition is the next state in the low 2 bits and the emit bits:
+ * - CLOSE_BEFORE  the scalar [token_start, i) ends before this byte
+ * - OPEN          a scalar or string starts at this byte
+ * - SINGLE        this byte is a one byte structural token
+ * - CLOSE_AFTER   the string [token_start, i+1) ends with this byte
+ */
+#define STATE_MASK              0x03
+#define CLOSE_BEFORE_SHIFT      2
+#define OPEN_SHIFT              3
+#define SINGLE_SHIFT            4
+#define CLOSE_AFTER_SHIFT       5
+
+#define CLOSE_BEFORE            (1 << CLOSE_BEFORE_SHIFT)
+#define OPEN                    (1 << OPEN_SHIFT)
+#define SINGLE                  (1 << SINGLE_SHIFT)
+#define CLOSE_AFTER             (1 << CLOSE_AFTER_SHIFT)
+
+static const uint8_t byte_class[256] = {
+    ['{']   = CLASS_STRUCTURAL,
+    ['}']   = CLASS_STRUCTURAL,
+    ['[']   = CLASS_STRUCTURAL,
+    [']']   = CLASS_STRUCTURAL,
+    [':']   = CLASS_STRUCTURAL,
+    [',']   = CLASS_STRUCTURAL,
+    [' ']   = CLASS_SPACE,
+    ['\t']  = CLASS_SPACE,
+    ['\n']  = CLASS_SPACE,
+    ['\r']  = CLASS_SPACE,
+    ['"']   = CLASS_QUOTE,
+    ['\\']  = CLASS_BACKSLASH,
+};
+
+static const uint8_t transitions[4][CLASS_COUNT] = {
+    [JSON_DFA_OUTSIDE] = {
+        [CLASS_OTHER]       = JSON_DFA_SCALAR | OPEN,
+        [CLASS_SPACE]       = JSON_DFA_OUTSIDE,
+        [CLASS_STRUCTURAL]  = JSON_DFA_OUTSIDE | SINGLE,
+        [CLASS_QUOTE]       = JSON_DFA_STRING | OPEN,
+        [CLASS_BACKSLASH]   = JSON_DFA_SCALAR | OPEN,
+    },
+    [JSON_DFA_SCALAR] = {
+        [CLASS_OTHER]       = JSON_DFA_SCALAR,
+        [CLASS_SPACE]       = JSON_DFA_OUTSIDE | CLOSE_BEFORE,
+        [CLASS_STRUCTURAL]  = JSON_DFA_OUTSIDE | CLOSE_BEFORE | SINGLE,
+        [CLASS_QUOTE]       = JSON_DFA_STRING | CLOSE_BEFORE | OPEN,
+        [CLASS_BACKSLASH]   = JSON_DFA_SCALAR,
+    },
+    [JSON_DFA_STRING] = {
+        [CLASS_OTHER]       = JSON_DFA_STRING,
+        [CLASS_SPACE]       = JSON_DFA_STRING,
+        [CLASS_STRUCTURAL]  = JSON_DFA_STRING,
+        [CLASS_QUOTE]       = JSON_DFA_OUTSIDE | CLOSE_AFTER,
+        [CLASS_BACKSLASH]   = JSON_DFA_ESCAPE,
+    },
+    [JSON_DFA_ESCAPE] = {
+        [CLASS_OTHER]       = JSON_DFA_STRING,
+        [CLASS_SPACE]       = JSON_DFA_STRING,
+        [CLASS_STRUCTURAL]  = JSON_DFA_STRING,
+        [CLASS_QUOTE]       = JSON_DFA_STRING,
+        [CLASS_BACKSLASH]   = JSON_DFA_STRING,
+    },
+};
+
+void json_tokenizer_init(struct json_tokenizer *tok, const uint8_t *data, size_t size) {
+    memset(tok, 0, offsetof(struct json_tokenizer, ring));
+    tok->data = data;
+    tok->size = size;
+    tok->state = JSON_DFA_OUTSIDE;
+}
+
+size_t json_tokenizer_fill(struct json_tokenizer *tok) {
+    // up to two tokens per byte plus the unconditional store of a third, and
+    // the scalar the end of the input closes, must never reach the tail
+    size_t free_slots = JSON_TOKEN_RING_SIZE - (size_t)(tok->head - tok->tail);
+    size_t chunk = free_slots > 1 ? (free_slots - 1) / 2 : 0;
+    if (chunk > tok->size - tok->pos) {
+        chunk = tok->size - tok->pos;
+    }
+
+    const uint8_t *data = tok->data;
+    struct json_token *ring = tok->ring;
+    uint64_t head = tok->head;
+    uint32_t state = tok->state;
+    size_t token_start = tok->token_start;
+    size_t end = tok->pos + chunk;
+    for (size_t i=tok->pos; i<end; i++) {
+        uint32_t t = transitions[state][byte_class[data[i]]];
+
+        ring[head & JSON_TOKEN_RING_MASK] = (struct json_token){ token_start, i };
+        head += (t >> CLOSE_BEFORE_SHIFT) & 1;
+
+        size_t open_mask = -(size_t)((t >> OPEN_SHIFT) & 1);
+        token_start = (i & open_mask) | (token_start & ~open_mask);
+
+        ring[head & JSON_TOKEN_RING_MASK] = (struct json_token){ i, i + 1 };
+        head += (t >> SINGLE_SHIFT) & 1;
+
+        ring[head & JSON_TOKEN_RING_MASK] = (struct json_token){ token_start, i + 1 };
+        head += (t >> CLOSE_AFTER_SHIFT) & 1;
+
+        state = t & STATE_MASK;
+    }
+    tok->pos = end;
+
+    // the input ends, a scalar ends with it
+    if (tok->pos == tok->size && state != JSON_DFA_OUTSIDE) {
+        if (state == JSON_DFA_SCALAR) {
+            ring[head & JSON_TOKEN_RING_MASK] = (struct json_token){ token_start, tok->size };
+            head++;
+        } else {
+            tok->unterminated = true;
+        }
+        state = JSON_DFA_OUTSIDE;
+    }
+    tok->head = head;
+    tok->state = state;
+    tok->token_start = token_start;
+    return (size_t)(tok->head - tok->tail);
+}
+
+static bool token_error(struct json_tokenizer *tok, const char *error, size_t pos) {
+    tok->error = error;
+    tok->error_pos = pos;
+    return false;
+}
+
+bool json_tokenizer_next(struct json_tokenizer *tok, struct json_token *token) {
+    // a chunk can end on whitespace only, keep filling until a token shows up
+    while (tok->head == tok->tail) {
+        if (tok->pos == tok->size) {
+            if (tok->unterminated) {
+                return token_error(tok, "input ends inside a string", tok->token_start);
+            }
+            return false;
+        }
+        json_tokenizer_fill(tok);
+    }
+    *token = tok->ring[tok->tail & JSON_TOKEN_RING_MASK];
+    tok->tail++;
+    return true;
+}
+
+static inline char token_char(const struct json_tokenizer *tok, const struct json_token *token) {
+    return (char)tok->data[token->start];
+}
+
+static inline bool is_char_token(const struct json_tokenizer *tok, const struct json_token *token, char c) {
+    return token->end - token->start == 1 && token_char(tok, token) == c;
+}
+
+/*
+ * Next token where the input must go on, running out of tokens is an error
+ */
+static bool next_token(struct json_tokenizer *tok, struct json_token *token) {
+    if (!json_tokenizer_next(tok, token)) {
+        if (!tok->error) {
+            token_error(tok, "input ends in the middle of a value", tok->size);
+        }
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Skip the value that starts with token, nested objects and arrays included
+ */
+static bool skip_token_value(struct json_tokenizer *tok, const struct json_token *token) {
+    struct json_token t;
+    int depth = 0;
+
+    if (!is_char_token(tok, token, '{') && !is_char_token(tok, token, '[')) {
+        return true;
+    }
+    depth = 1;
+    while (depth > 0) {
+        if (!next_token(tok, &t)) {
+            return false;
+        }
+        if (is_char_token(tok, &t, '{') || is_char_token(tok, &t, '[')) {
+            depth++;
+        } else if (is_char_token(tok, &t, '}') || is_char_token(tok, &t, ']')) {
+            depth--;
+        }
+    }
+    return true;
+}
+
+bool json_dfa_find_pairs(struct json_tokenizer *tok) {
+    struct json_token token;
+    struct json_token value;
+
+    if (!next_token(tok, &token)) {
+        return false;
+    }
+    if (!is_char_token(tok, &token, '{')) {
+        return token_error(tok, "failed to find start of json", token.start);
+    }
+    for (;;) {
+        if (!next_token(tok, &token)) {
+            return false;
+        }
+        if (token_char(tok, &token) != '"') {
+            return token_error(tok, "failed to find pairs item", token.start);
+        }
+        bool pairs = token.end - token.start == 7 && memcmp(&tok->data[token.start], "\"pairs\"", 7) == 0;
+        if (!next_token(tok, &value)) {
+            return false;
+        }
+        if (!is_char_token(tok, &value, ':')) {
+            return token_error(tok, "failed to find item separator", value.start);
+        }
+        if (!next_token(tok, &value)) {
+            return false;
+        }
+        if (pairs) {
+            if (!is_char_token(tok, &value, '[')) {
+                return token_error(tok, "failed to find start of json array", value.start);
+            }
+            return true;
+        }
+        if (!skip_token_value(tok, &value) || !next_token(tok, &token)) {
+            return false;
+        }
+        if (!is_char_token(tok, &token, ',')) {
+            return token_error(tok, "failed to find pairs item", token.start);
+        }
+    }
+}
+
+bool json_dfa_next_row(struct json_tokenizer *tok, struct data_item_s *item) {
+    struct json_token token;
+    struct json_token value;
+    double values[4] = {};
+    int found_items = 0;
+
+    if (!next_token(tok, &token)) {
+        return false;
+    }
+    if (is_char_token(tok, &token, ',') && !next_token(tok, &token)) {
+        return false;
+    }
+    if (is_char_token(tok, &token, ']')) {
+        return false;
+    }
+    if (!is_char_token(tok, &token, '{')) {
+        return token_error(tok, "expected a row", token.start);
+    }
+    size_t row_start = token.start;
+
+    for (;;) {
+        if (!next_token(tok, &token)) {
+            return false;
+        }
+        if (is_char_token(tok, &token, '}')) {
+            break;
+        }
+        if (token_char(tok, &token) != '"') {
+            return token_error(tok, "expected a key", token.start);
+        }
+        int found_item = token.end - token.start == 4 ? match_row_key(&tok->data[token.start + 1]) : 0;
+        if (!next_token(tok, &value)) {
+            return false;
+        }
+        if (!is_char_token(tok, &value, ':')) {
+            return token_error(tok, "expected ':'", value.start);
+        }
+        if (!next_token(tok, &value)) {
+            return false;
+        }
+        if (found_item) {
+            double v;
+            const char *start = (const char *)&tok->data[value.start];
+            if (parse_double(start, (const char *)&tok->data[value.end], &v) != value.end - value.start) {
+                return token_error(tok, "failed to parse value", value.start);
+            }
+            switch (found_item) {
+                case FOUND_X0:
+                    values[0] = v;
+                    break;
+                case FOUND_Y0:
+                    values[1] = v;
+                    break;
+                case FOUND_X1:
+                    values[2] = v;
+                    break;
+                default:
+                    values[3] = v;
+                    break;
+            }
+            found_items |= found_item;
+        } else if (!skip_token_value(tok, &value)) {
+            return false;
+        }
+
+        if (!next_token(tok, &token)) {
+            return false;
+        }
+        if (is_char_token(tok, &token, '}')) {
+            break;
+        }
+        if (!is_char_token(tok, &token, ',')) {
+            return token_error(tok, "expected ',' or '}' after the value", token.start);
+        }
+    }
+
+    if (found_items != (FOUND_X0 | FOUND_Y0 | FOUND_X1 | FOUND_Y1)) {
+        return token_error(tok, "failed to find all items", row_start);
+    }
+    item->x0 = values[0];
+    item->y0 = values[1];
+    item->x1 = values[2];
+    item->y1 = values[3];
+    return true;
+}
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Table driven JSON tokenizer
+ *
+ * Every input byte is mapped to a class by a 256 entry table, the current
+ * state and the class index a transition table that holds the next state
+ * and what the byte does to the tokens. The byte loop has no data dependent
+ * branches, a token record is always written to the ring and the ring head
+ * only moves by the emit bits of the transition.
+ *
+ * Tokens are byte ranges [start, end) of the input:
+ *  - one structural char, { } [ ] : or ,
+ *  - a string with its quotes, escapes are skipped but not decoded
+ *  - a scalar, a run of any other chars, which covers numbers and literals
+ * Whitespace only separates tokens.
+ *
+ * The ring is refilled a chunk of bytes at a time, a byte ends at most two
+ * tokens so a chunk is about half the free ring slots.
+ */
+
+#define JSON_TOKEN_RING_SIZE    256     // power of 2
+
+enum json_dfa_state_e {
+    JSON_DFA_OUTSIDE,
+    JSON_DFA_SCALAR,
+    JSON_DFA_STRING,
+    JSON_DFA_ESCAPE,
+};
+
+struct json_token {
+    size_t start;
+    size_t end;                     // exclusive
+};
+
+struct json_tokenizer {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;                     // next byte to tokenize
+    uint32_t state;
+    size_t token_start;             // start of the scalar or string being read
+    bool unterminated;              // the input ends inside a string
+    const char *error;              // why the last call failed, NULL at the end of the input
+    size_t error_pos;               // offset in data of the error
+    uint64_t head;                  // tokens written
+    uint64_t tail;                  // tokens read
+    struct json_token ring[JSON_TOKEN_RING_SIZE];
+};
+
+void json_tokenizer_init(struct json_tokenizer *tok, const uint8_t *data, size_t size);
+
+/*
+ * Tokenize the next chunk of input into the free part of the ring, returns
+ * the number of tokens in the ring, 0 once all the input is tokenized and
+ * read
+ */
+size_t json_tokenizer_fill(struct json_tokenizer *tok);
+
+/*
+ * Next token, refills the ring when it is empty. Returns false at the end
+ * of the input, with tok->error set if the input ends inside a string.
+ */
+bool json_tokenizer_next(struct json_tokenizer *tok, struct json_token *token);
+
+struct data_item_s;
+
+/*
+ * Pair rows from the token stream, find the "pairs" array first and then
+ * read one row per call. Keys other than x0, y0, x1 and y1 are skipped with
+ * their value. Both return false on malformed data with tok->error and
+ * tok->error_pos set, json_dfa_next_row also returns false after the last
+ * row with tok->error left NULL.
+ */
+bool json_dfa_find_pairs(struct json_tokenizer *tok);
+bool json_dfa_next_row(struct json_tokenizer *tok, struct data_item_s *item);
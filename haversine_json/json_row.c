@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "json_row.h"
+#include "json_scan.h"
+#include "fast_double.h"
+#include "rdtsc_utils.h"
+
+#define LOG(...) {                  \
+        if (cur->verbose) {         \
+            printf(__VA_ARGS__);    \
+        }                           \
+    }
+
+/*
+ * There is no clear guidance on how conformant this json parser should be
+ * It is not the goal to implement a JSON parser but just something that can
+ * read the previously generated file. We could cheat as we know the exact 
+ * structure to expect:
+ * 
+ * {"pairs":[
+ * {"x0":-152.1370425038677752, "y0":-71.3097241387282139, "x1":-163.3649409391753977, "y1":-67.8408444243673472},
+ * {"x0":-97.5403914868554125, "y0":-54.3610062144515211, "x1":-91.8418793435403558, "y1":-45.5549272734461894}
+ * ]}
+ * 
+ * parse_row does cheat first, a fast path takes the rows in exactly that
+ * form and only the rows it rejects go to the general parser.
+ *
+ * But since we probably want a pig parser to optimize later
+ * we are going to add some flexibility like:
+ * - ignore whitespace
+ * - ignore linefeed or carriage return
+ * - data items do not need to be in the order x0, y0, x1, y1, but are tagged using lowercase
+ * - other keys of a row are skipped together with their value, which can be
+ *   any JSON value, so extra fields do not stop the parse
+ * 
+ * Will start with a char based parser which is really inneficient and slow
+ * 
+ * By using advance to char we may be skipping bad formatted json or other data we don't care about,
+ * so this is not really a good way to validate the structure is actually real json
+ */
+
+/*
+ * Find the next position of target using the structural index, only valid
+ * for targets that are structural chars. Returns the position of target or
+ * the end of the data if not found
+ */
+static size_t next_indexed_target(struct parse_cursor *cur, char target) {
+    size_t pos = cur->ptr - cur->base;
+    size_t end = pos + cur->remaining;
+    for (;;) {
+        pos = next_structural(cur->index, pos, end);
+        if (pos == end || (char)cur->base[pos] == target) {
+            return pos;
+        }
+        pos++;
+    }
+}
+
+static bool advance_until_indexed(struct parse_cursor *cur, char target) {
+    size_t start = cur->ptr - cur->base;
+    size_t pos = next_indexed_target(cur, target);
+    size_t end = start + cur->remaining;
+    if (pos == end) {
+        cur->ptr += cur->remaining;
+        cur->remaining = 0;
+        return false;
+    }
+    // consume up to and including the target
+    LOG("Found [%c] after [%zu] bytes read\n", target, pos - start + 1);
+    cur->ptr = cur->base + pos + 1;
+    cur->remaining = end - (pos + 1);
+    return true;
+}
+
+bool advance_until(struct parse_cursor *cur, char target) {
+    if (cur->index && is_structural_char(target)) {
+        return advance_until_indexed(cur, target);
+    }
+    uint32_t bytes_consumed = 0;
+    bool found = false;
+    while(!found && cur->remaining>0) {
+        bytes_consumed++;
+        cur->remaining--;
+        if ((char)*cur->ptr==target) {
+            // found target and we have already consumed
+            LOG("Found [%c] after [%" PRIu32 "] bytes read\n", target, bytes_consumed);
+            found = true;
+        }
+        cur->ptr++;
+    }
+    return found;
+}
+
+static bool find_string(struct parse_cursor *cur, char *string) {
+    bool found_it = false;
+    int len = strlen(string);
+    LOG("Looking for [%s] len[%d]\n", string, len);
+    char *ptr = string;
+    for (int i=0; i<len; i++) {
+        found_it = advance_until(cur, *ptr);
+        if (!found_it) return false;
+        ptr++;
+    }
+    // we found all elements
+    return true;
+}
+
+bool is_whitespace(char c) {
+    return c==' ' || c=='\t' || c=='\n' || c=='\r';
+}
+
+/*
+ * Malformed data is not fatal while parsing rows, a -j chunk that started on
+ * a wrong split point is thrown away. The row helpers return false for both
+ * the end of the data and a malformed row, the latter sets cur->error.
+ */
+static bool row_error(struct parse_cursor *cur, const char *error) {
+    cur->error = error;
+    return false;
+}
+
+/*
+ * Compare a parsed value with strtod of the same consumed chars, on a
+ * mismatch item_value_buffer keeps the value text
+ */
+static bool verify_value(struct parse_cursor *cur, const char *start, size_t consumed, double value) {
+    if (consumed >= MAX_VALUE_LEN) {
+        return row_error(cur, "value too long to verify");
+    }
+    memset(cur->item_value_buffer, 0, MAX_VALUE_LEN);
+    memcpy(cur->item_value_buffer, start, consumed);
+    double expected = strtod(cur->item_value_buffer, NULL);
+    if (memcmp(&value, &expected, sizeof(double)) != 0) {
+        return row_error(cur, "value differs from strtod");
+    }
+    cur->verified_value_count++;
+    return true;
+}
+
+/*
+ * Parse the number at the current position in place, there is no copy
+ * into item_value_buffer unless we are verifying against strtod.
+ * Returns false if the data ends before the number starts or there is no
+ * number.
+ */
+bool parse_value(struct parse_cursor *cur, double *value) {
+    while (cur->remaining>0 && is_whitespace((char)*cur->ptr)) {
+        cur->ptr++;
+        cur->remaining--;
+    }
+
+    const char *start = (const char *)cur->ptr;
+    size_t consumed = parse_double(start, start + cur->remaining, value);
+    if (!consumed) {
+        if (cur->remaining==0 || (cur->remaining==1 && (*start=='-' || *start=='+'))) {
+            // ran out of data, the number is in the next buffer
+            return false;
+        }
+        return row_error(cur, "failed to parse value");
+    }
+
+    if (cur->verify_values && !verify_value(cur, start, consumed, *value)) {
+        return false;
+    }
+
+    cur->ptr += consumed;
+    cur->remaining -= consumed;
+    return true;
+}
+
+/*
+ * Row keys are recognized in place with one 16 bit load instead of copying
+ * them out and comparing strings. The low bit of each key char is a perfect
+ * hash of x0, y0, x1 and y1 ('x' and '0' are even, 'y' and '1' odd), one
+ * compare with the key in that slot then rejects every other key.
+ */
+#define KEY16(a, b)             ((uint16_t)(uint8_t)(a) | (uint16_t)(uint8_t)(b) << 8)
+#define KEY_SLOT(key)           (((key) & 0x1) | (((key) >> 7) & 0x2))
+
+static const uint16_t row_keys[4] = { KEY16('x', '0'), KEY16('y', '0'), KEY16('x', '1'), KEY16('y', '1') };
+static const uint8_t row_key_found[4] = { FOUND_X0, FOUND_Y0, FOUND_X1, FOUND_Y1 };
+
+// byte order independent, compiles to a single 16 bit load on x86
+static inline uint16_t load_key16(const uint8_t *ptr) {
+    return (uint16_t)ptr[0] | (uint16_t)ptr[1] << 8;
+}
+
+int match_row_key(const uint8_t *key) {
+    uint16_t key16 = load_key16(key);
+    int slot = KEY_SLOT(key16);
+    return key16 == row_keys[slot] ? row_key_found[slot] : 0;
+}
+
+/*
+ * Move the cursor past the closing quote of a string, the cursor is inside
+ * the string. Returns false if the data ends first.
+ */
+static bool skip_string(struct parse_cursor *cur) {
+    while (cur->remaining>0) {
+        char c = (char)*cur->ptr;
+        if (c == '\\') {
+            if (cur->remaining<2) {
+                return false;
+            }
+            cur->ptr += 2;
+            cur->remaining -= 2;
+            continue;
+        }
+        cur->ptr++;
+        cur->remaining--;
+        if (c == '"') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Identify the key after its opening quote and move past its closing quote.
+ * Returns the FOUND_ bit of a row key, 0 for any other key or -1 if the
+ * data ends inside the key.
+ */
+static int parse_key(struct parse_cursor *cur) {
+    if (cur->remaining>=3 && cur->ptr[2] == '"') {
+        int found_item = match_row_key(cur->ptr);
+        if (found_item) {
+            cur->ptr += 3;
+            cur->remaining -= 3;
+            return found_item;
+        }
+    }
+    return skip_string(cur) ? 0 : -1;
+}
+
+/*
+ * Skip the value of an unknown key, a string, number, literal or a nested
+ * object or array. The cursor is left on the ',' or '}' after the value.
+ * Returns false if the data ends before the value does.
+ */
+static bool skip_value(struct parse_cursor *cur) {
+    int depth = 0;
+
+    while (cur->remaining>0 && is_whitespace((char)*cur->ptr)) {
+        cur->ptr++;
+        cur->remaining--;
+    }
+    while (cur->remaining>0) {
+        char c = (char)*cur->ptr;
+        if (depth == 0 && (c == ',' || c == '}' || c == ']' || is_whitespace(c))) {
+            return true;
+        }
+        cur->ptr++;
+        cur->remaining--;
+        if (c == '"') {
+            if (!skip_string(cur)) {
+                return false;
+            }
+            if (depth == 0) {
+                return true;
+            }
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * After a value, ',' means another key follows and '}' ends the row.
+ * Returns false if the data ends first or on any other char.
+ */
+static bool parse_separator(struct parse_cursor *cur, char *separator) {
+    while (cur->remaining>0 && is_whitespace((char)*cur->ptr)) {
+        cur->ptr++;
+        cur->remaining--;
+    }
+    if (cur->remaining==0) {
+        return false;
+    }
+    *separator = (char)*cur->ptr;
+    if (*separator != ',' && *separator != '}') {
+        return row_error(cur, "expected ',' or '}' after the value");
+    }
+    cur->ptr++;
+    cur->remaining--;
+    return true;
+}
+
+/*
+ * Move the cursor past the json header up to the start of the pairs array
+ */
+bool find_pairs_array(struct parse_cursor *cur) {
+    // first hit the start of json
+    if (!advance_until(cur, '{')) {
+        return row_error(cur, "failed to find start of json");
+    }
+
+    // there may be other json items, we want to find "pairs"
+    if (!find_string(cur, "\"pairs\"")) {
+        return row_error(cur, "failed to find pairs item");
+    }
+    if (!advance_until(cur, ':')) {
+        return row_error(cur, "failed to find item separator");
+    }
+    if (!advance_until(cur, '[')) {    // start of json array
+        return row_error(cur, "failed to find start of json array");
+    }
+    return true;
+}
+
+static enum parse_row_result_e row_failed(struct parse_cursor *cur) {
+    return cur->error ? ROW_ERROR : ROW_INCOMPLETE;
+}
+
+/*
+ * General tier, any whitespace, key order, extra keys and exponents
+ */
+enum parse_row_result_e parse_row_general(struct parse_cursor *cur, struct data_item_s *item) {
+    double X0 = 0, Y0 = 0, X1 = 0, Y1 = 0;
+    uint8_t found_items = 0;
+    char separator = ',';
+    double value;
+
+    // parse array row
+    if (!advance_until(cur, '{')) {    // start of row item
+        return ROW_NONE;
+    }
+    if (cur->ptr > cur->row_end) {
+        // leave the cursor on the '{', the row belongs to the next chunk
+        cur->ptr--;
+        cur->remaining++;
+        return ROW_NONE;
+    }
+
+    while (separator == ',') {
+        if (!advance_until(cur, '"')) {    // start of item id
+            return ROW_INCOMPLETE;
+        }
+        int found_item = parse_key(cur);
+        if (found_item < 0) {
+            return ROW_INCOMPLETE;
+        }
+        if (!advance_until(cur, ':')) {    // start of value
+            return ROW_INCOMPLETE;
+        }
+
+        if (found_item == 0) {
+            LOG("Skipping value of unknown key\n");
+            if (!skip_value(cur)) {
+                return ROW_INCOMPLETE;
+            }
+        } else {
+            if (!parse_value(cur, &value)) {
+                return row_failed(cur);
+            }
+            LOG("Found value [%3.16f]\n", value);
+            switch (found_item) {
+                case FOUND_X0:
+                    X0 = value;
+                    break;
+                case FOUND_Y0:
+                    Y0 = value;
+                    break;
+                case FOUND_X1:
+                    X1 = value;
+                    break;
+                default:
+                    Y1 = value;
+                    break;
+            }
+            found_items |= found_item;
+        }
+
+        // the last item does not end with ',' instead we hit the end of the array item '}'
+        if (!parse_separator(cur, &separator)) {
+            return row_failed(cur);
+        }
+    }
+
+    if (found_items != (FOUND_X0 | FOUND_Y0 | FOUND_X1 | FOUND_Y1)) {
+        cur->error = "failed to find all items";
+        return ROW_ERROR;
+    }
+    LOG("Parsed x0:%3.16f, y0:%3.16f, x1:%3.16f, y1:%3.16f \n", X0, Y0, X1, Y1);
+
+    item->x0 = X0;
+    item->y0 = Y0;
+    item->x1 = X1;
+    item->y1 = Y1;
+    return ROW_PARSED;
+}
+
+/*
+ * Fast tier, the exact row data_gen writes after the ",\n" of the previous
+ * row:
+ *      {"x0":V, "y0":V, "x1":V, "y1":V}
+ * Each key with its separators is one fixed compare and each value is
+ * parsed where it ends up. With the structural index the row start and the
+ * end of every value come from the bitmap, a value must end right on the
+ * next structural char. Any difference, including the data ending inside
+ * the row or a row past row_end, returns false with the cursor untouched so
+ * the general tier can take the row.
+ */
+#define FAST_ROW_KEYS           4
+
+static const char *fast_row_keys[FAST_ROW_KEYS] = { "{\"x0\":", ", \"y0\":", ", \"x1\":", ", \"y1\":" };
+static const size_t fast_row_key_len[FAST_ROW_KEYS] = { 6, 7, 7, 7 };
+
+static bool parse_row_fast(struct parse_cursor *cur, struct data_item_s *item) {
+    uint8_t *ptr = cur->ptr;
+    uint8_t *end = cur->ptr + cur->remaining;
+    const char *starts[FAST_ROW_KEYS];
+    size_t sizes[FAST_ROW_KEYS];
+    double values[FAST_ROW_KEYS];
+
+    if (cur->index) {
+        // skip the ',' of the previous row
+        size_t pos = next_structural(cur->index, ptr - cur->base, end - cur->base);
+        if (cur->base + pos < end && cur->base[pos] == ',') {
+            pos = next_structural(cur->index, pos + 1, end - cur->base);
+        }
+        ptr = cur->base + pos;
+    } else {
+        while (ptr < end && (*ptr == ',' || is_whitespace((char)*ptr))) {
+            ptr++;
+        }
+    }
+    if (ptr >= cur->row_end) {
+        return false;
+    }
+    for (int k=0; k<FAST_ROW_KEYS; k++) {
+        if ((size_t)(end - ptr) < fast_row_key_len[k] || memcmp(ptr, fast_row_keys[k], fast_row_key_len[k]) != 0) {
+            return false;
+        }
+        ptr += fast_row_key_len[k];
+        starts[k] = (const char *)ptr;
+        uint8_t *value_end = end;
+        if (cur->index) {
+            value_end = cur->base + next_structural(cur->index, ptr - cur->base, end - cur->base);
+        }
+        sizes[k] = parse_double((const char *)ptr, (const char *)value_end, &values[k]);
+        if (!sizes[k] || (cur->index && ptr + sizes[k] != value_end)) {
+            return false;
+        }
+        ptr += sizes[k];
+    }
+    if (ptr == end || *ptr != '}') {
+        return false;
+    }
+    ptr++;
+
+    if (cur->verify_values) {
+        // the general tier parses the row again and stops on the bad value
+        for (int k=0; k<FAST_ROW_KEYS; k++) {
+            if (!verify_value(cur, starts[k], sizes[k], values[k])) {
+                return false;
+            }
+        }
+    }
+    item->x0 = values[0];
+    item->y0 = values[1];
+    item->x1 = values[2];
+    item->y1 = values[3];
+    cur->remaining -= ptr - cur->ptr;
+    cur->ptr = ptr;
+    return true;
+}
+
+/*
+ * Close the current run of rows and start one in tier
+ */
+static void switch_parse_tier(struct parse_cursor *cur, enum parse_tier_e tier) {
+    uint64_t now = GET_CPU_TICKS();
+    cur->tiers[cur->tier].ticks += now - cur->tier_start_ticks;
+    cur->tier = tier;
+    cur->tier_start_ticks = now;
+}
+
+/*
+ * Parse the next row with the fast tier and fall back to the general one.
+ * The run switches after the fast attempt, so the failed attempt of the
+ * first row of a fallback run counts as fast path time and the first fast
+ * row after it as fallback time.
+ */
+enum parse_row_result_e parse_row(struct parse_cursor *cur, struct data_item_s *item) {
+    uint8_t *row_start = cur->ptr;
+    enum parse_tier_e tier = PARSE_TIER_FAST;
+    enum parse_row_result_e result = ROW_PARSED;
+
+    if (!parse_row_fast(cur, item)) {
+        tier = PARSE_TIER_FALLBACK;
+        result = parse_row_general(cur, item);
+    }
+    if (result == ROW_PARSED) {
+        if (tier != cur->tier) {
+            switch_parse_tier(cur, tier);
+        }
+        cur->tiers[tier].rows++;
+        cur->tiers[tier].bytes += cur->ptr - row_start;
+    }
+    return result;
+}
+
+/*
+ * Time the parse_row calls between start and stop, the work the caller does
+ * between rows counts for the run it falls in
+ */
+void parse_tiers_start(struct parse_cursor *cur) {
+    cur->tier = PARSE_TIER_FAST;
+    cur->tier_start_ticks = GET_CPU_TICKS();
+}
+
+void parse_tiers_stop(struct parse_cursor *cur) {
+    switch_parse_tier(cur, cur->tier);
+}
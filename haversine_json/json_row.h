@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Row parser of the data_gen JSON pairs file
+ *
+ * A parse_cursor walks a buffer of the file, either byte by byte or by
+ * jumping between the structural chars of a json_scan structural index,
+ * and parse_row turns the next {"x0":..., "y0":..., "x1":..., "y1":...}
+ * object of the pairs array into a data_item_s.
+ */
+
+#define MAX_VALUE_LEN           64
+
+#define FOUND_X0                0x1
+#define FOUND_Y0                0x2
+#define FOUND_X1                0x4
+#define FOUND_Y1                0x8
+
+/*
+ * Rows are parsed in two tiers, a fast path that only accepts the exact row
+ * data_gen writes and the general parser the fast path falls back to for
+ * any other row. Every cursor keeps the rows, bytes and ticks of each tier.
+ * The ticks are timed per run of rows in the same tier, the TSC is only
+ * read when the tier changes and by parse_tiers_start and parse_tiers_stop.
+ */
+enum parse_tier_e {
+    PARSE_TIER_FAST,
+    PARSE_TIER_FALLBACK,
+    PARSE_TIERS,
+};
+
+struct parse_tier {
+    size_t rows;
+    size_t bytes;
+    uint64_t ticks;
+};
+
+struct structural_index;
+
+/*
+ * Parsing position inside a buffer of the file, each parsing thread owns its
+ * own cursor so that several byte ranges of the file can be parsed at the
+ * same time
+ */
+struct parse_cursor {
+    uint8_t *ptr;
+    size_t remaining;
+    uint8_t *base;                          // start of the buffer ptr points into
+    const struct structural_index *index;   // structural index of base, NULL for the scalar walk
+    uint8_t *row_end;                       // rows starting at or after row_end are left for the next chunk
+    const char *error;                      // why parse_row returned ROW_ERROR or find_pairs_array false
+    bool verify_values;                     // cross check every parsed value against strtod
+    bool verbose;
+    char item_value_buffer[MAX_VALUE_LEN];
+    size_t verified_value_count;
+    struct parse_tier tiers[PARSE_TIERS];
+    enum parse_tier_e tier;                 // of the current run of rows
+    uint64_t tier_start_ticks;              // when the current run started
+};
+
+struct data_item_s {
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+};
+
+/*
+ * Parse the next array row into item:
+ * - ROW_PARSED        item holds the row
+ * - ROW_NONE          there are no more rows left for this cursor
+ * - ROW_INCOMPLETE    a row started but the data ended before the row did
+ * - ROW_ERROR         the row is malformed, cur->error tells why
+ */
+enum parse_row_result_e {
+    ROW_PARSED,
+    ROW_NONE,
+    ROW_INCOMPLETE,
+    ROW_ERROR,
+};
+
+enum parse_row_result_e parse_row(struct parse_cursor *cur, struct data_item_s *item);
+
+/*
+ * Time the parse_row calls between start and stop, the work the caller does
+ * between rows counts for the run it falls in
+ */
+void parse_tiers_start(struct parse_cursor *cur);
+void parse_tiers_stop(struct parse_cursor *cur);
+
+/*
+ * Only the general tier, the parser as it was before the fast path
+ */
+enum parse_row_result_e parse_row_general(struct parse_cursor *cur, struct data_item_s *item);
+
+/*
+ * Move the cursor past the json header up to the start of the pairs array,
+ * returns false with cur->error set when the header is malformed
+ */
+bool find_pairs_array(struct parse_cursor *cur);
+
+/*
+ * FOUND_ bit of the two key chars at key when they are x0, y0, x1 or y1,
+ * 0 for anything else
+ */
+int match_row_key(const uint8_t *key);
+
+bool advance_until(struct parse_cursor *cur, char target);
+bool is_whitespace(char c);
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#include "json_scan.h"
+
+bool is_structural_char(char c) {
+    switch (c) {
+        case '{':
+        case '}':
+        case '"':
+        case ':':
+        case ',':
+        case '[':
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Scalar tail, used for the last bytes that do not fill a full SIMD register
+ */
+static void index_scalar(uint64_t *bits, const uint8_t *data, size_t start, size_t size) {
+    for (size_t pos=start; pos<size; pos++) {
+        if (is_structural_char((char)data[pos])) {
+            bits[pos/64] |= (uint64_t)1 << (pos%64);
+        }
+    }
+}
+
+/*
+ * 16 bytes at a time, 4 loads per 64 bit word of the bitmap
+ */
+static size_t index_sse2(uint64_t *bits, const uint8_t *data, size_t size) {
+    const __m128i open_brace = _mm_set1_epi8('{');
+    const __m128i close_brace = _mm_set1_epi8('}');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i open_bracket = _mm_set1_epi8('[');
+
+    size_t full_words = size / 64;
+    for (size_t w=0; w<full_words; w++) {
+        uint64_t word = 0;
+        for (int i=0; i<4; i++) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(data + w*64 + i*16));
+            __m128i match = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, open_brace), _mm_cmpeq_epi8(chunk, close_brace)),
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, colon)),
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, open_bracket))));
+            word |= (uint64_t)(uint16_t)_mm_movemask_epi8(match) << (i*16);
+        }
+        bits[w] = word;
+    }
+    return full_words * 64;
+}
+
+#if defined(__GNUC__)
+/*
+ * 32 bytes at a time, 2 loads per 64 bit word of the bitmap
+ */
+__attribute__((target("avx2")))
+static size_t index_avx2(uint64_t *bits, const uint8_t *data, size_t size) {
+    const __m256i open_brace = _mm256_set1_epi8('{');
+    const __m256i close_brace = _mm256_set1_epi8('}');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i open_bracket = _mm256_set1_epi8('[');
+
+    size_t full_words = size / 64;
+    for (size_t w=0; w<full_words; w++) {
+        uint64_t word = 0;
+        for (int i=0; i<2; i++) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + w*64 + i*32));
+            __m256i match = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, open_brace), _mm256_cmpeq_epi8(chunk, close_brace)),
+                _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, colon)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, comma), _mm256_cmpeq_epi8(chunk, open_bracket))));
+            word |= (uint64_t)(uint32_t)_mm256_movemask_epi8(match) << (i*32);
+        }
+        bits[w] = word;
+    }
+    // dirty upper YMM halves make every later SSE and libm call pay the
+    // AVX-SSE transition penalty
+    _mm256_zeroupper();
+    return full_words * 64;
+}
+#endif
+
+bool build_structural_index(struct structural_index *index, const uint8_t *data, size_t size, enum json_scan_isa_e isa) {
+    index->size = size;
+    index->word_count = (size + 63) / 64;
+    index->bits = calloc(index->word_count, sizeof(uint64_t));
+    if (!index->bits) {
+        return false;
+    }
+
+#if defined(__GNUC__)
+    if (isa == JSON_SCAN_AUTO) {
+        isa = __builtin_cpu_supports("avx2") ? JSON_SCAN_AVX2 : JSON_SCAN_SSE2;
+    }
+#else
+    isa = JSON_SCAN_SSE2;
+#endif
+
+    size_t done;
+    switch (isa) {
+#if defined(__GNUC__)
+        case JSON_SCAN_AVX2:
+            index->isa_name = "AVX2";
+            done = index_avx2(index->bits, data, size);
+            break;
+#endif
+        default:
+            index->isa_name = "SSE2";
+            done = index_sse2(index->bits, data, size);
+            break;
+    }
+    index_scalar(index->bits, data, done, size);
+    return true;
+}
+
+void free_structural_index(struct structural_index *index) {
+    free(index->bits);
+    index->bits = NULL;
+    index->word_count = 0;
+    index->size = 0;
+}
+
+static inline size_t lowest_set_bit(uint64_t word) {
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctzll(word);
+#else
+    size_t bit = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+size_t next_structural(const struct structural_index *index, size_t pos, size_t end) {
+    if (pos >= end) {
+        return end;
+    }
+    size_t w = pos / 64;
+    // drop the bits before pos in the first word
+    uint64_t word = index->bits[w] & (~(uint64_t)0 << (pos % 64));
+    size_t last_word = (end - 1) / 64;
+    while (!word) {
+        w++;
+        if (w > last_word) {
+            return end;
+        }
+        word = index->bits[w];
+    }
+    size_t found = w*64 + lowest_set_bit(word);
+    return found < end ? found : end;
+}
+
+static inline size_t set_bit_count(uint32_t mask) {
+#if defined(__GNUC__)
+    return (size_t)__builtin_popcount(mask);
+#else
+    size_t count = 0;
+    while (mask) {
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+static size_t count_char_sse2(const uint8_t *data, size_t size, char c, size_t *done) {
+    const __m128i target = _mm_set1_epi8(c);
+    size_t count = 0;
+    size_t pos = 0;
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + pos));
+        count += set_bit_count((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target)));
+    }
+    *done = pos;
+    return count;
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2,popcnt")))
+static size_t count_char_avx2(const uint8_t *data, size_t size, char c, size_t *done) {
+    const __m256i target = _mm256_set1_epi8(c);
+    size_t count = 0;
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + pos));
+        count += set_bit_count((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, target)));
+    }
+    // same as index_avx2, the row count runs right before the SSE parse and
+    // haversine code
+    _mm256_zeroupper();
+    *done = pos;
+    return count;
+}
+#endif
+
+size_t count_char(const uint8_t *data, size_t size, char c, enum json_scan_isa_e isa) {
+    size_t count;
+    size_t done;
+
+#if defined(__GNUC__)
+    if (isa == JSON_SCAN_AUTO) {
+        isa = __builtin_cpu_supports("avx2") ? JSON_SCAN_AVX2 : JSON_SCAN_SSE2;
+    }
+    if (isa == JSON_SCAN_AVX2) {
+        count = count_char_avx2(data, size, c, &done);
+    } else {
+        count = count_char_sse2(data, size, c, &done);
+    }
+#else
+    count = count_char_sse2(data, size, c, &done);
+#endif
+    for (; done<size; done++) {
+        count += (data[done] == (uint8_t)c);
+    }
+    return count;
+}
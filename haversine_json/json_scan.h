@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * SIMD JSON structural scanner
+ *
+ * Builds a bitmap with one bit per input byte, the bit is set when the byte
+ * is one of the structural characters the parser jumps between:
+ *      { } " : , [
+ * Bit (pos % 64) of word (pos / 64) represents data[pos].
+ */
+
+enum json_scan_isa_e {
+    JSON_SCAN_AUTO,
+    JSON_SCAN_SSE2,
+    JSON_SCAN_AVX2,
+};
+
+struct structural_index {
+    uint64_t *bits;
+    size_t word_count;
+    size_t size;            // size in bytes of the indexed data
+    const char *isa_name;   // which implementation built the index
+};
+
+bool is_structural_char(char c);
+
+/*
+ * Returns false if the bitmap can not be allocated
+ */
+bool build_structural_index(struct structural_index *index, const uint8_t *data, size_t size, enum json_scan_isa_e isa);
+void free_structural_index(struct structural_index *index);
+
+/*
+ * Return the position of the first structural char at or after pos
+ * and before end, returns end if there is none
+ */
+size_t next_structural(const struct structural_index *index, size_t pos, size_t end);
+
+/*
+ * Count the occurrences of c in data, with the same SIMD implementations as
+ * the structural index. Used to size arrays exactly before parsing.
+ */
+size_t count_char(const uint8_t *data, size_t size, char c, enum json_scan_isa_e isa);
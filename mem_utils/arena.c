@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "arena.h"
+#include "page_alloc.h"
+
+#define ARENA_HEADER_SIZE   ((sizeof(struct arena_block) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/*
+ * Get a block straight from the OS, page aligned and zero filled.
+ * Huge pages are only a hint, when the kernel has none available
+ * the block is still valid, just backed by 4KB pages.
+ */
+static struct arena_block *arena_new_block(struct arena *arena, size_t min_size) {
+    size_t map_size = ARENA_HEADER_SIZE + min_size;
+    if (map_size < arena->block_size) {
+        map_size = arena->block_size;
+    }
+    map_size = round_up(map_size, arena->huge_pages ? ARENA_HUGE_PAGE_SIZE : PAGE_ALLOC_PAGE_SIZE);
+    struct page_buffer pages;
+
+    if (!page_alloc(&pages, map_size, arena->huge_pages, false)) {
+        return NULL;
+    }
+    struct arena_block *block = (struct arena_block *)pages.ptr;
+
+    block->next = NULL;
+    block->size = pages.map_size - ARENA_HEADER_SIZE;
+    block->used = 0;
+    arena->block_count++;
+    arena->reserved_bytes += pages.map_size;
+    return block;
+}
+
+static void arena_release_block(struct arena_block *block) {
+    struct page_buffer pages = {};
+    pages.ptr = (uint8_t *)block;
+    pages.map_size = block->size + ARENA_HEADER_SIZE;
+    page_free(&pages);
+}
+
+void arena_init(struct arena *arena, size_t block_size, bool huge_pages) {
+    memset(arena, 0, sizeof(struct arena));
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->huge_pages = huge_pages;
+}
+
+/*
+ * Returns ARENA_ALIGNMENT aligned memory or NULL if the OS is out of memory.
+ * Requests that do not fit the block size get a bigger block of their own.
+ */
+void *arena_alloc(struct arena *arena, size_t size) {
+    size = round_up(size, ARENA_ALIGNMENT);
+
+    struct arena_block *block = arena->current;
+    while (!block || block->used + size > block->size) {
+        if (block && block->next) {
+            // reuse the blocks kept by arena_reset
+            block = block->next;
+            block->used = 0;
+            continue;
+        }
+        struct arena_block *new_block = arena_new_block(arena, size);
+        if (!new_block) {
+            return NULL;
+        }
+        if (block) {
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            arena->first = new_block;
+        }
+        block = new_block;
+    }
+    arena->current = block;
+
+    void *ptr = (uint8_t *)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    arena->allocated_bytes += size;
+    return ptr;
+}
+
+/*
+ * Forget all allocations but keep the blocks, the next allocations reuse
+ * already faulted in memory
+ */
+void arena_reset(struct arena *arena) {
+    arena->current = arena->first;
+    if (arena->current) {
+        arena->current->used = 0;
+    }
+    arena->allocated_bytes = 0;
+}
+
+void arena_free(struct arena *arena) {
+    struct arena_block *block = arena->first;
+    while (block) {
+        struct arena_block *next = block->next;
+        arena_release_block(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_count = 0;
+    arena->reserved_bytes = 0;
+    arena->allocated_bytes = 0;
+}
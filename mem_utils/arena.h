@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Simple arena (bump) allocator
+ *
+ * Memory is taken from the OS in large blocks and handed out by moving an
+ * offset forward, so allocating is a compare and an add instead of a malloc
+ * call, and consecutive allocations are contiguous in memory.
+ * There is no per allocation free, arena_reset() rewinds the arena keeping
+ * its blocks for reuse and arena_free() returns all blocks to the OS.
+ */
+
+#define ARENA_DEFAULT_BLOCK_SIZE    (64*1024*1024)
+#define ARENA_ALIGNMENT             16
+#define ARENA_HUGE_PAGE_SIZE        (2*1024*1024)
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;            // usable bytes after the header
+    size_t used;
+};
+
+struct arena {
+    struct arena_block *first;
+    struct arena_block *current;
+    size_t block_size;      // size of new blocks, header included
+    bool huge_pages;        // back blocks with 2MB pages when the OS allows it
+    size_t block_count;
+    size_t reserved_bytes;  // bytes taken from the OS
+    size_t allocated_bytes; // bytes handed out since the last reset
+};
+
+void arena_init(struct arena *arena, size_t block_size, bool huge_pages);
+void *arena_alloc(struct arena *arena, size_t size);
+void arena_reset(struct arena *arena);
+void arena_free(struct arena *arena);
@@ -0,0 +1,22 @@
+@echo off
+cls
+IF NOT EXIST build mkdir build
+pushd build
+
+echo.
+echo.
+echo ====================
+echo Compile Library Code
+echo ====================
+:: Compile library code
+call cl /Zi /FC /c ..\arena.c ..\page_alloc.c || echo "Command Failed" && popd && exit /B
+:: Link and create static lib
+call lib arena.obj page_alloc.obj /OUT:libmem_utils.lib || echo "Command Failed" && popd && exit /B
+echo ===============================================================
+
+echo.
+echo.
+echo ====================
+echo Compile Completed OK
+echo ====================
+popd
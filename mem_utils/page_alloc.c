@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "page_alloc.h"
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/*
+ * Fault in every page by hand, for the mappings MAP_POPULATE can not be
+ * used on
+ */
+static void touch_pages(uint8_t *ptr, size_t size) {
+    for (size_t offset=0; offset<size; offset+=PAGE_ALLOC_PAGE_SIZE) {
+        ((volatile uint8_t *)ptr)[offset] = 0;
+    }
+}
+
+#ifdef _WIN32
+
+bool page_alloc(struct page_buffer *buffer, size_t size, bool huge_pages, bool populate) {
+    memset(buffer, 0, sizeof(struct page_buffer));
+    buffer->size = size;
+
+    if (huge_pages) {
+        // needs SeLockMemoryPrivilege, without it VirtualAlloc just fails
+        size_t large_page = GetLargePageMinimum();
+        if (large_page) {
+            buffer->map_size = round_up(size ? size : 1, large_page);
+            buffer->ptr = VirtualAlloc(NULL, buffer->map_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (buffer->ptr) {
+                // large pages are always resident
+                buffer->backing = PAGE_BACKING_HUGETLB;
+                buffer->populated = true;
+                return true;
+            }
+        }
+    }
+
+    buffer->map_size = round_up(size ? size : 1, PAGE_ALLOC_PAGE_SIZE);
+    buffer->ptr = VirtualAlloc(NULL, buffer->map_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!buffer->ptr) {
+        return false;
+    }
+    buffer->backing = PAGE_BACKING_SMALL;
+    if (populate) {
+        touch_pages(buffer->ptr, buffer->map_size);
+        buffer->populated = true;
+    }
+    return true;
+}
+
+void page_free(struct page_buffer *buffer) {
+    if (buffer->ptr) {
+        VirtualFree(buffer->ptr, 0, MEM_RELEASE);
+    }
+    memset(buffer, 0, sizeof(struct page_buffer));
+}
+
+#else
+
+/*
+ * Map map_size bytes at a 2MB boundary, so the kernel can back the whole
+ * range with huge pages, by mapping 2MB more and unmapping the ends
+ */
+static uint8_t *map_huge_aligned(size_t map_size) {
+    size_t over_size = map_size + PAGE_ALLOC_HUGE_PAGE_SIZE;
+    uint8_t *ptr = mmap(NULL, over_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    uint8_t *aligned = (uint8_t *)round_up((uintptr_t)ptr, PAGE_ALLOC_HUGE_PAGE_SIZE);
+    size_t head = aligned - ptr;
+    size_t tail = over_size - head - map_size;
+    if (head) {
+        munmap(ptr, head);
+    }
+    if (tail) {
+        munmap(aligned + map_size, tail);
+    }
+    return aligned;
+}
+
+bool page_alloc(struct page_buffer *buffer, size_t size, bool huge_pages, bool populate) {
+    int populate_flag = 0;
+
+    memset(buffer, 0, sizeof(struct page_buffer));
+    buffer->size = size;
+#ifdef MAP_POPULATE
+    populate_flag = populate ? MAP_POPULATE : 0;
+#endif
+
+    if (huge_pages) {
+        buffer->map_size = round_up(size ? size : 1, PAGE_ALLOC_HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+        // fails right away when there are not enough reserved huge pages
+        uint8_t *ptr = mmap(NULL, buffer->map_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate_flag, -1, 0);
+        if (ptr != MAP_FAILED) {
+            buffer->ptr = ptr;
+            buffer->backing = PAGE_BACKING_HUGETLB;
+            buffer->populated = populate;
+            return true;
+        }
+#endif
+        buffer->ptr = map_huge_aligned(buffer->map_size);
+        if (!buffer->ptr) {
+            return false;
+        }
+        buffer->backing = PAGE_BACKING_SMALL;
+#ifdef MADV_HUGEPAGE
+        // best effort, ignore failure on kernels without THP
+        if (madvise(buffer->ptr, buffer->map_size, MADV_HUGEPAGE) == 0) {
+            buffer->backing = PAGE_BACKING_TRANSPARENT;
+        }
+#endif
+        // MAP_POPULATE would fault before the hint, populate after it
+        if (populate) {
+#ifdef MADV_POPULATE_WRITE
+            if (madvise(buffer->ptr, buffer->map_size, MADV_POPULATE_WRITE) != 0) {
+                touch_pages(buffer->ptr, buffer->map_size);
+            }
+#else
+            touch_pages(buffer->ptr, buffer->map_size);
+#endif
+            buffer->populated = true;
+        }
+        return true;
+    }
+
+    buffer->map_size = round_up(size ? size : 1, PAGE_ALLOC_PAGE_SIZE);
+    uint8_t *ptr = mmap(NULL, buffer->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | populate_flag, -1, 0);
+    if (ptr == MAP_FAILED) {
+        buffer->ptr = NULL;
+        return false;
+    }
+    buffer->ptr = ptr;
+    buffer->backing = PAGE_BACKING_SMALL;
+    buffer->populated = populate;
+    return true;
+}
+
+void page_free(struct page_buffer *buffer) {
+    if (buffer->ptr) {
+        munmap(buffer->ptr, buffer->map_size);
+    }
+    memset(buffer, 0, sizeof(struct page_buffer));
+}
+
+#endif
+
+const char *page_backing_name(enum page_backing_e backing) {
+    switch (backing) {
+        case PAGE_BACKING_TRANSPARENT:
+            return "2MB transparent";
+        case PAGE_BACKING_HUGETLB:
+            return "2MB hugetlb";
+        default:
+            return "4KB";
+    }
+}
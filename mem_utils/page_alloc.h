@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Page allocator for big buffers
+ *
+ * Every 4KB page of a fresh mapping costs a page fault on first touch, a 1GB
+ * buffer is about 250K faults. With huge_pages the buffer asks for 2MB pages,
+ * 512 times fewer faults and TLB entries:
+ * - first explicit huge pages (MAP_HUGETLB, MEM_LARGE_PAGES on Windows),
+ *   which need pages reserved by the admin (vm.nr_hugepages)
+ * - else a 2MB aligned mapping with madvise(MADV_HUGEPAGE), which the kernel
+ *   backs with transparent huge pages when it has them
+ * With populate all pages are faulted in by page_alloc (MAP_POPULATE) so the
+ * first pass over the buffer does not fault at all.
+ */
+
+#define PAGE_ALLOC_PAGE_SIZE        4096
+#define PAGE_ALLOC_HUGE_PAGE_SIZE   (2*1024*1024)
+
+enum page_backing_e {
+    PAGE_BACKING_SMALL,         // 4KB pages
+    PAGE_BACKING_TRANSPARENT,   // MADV_HUGEPAGE hint, 2MB pages if the kernel has them
+    PAGE_BACKING_HUGETLB,       // explicit 2MB pages
+};
+
+struct page_buffer {
+    uint8_t *ptr;               // zero filled, page aligned, NULL when not allocated
+    size_t size;                // requested bytes
+    size_t map_size;            // bytes mapped
+    enum page_backing_e backing;
+    bool populated;
+};
+
+/*
+ * Returns false when the OS is out of memory, huge pages are only tried and
+ * never make the allocation fail
+ */
+bool page_alloc(struct page_buffer *buffer, size_t size, bool huge_pages, bool populate);
+void page_free(struct page_buffer *buffer);
+
+const char *page_backing_name(enum page_backing_e backing);
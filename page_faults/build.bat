@@ -9,12 +9,13 @@ echo ===================
 echo Compile Executables
 echo ===================
 :: Compile executables
-call cl /Zi /FC -I..\..\rdtsc\ -I..\..\rep_tester ..\page_faults1.c ..\..\rep_tester\build\libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ -I..\..\rep_tester ..\page_faults2.c ..\..\rep_tester\build\libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\page_faults3.c ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\page_faults4.c ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\page_faults5.c ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\page_faults6.c ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\rep_tester -I..\..\mem_utils\ ..\page_faults1.c ..\..\rep_tester\build\libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\rep_tester -I..\..\mem_utils\ ..\page_faults2.c ..\..\rep_tester\build\libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\page_faults3.c ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\page_faults4.c ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\page_faults5.c ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\page_faults6.c ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\rep_tester -I..\..\mem_utils\ ..\page_faults7.c ..\..\rep_tester\build\libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
 
 echo.
 echo.
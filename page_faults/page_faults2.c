@@ -17,6 +17,7 @@
 
 #include "reptester.h"
 #include "rdtsc_utils.h"
+#include "page_alloc.h"
 
 /*
  * Incrementally touch pages of allocated memory and
@@ -35,6 +36,8 @@ struct test_context {
     char *name;
     int num_pages;
     bool reverse;
+    bool huge_pages;
+    struct page_buffer pages;
     char *filename;
     FILE *fp;
     size_t buffer_size;
@@ -86,14 +89,10 @@ void test_setup(void *context) {
     // printf("[%s] name[%s]\n", __FUNCTION__, ctx->name);
 
     // allocate memory
-#ifdef _WIN32
-    ctx->buffer = (uint8_t *)VirtualAlloc(0, ctx->buffer_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-#else
-    ctx->buffer = mmap(0, ctx->buffer_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-#endif
-    if (!ctx->buffer) {
+    if (!page_alloc(&ctx->pages, ctx->buffer_size, ctx->huge_pages, false)) {
          MY_ERROR("mmap     failed for size[%zu]\n", ctx->buffer_size);
     }
+    ctx->buffer = ctx->pages.ptr;
 
     ctx->start_pagefault_count = ReadOSPageFaultCount();
 }
@@ -117,11 +116,7 @@ void test_teardown(void *context) {
     }
 
     // release memory
-#ifdef _WIN32
-    VirtualFree(ctx->buffer, 0, MEM_RELEASE);
-#else
-    munmap(ctx->buffer, ctx->buffer_size);
-#endif
+    page_free(&ctx->pages);
     ctx->buffer = 0;
 }
 
@@ -158,12 +153,14 @@ void usage(void) {
     fprintf(stderr, "-h             This help dialog.\n");
     fprintf(stderr, "-n <num>       Use <num> PAGES to test.\n");
     fprintf(stderr, "-r             Set reverse sweep of pages\n");
+    fprintf(stderr, "-H             Back the buffer with 2MB pages, one fault per 512 pages\n");
 }
 
 int main (int argc, char *argv[]) {
     int opt;
     int num_pages = 0;
     bool reverse = false;
+    bool huge_pages = false;
 
     printf("=============\n");
     printf("Page Faults 2\n");
@@ -186,10 +183,12 @@ int main (int argc, char *argv[]) {
             ++index;
         } else if (strcmp(argv[index], "-r")==0) {
             reverse = true;
+        } else if (strcmp(argv[index], "-H")==0) {
+            huge_pages = true;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "hn:r")) != -1) {
+    while( (opt = getopt(argc, argv, "hn:rH")) != -1) {
         switch (opt) {
             case 'h':
                 usage();
@@ -204,6 +203,10 @@ int main (int argc, char *argv[]) {
                 reverse = true;
                 break;
 
+            case 'H':
+                huge_pages = true;
+                break;
+
             default:
                 fprintf(stderr, "MY_ERROR Invalid command line option\n");
                 usage();
@@ -232,6 +235,7 @@ int main (int argc, char *argv[]) {
     my_context.name = "PageFaults_incremental_single";
     my_context.num_pages = num_pages;
     my_context.reverse = reverse;
+    my_context.huge_pages = huge_pages;
 
     printf("\n\n");
 
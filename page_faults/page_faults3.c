@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 
 #include "rdtsc_utils.h"
+#include "page_alloc.h"
 
 /*
  * Single Pass touch each page of allocated memory and
@@ -35,16 +36,19 @@ void usage(void) {
     fprintf(stderr, "-h             This help dialog.\n");
     fprintf(stderr, "-n <num>       Use <num> PAGES to test.\n");
     fprintf(stderr, "-r             Set reverse sweep of pages\n");
+    fprintf(stderr, "-H             Back the buffer with 2MB pages, one fault per 512 pages\n");
 }
 
 int main (int argc, char *argv[]) {
     int opt;
     int num_pages = 0;
     bool reverse = false;
+    bool huge_pages = false;
     char *filename;
     FILE *fp;
     size_t buffer_size;
     uint8_t *buffer;
+    struct page_buffer pages;
 
     printf("=========================================\n");
     printf("Page Faults 3: Single Pass PageFault test\n");
@@ -67,10 +71,12 @@ int main (int argc, char *argv[]) {
             ++index;
         } else if (strcmp(argv[index], "-r")==0) {
             reverse = true;
+        } else if (strcmp(argv[index], "-H")==0) {
+            huge_pages = true;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "hn:r")) != -1) {
+    while( (opt = getopt(argc, argv, "hn:rH")) != -1) {
         switch (opt) {
             case 'h':
                 usage();
@@ -85,6 +91,10 @@ int main (int argc, char *argv[]) {
                 reverse = true;
                 break;
 
+            case 'H':
+                huge_pages = true;
+                break;
+
             default:
                 fprintf(stderr, "MY_ERROR Invalid command line option\n");
                 usage();
@@ -120,14 +130,11 @@ int main (int argc, char *argv[]) {
     printf("[%s] Num Pages                          [%u] pages\n", __FUNCTION__, num_pages);
 
     // allocate memory
-#ifdef _WIN32
-    buffer = (uint8_t *)VirtualAlloc(0, buffer_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-#else
-    buffer = mmap(0, buffer_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-#endif
-    if (!buffer) {
+    if (!page_alloc(&pages, buffer_size, huge_pages, false)) {
          MY_ERROR("mmap     failed for size[%zu]\n", buffer_size);
     }
+    buffer = pages.ptr;
+    printf("[%s] Page backing                       [%s]\n", __FUNCTION__, page_backing_name(pages.backing));
 
     // Test
     uint8_t data = 0x5a;
@@ -151,11 +158,7 @@ int main (int argc, char *argv[]) {
     }
 
     // release memory
-#ifdef _WIN32
-    VirtualFree(buffer, 0, MEM_RELEASE);
-#else
-    munmap(buffer, buffer_size);
-#endif
+    page_free(&pages);
     buffer = 0;
    
     printf("\n\n");
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "page_alloc.h"
+
+/*
+ * Allocate a buffer with page_alloc, write its first byte and then one byte
+ * of every 4KB page, the way a file read or the pair array fill a fresh
+ * buffer, and free it again. Every backing runs as its own test:
+ * - 4KB pages, a fault on the first touch of every page
+ * - 4KB pages pre-faulted by page_alloc
+ * - 2MB pages, a fault on the first touch of every 2MB
+ * - 2MB pages pre-faulted by page_alloc
+ * Time to first byte is from the allocation until the first byte is
+ * written, total time is until every page is written. Page faults are
+ * counted over both.
+ */
+
+#define PAGE_SIZE   4096
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+struct test_context {
+    char *name;
+    bool huge_pages;
+    bool populate;
+    size_t buffer_size;
+    enum page_backing_e backing;
+    uint64_t faults;
+    uint64_t min_first_byte_ticks;
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+    struct page_buffer pages;
+
+    uint64_t faults_before = ReadOSPageFaultCount();
+    uint64_t start = GET_CPU_TICKS();
+    if (!page_alloc(&pages, ctx->buffer_size, ctx->huge_pages, ctx->populate)) {
+        MY_ERROR("page_alloc failed for size[%zu]\n", ctx->buffer_size);
+    }
+    pages.ptr[0] = 0x5a;
+    uint64_t first_byte_ticks = GET_CPU_TICKS() - start;
+    for (size_t offset=PAGE_SIZE; offset<ctx->buffer_size; offset+=PAGE_SIZE) {
+        pages.ptr[offset] = 0x5a;
+    }
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+    uint64_t faults_after = ReadOSPageFaultCount();
+
+    ctx->backing = pages.backing;
+    page_free(&pages);
+
+    ctx->faults = faults_after - faults_before;
+    printf("PageFaults: %" PRIu64 "", ctx->faults);
+
+    if (ctx->min_first_byte_ticks==0 || first_byte_ticks < ctx->min_first_byte_ticks) {
+        ctx->min_first_byte_ticks = first_byte_ticks;
+        printf(" | New Min FirstByte [%" PRIu64 "]Ticks", first_byte_ticks);
+        new_new_line = true;
+    }
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(ctx->buffer_size, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(ctx->buffer_size, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+
+    printf("[%s] name[%s] backing[%s] PageFaults[%" PRIu64 "]\n", __FUNCTION__, ctx->name,
+           page_backing_name(ctx->backing), ctx->faults);
+    printf("\n");
+
+    printf("[%s] Fastest FirstByte [%" PRIu64 "]Ticks [%" PRIu64 "]ms\n", __FUNCTION__,
+           ctx->min_first_byte_ticks, get_ms_from_cpu_ticks(ctx->min_first_byte_ticks));
+    printf("\n");
+
+    printf("[%s] Slowest Speed", __FUNCTION__);
+    print_data_speed(ctx->buffer_size, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Speed", __FUNCTION__);
+    print_data_speed(ctx->buffer_size, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+void usage(void) {
+    fprintf(stderr, "Page Faults 7 Usage:\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-n <mb>        Use a <mb> MB buffer. (defaults to 256MB)\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    size_t buffer_mb = 256;
+
+    printf("==================================\n");
+    printf("Page Faults 7: Huge Page Buffers\n");
+    printf("==================================\n");
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-n")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing buffer size parameter\n");
+                usage();
+                exit(1);
+            }
+            buffer_mb = strtoull(argv[index+1], NULL, 10);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            ++index;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "hn:t:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 'n':
+                buffer_mb = strtoull(optarg, NULL, 10);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    if (buffer_mb==0) {
+        fprintf(stderr, "ERROR invalid buffer size\n");
+        usage();
+        exit(1);
+    }
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Using buffer    [%zu]MB\n", buffer_mb);
+
+    struct test_context contexts[4] = {};
+    contexts[0].name = "Pages_4KB";
+    contexts[1].name = "Pages_4KB_populate";
+    contexts[1].populate = true;
+    contexts[2].name = "Pages_2MB";
+    contexts[2].huge_pages = true;
+    contexts[3].name = "Pages_2MB_populate";
+    contexts[3].huge_pages = true;
+    contexts[3].populate = true;
+
+    struct rep_tester_config tests[4] = {};
+    for (int i=0; i<4; i++) {
+        contexts[i].buffer_size = buffer_mb * 1024 * 1024;
+
+        tests[i].test_name = contexts[i].name;
+        tests[i].test_main = test_main;
+        tests[i].print_stats = print_stats;
+        tests[i].test_runtime_seconds = runtime;
+        tests[i].silent = true;
+        tests[i].context = &contexts[i];
+    }
+
+    printf("\n\n");
+
+    rep_tester_run(tests, 4);
+
+    printf("\n\n");
+
+
+    return 0;
+}
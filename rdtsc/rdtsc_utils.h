@@ -22,6 +22,9 @@
 #if 1
 // #ifdef PROFILER
 /*
+ * A block may be entered many times (e.g. once per loop iteration), ticks,
+ * children ticks and processed bytes accumulate over all the runs.
+ *
  * If we are in a recursive function:
  *      profile_index == index
  * Then do not modify data, let the outermost
@@ -35,7 +38,7 @@
         } else { \
             profile_data[index].name = block_name; \
             profile_data[index].start_rdtsc = GET_CPU_TICKS(); \
-            profile_data[index].processed_byte_count = byte_count; \
+            profile_data[index].processed_byte_count += byte_count; \
             if (profile_index != -1) { \
                 profile_data[index].parent_index = profile_index;\
             } else {\
@@ -50,12 +53,13 @@
 
 #define TAG_BLOCK_END(index) { \
         if (profile_data[index].recursive_count==0) { \
-            profile_data[index].total_ticks +=  GET_CPU_TICKS() - profile_data[index].start_rdtsc; \
+            uint64_t block_elapsed_ticks = GET_CPU_TICKS() - profile_data[index].start_rdtsc; \
+            profile_data[index].total_ticks += block_elapsed_ticks; \
             profile_data[index].count++; \
             profile_data[index].start_rdtsc = 0; \
             if (profile_data[index].parent_index != -1) { \
                 profile_index = profile_data[index].parent_index; \
-                profile_data[profile_index].children_ticks += profile_data[index].total_ticks; \
+                profile_data[profile_index].children_ticks += block_elapsed_ticks; \
             } else { \
                 profile_index = -1; \
             } \
@@ -65,6 +69,18 @@
 }
 #define TAG_FUNCTION_END(...)     TAG_BLOCK_END(__VA_ARGS__)
 
+/*
+ * Add ticks that were measured outside of the block macros, for example by
+ * a worker thread, to a top level block
+ */
+#define TAG_DATA_BLOCK_RECORD(index, block_name, ticks, byte_count) { \
+        profile_data[index].name = block_name; \
+        profile_data[index].parent_index = -1; \
+        profile_data[index].total_ticks += ticks; \
+        profile_data[index].processed_byte_count += byte_count; \
+        profile_data[index].count++; \
+}
+
 #else
 
 #define TAG_DATA_BLOCK_START(index, block_name, byte_count)     {}
@@ -73,6 +89,7 @@
 #define TAG_DATA_FUNCTION_START(index, byte_count)              {}
 #define TAG_BLOCK_END(index)                    {}
 #define TAG_FUNCTION_END(...)                   {}
+#define TAG_DATA_BLOCK_RECORD(index, block_name, ticks, byte_count)   {}
 
 #endif
 
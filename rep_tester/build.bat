@@ -20,10 +20,11 @@ echo ===================
 echo Compile Executables
 echo ===================
 :: Compile executables
-call cl /Zi /FC -I..\..\rdtsc\ ..\rep_test1.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\rep_test2.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\rep_test3.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
-call cl /Zi /FC -I..\..\rdtsc\ ..\rep_test4.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\rep_test1.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\rep_test2.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\rep_test3.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\rep_test4.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
+call cl /Zi /FC -I..\..\rdtsc\ -I..\..\mem_utils\ ..\rep_test5.c libreptester.lib ..\..\rdtsc\build\librdtsc_utils.lib ..\..\mem_utils\build\libmem_utils.lib || echo "Command Failed" && popd && exit /B
 
 echo.
 echo.
@@ -16,6 +16,7 @@
 
 #include "reptester.h"
 #include "rdtsc_utils.h"
+#include "page_alloc.h"
 
 #define MY_ERROR(...) {                 \
         fprintf(stderr, __VA_ARGS__);   \
@@ -27,6 +28,9 @@ struct test_context {
     char *filename;
     size_t filesize;
     uint8_t *buffer;
+    struct page_buffer pages;
+    bool huge_pages;
+    bool populate;
     FILE *fp;
     uint64_t min_cpu_ticks;
     uint64_t max_cpu_ticks;
@@ -50,12 +54,12 @@ void env_setup(void *context) {
 #endif
 
     ctx->filesize = statbuf.st_size;
-    ctx->buffer = malloc(ctx->filesize);
-
-    if (!ctx->buffer) {
-         MY_ERROR("Malloc failed for size[%zu]\n", ctx->filesize);
+    if (!page_alloc(&ctx->pages, ctx->filesize, ctx->huge_pages, ctx->populate)) {
+         MY_ERROR("page_alloc failed for size[%zu]\n", ctx->filesize);
     }
-    printf("[%s] Allocated Buffer              [%zu] bytes @ [%p]\n", __FUNCTION__, ctx->filesize, ctx->buffer);
+    ctx->buffer = ctx->pages.ptr;
+    printf("[%s] Allocated Buffer              [%zu] bytes @ [%p] [%s] pages\n", __FUNCTION__, ctx->filesize, ctx->buffer,
+           page_backing_name(ctx->pages.backing));
 
 #if _WIN32
     ctx->fp = fopen(ctx->filename, "rb");
@@ -74,7 +78,7 @@ void env_teardown(void *context) {
 
     fclose(ctx->fp);
 
-    free(ctx->buffer);
+    page_free(&ctx->pages);
     ctx->buffer = 0;
 }
 
@@ -156,12 +160,16 @@ void usage(void) {
     fprintf(stderr, "-h             This help dialog.\n");
     fprintf(stderr, "-i <filename>  Use <filename> as input.\n");
     fprintf(stderr, "-t <runtime>   Set runtime in seconds. (defaults to 10seconds)\n");
+    fprintf(stderr, "-H             Back the buffer with 2MB pages (MAP_HUGETLB, else MADV_HUGEPAGE).\n");
+    fprintf(stderr, "-P             Pre-fault the buffer when it is allocated (MAP_POPULATE).\n");
 }
 
 int main (int argc, char *argv[]) {
     int opt;
     char *filename = NULL;
     int runtime = 10;
+    bool huge_pages = false;
+    bool populate = false;
 
 #ifdef _WIN32
     for (int index=1; index<argc; ++index) {
@@ -188,10 +196,14 @@ int main (int argc, char *argv[]) {
             runtime = atoi(argv[index+1]);
             // since we consume the next parameter then skip it
             ++index;
+        } else if (strcmp(argv[index], "-H")==0) {
+            huge_pages = true;
+        } else if (strcmp(argv[index], "-P")==0) {
+            populate = true;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "hi:t:")) != -1) {
+    while( (opt = getopt(argc, argv, "hi:t:HP")) != -1) {
         switch (opt) {
             case 'h':
                 usage();
@@ -206,6 +218,14 @@ int main (int argc, char *argv[]) {
                 runtime = atoi(optarg);
                 break;
 
+            case 'H':
+                huge_pages = true;
+                break;
+
+            case 'P':
+                populate = true;
+                break;
+
             default:
                 fprintf(stderr, "MY_ERROR Invalid command line option\n");
                 usage();
@@ -226,6 +246,8 @@ int main (int argc, char *argv[]) {
 
     printf("Using filename  [%s]\n", filename);
     printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Huge pages      [%s]\n", huge_pages ? "True" : "False");
+    printf("Pre-fault       [%s]\n", populate ? "True" : "False");
 
     struct rep_tester_config foo = {};
     foo.env_setup = env_setup;
@@ -238,6 +260,8 @@ int main (int argc, char *argv[]) {
 
     struct test_context my_context = {};
     my_context.name = "FreadTest1";
+    my_context.huge_pages = huge_pages;
+    my_context.populate = populate;
     my_context.filename = filename;
 
 
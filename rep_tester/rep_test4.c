@@ -14,6 +14,7 @@
 
 #include "reptester.h"
 #include "rdtsc_utils.h"
+#include "page_alloc.h"
 
 #define MY_ERROR(...) {                    \
         fprintf(stderr, __VA_ARGS__);   \
@@ -24,6 +25,9 @@ struct test_context {
     char *name;
     size_t buffer_size;
     uint8_t *buffer;
+    struct page_buffer pages;
+    bool huge_pages;
+    bool populate;
     uint64_t min_cpu_ticks;
     uint64_t max_cpu_ticks;
 };
@@ -43,10 +47,10 @@ void env_teardown(void *context) {
 
 void test_setup(void *context) {
     struct test_context *ctx = (struct test_context *)context;
-    ctx->buffer = malloc(ctx->buffer_size);
-    if (!ctx->buffer) {
-         MY_ERROR("Malloc failed for size[%zu]\n", ctx->buffer_size);
+    if (!page_alloc(&ctx->pages, ctx->buffer_size, ctx->huge_pages, ctx->populate)) {
+         MY_ERROR("page_alloc failed for size[%zu]\n", ctx->buffer_size);
     }
+    ctx->buffer = ctx->pages.ptr;
 }
 
 void test_main(void *context) {
@@ -96,7 +100,7 @@ void test_main(void *context) {
 
 void test_teardown(void *context) {
     struct test_context *ctx = (struct test_context *)context;
-    free(ctx->buffer);
+    page_free(&ctx->pages);
     ctx->buffer = 0;
 }
 
@@ -122,11 +126,15 @@ void usage(void) {
     fprintf(stderr, "Rep Test 1 Usage:\n");
     fprintf(stderr, "-h             This help dialog.\n");
     fprintf(stderr, "-t <runtime>   Set runtime in seconds. (defaults to 10seconds)\n");
+    fprintf(stderr, "-H             Back the buffer with 2MB pages (MAP_HUGETLB, else MADV_HUGEPAGE).\n");
+    fprintf(stderr, "-P             Pre-fault the buffer when it is allocated (MAP_POPULATE).\n");
 }
 
 int main (int argc, char *argv[]) {
     int opt;
     int runtime = 10;
+    bool huge_pages = false;
+    bool populate = false;
 
 #ifdef _WIN32
     for (int index=1; index<argc; ++index) {
@@ -143,10 +151,14 @@ int main (int argc, char *argv[]) {
             runtime = atoi(argv[index+1]);
             // since we consume the next parameter then skip it
             ++index;
+        } else if (strcmp(argv[index], "-H")==0) {
+            huge_pages = true;
+        } else if (strcmp(argv[index], "-P")==0) {
+            populate = true;
         }
     }
 #else
-    while( (opt = getopt(argc, argv, "ht:")) != -1) {
+    while( (opt = getopt(argc, argv, "ht:HP")) != -1) {
         switch (opt) {
             case 'h':
                 usage();
@@ -157,6 +169,14 @@ int main (int argc, char *argv[]) {
                 runtime = atoi(optarg);
                 break;
 
+            case 'H':
+                huge_pages = true;
+                break;
+
+            case 'P':
+                populate = true;
+                break;
+
             default:
                 fprintf(stderr, "MY_ERROR Invalid command line option\n");
                 usage();
@@ -172,6 +192,8 @@ int main (int argc, char *argv[]) {
 
 
     printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Huge pages      [%s]\n", huge_pages ? "True" : "False");
+    printf("Pre-fault       [%s]\n", populate ? "True" : "False");
 
     struct rep_tester_config foo = {};
     foo.env_setup = env_setup;
@@ -184,6 +206,8 @@ int main (int argc, char *argv[]) {
 
     struct test_context my_context = {};
     my_context.name = "WriteTest_malloc";
+    my_context.huge_pages = huge_pages;
+    my_context.populate = populate;
 
 
     printf("\n\n");
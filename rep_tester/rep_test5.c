@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+
+#include "reptester.h"
+#include "rdtsc_utils.h"
+#include "arena.h"
+#include "page_alloc.h"
+
+#define MY_ERROR(...) {                 \
+        fprintf(stderr, __VA_ARGS__);   \
+        exit(1);                        \
+    }
+
+/*
+ * Build and walk the same set of haversine pairs the way json_data_parser
+ * stores them, to compare the cost of the storage itself:
+ * - malloc per node linked list (the original non -p path)
+ * - arena allocated linked list (the current non -p path)
+ * - preallocated array from page_alloc (the -p path)
+ */
+enum storage_mode_e {
+    STORAGE_MALLOC_LIST,
+    STORAGE_ARENA_LIST,
+    STORAGE_ARRAY,
+};
+
+struct data_item_s {
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+};
+
+struct list_item_s {
+    struct data_item_s data_item;
+    struct list_item_s *next_item;
+};
+
+struct test_context {
+    char *name;
+    enum storage_mode_e mode;
+    size_t item_count;
+    bool huge_pages;
+    struct list_item_s *list_head;
+    struct data_item_s *data_array;
+    struct page_buffer array_pages;
+    struct arena arena;
+    double sum;
+    uint64_t min_cpu_ticks;
+    uint64_t max_cpu_ticks;
+};
+
+void env_setup(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+
+    printf("[%s] name[%s] items[%zu]\n", __FUNCTION__, ctx->name, ctx->item_count);
+    if (ctx->mode == STORAGE_ARENA_LIST) {
+        arena_init(&ctx->arena, ARENA_DEFAULT_BLOCK_SIZE, ctx->huge_pages);
+    }
+}
+
+void env_teardown(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    if (ctx->mode == STORAGE_ARENA_LIST) {
+        printf("[%s] Arena used [%zu] blocks [%zu] bytes\n", __FUNCTION__, ctx->arena.block_count, ctx->arena.reserved_bytes);
+        arena_free(&ctx->arena);
+    }
+}
+
+void test_setup(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    ctx->list_head = NULL;
+    ctx->data_array = NULL;
+    ctx->sum = 0;
+}
+
+void test_main(void *context) {
+    bool new_new_line = false;
+    struct test_context *ctx = (struct test_context *)context;
+    struct list_item_s *list_tail = NULL;
+    double sum = 0;
+
+    uint64_t start = GET_CPU_TICKS();
+
+    // store all the items
+    if (ctx->mode == STORAGE_ARRAY) {
+        if (!page_alloc(&ctx->array_pages, ctx->item_count * sizeof(struct data_item_s), ctx->huge_pages, false)) {
+            MY_ERROR("page_alloc failed for size[%zu]\n", ctx->item_count * sizeof(struct data_item_s));
+        }
+        ctx->data_array = (struct data_item_s *)ctx->array_pages.ptr;
+    }
+    for (size_t i=0; i<ctx->item_count; i++) {
+        struct data_item_s row = {(double)i, (double)(i+1), (double)(i+2), (double)(i+3)};
+        if (ctx->mode == STORAGE_ARRAY) {
+            ctx->data_array[i] = row;
+            continue;
+        }
+        struct list_item_s *item;
+        if (ctx->mode == STORAGE_ARENA_LIST) {
+            item = arena_alloc(&ctx->arena, sizeof(struct list_item_s));
+        } else {
+            item = malloc(sizeof(struct list_item_s));
+        }
+        if (!item) {
+            MY_ERROR("Failed to allocate [%zu]bytes for item", sizeof(struct list_item_s));
+        }
+        item->data_item = row;
+        item->next_item = NULL;
+        if (!ctx->list_head) {
+            ctx->list_head = item;
+        } else {
+            list_tail->next_item = item;
+        }
+        list_tail = item;
+    }
+
+    // walk them
+    if (ctx->mode == STORAGE_ARRAY) {
+        for (size_t i=0; i<ctx->item_count; i++) {
+            struct data_item_s *item = &ctx->data_array[i];
+            sum += item->x0 + item->y0 + item->x1 + item->y1;
+        }
+    } else {
+        for (struct list_item_s *item = ctx->list_head; item; item = item->next_item) {
+            sum += item->data_item.x0 + item->data_item.y0 + item->data_item.x1 + item->data_item.y1;
+        }
+    }
+
+    // and release them
+    if (ctx->mode == STORAGE_ARRAY) {
+        page_free(&ctx->array_pages);
+    } else if (ctx->mode == STORAGE_ARENA_LIST) {
+        arena_reset(&ctx->arena);
+    } else {
+        struct list_item_s *item = ctx->list_head;
+        while (item) {
+            struct list_item_s *next = item->next_item;
+            free(item);
+            item = next;
+        }
+    }
+
+    uint64_t elapsed_ticks = GET_CPU_TICKS() - start;
+    ctx->sum = sum;
+
+    size_t data_size = ctx->item_count * sizeof(struct data_item_s);
+    if (ctx->min_cpu_ticks==0 || elapsed_ticks < ctx->min_cpu_ticks) {
+        ctx->min_cpu_ticks = elapsed_ticks;
+        printf(" | New MinTime");
+        print_data_speed(data_size, elapsed_ticks);
+        new_new_line = true;
+    }
+    if (elapsed_ticks > ctx->max_cpu_ticks) {
+        ctx->max_cpu_ticks = elapsed_ticks;
+        printf(" | New MaxTime");
+        print_data_speed(data_size, elapsed_ticks);
+        new_new_line = true;
+    }
+
+    if (new_new_line) {
+        printf("\n");
+    }
+}
+
+void test_teardown(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    ctx->list_head = NULL;
+    ctx->data_array = NULL;
+}
+
+
+void print_stats(void *context) {
+    struct test_context *ctx = (struct test_context *)context;
+    size_t data_size = ctx->item_count * sizeof(struct data_item_s);
+
+    printf("[%s] name[%s] sum[%.1f]\n", __FUNCTION__, ctx->name, ctx->sum);
+    printf("\n");
+
+    printf("[%s] Slowest Speed", __FUNCTION__);
+    print_data_speed(data_size, ctx->max_cpu_ticks);
+    printf("\n\n");
+
+    printf("[%s] Fastest Speed", __FUNCTION__);
+    print_data_speed(data_size, ctx->min_cpu_ticks);
+    printf("\n\n");
+}
+
+
+void usage(void) {
+    fprintf(stderr, "Rep Test 5 Usage:\n");
+    fprintf(stderr, "Compare malloc linked list, arena linked list and array storage of haversine pairs.\n");
+    fprintf(stderr, "-h             This help dialog.\n");
+    fprintf(stderr, "-t <runtime>   Set runtime in seconds per test. (defaults to 10seconds)\n");
+    fprintf(stderr, "-n <count>     Number of pairs to store. (defaults to 10000000)\n");
+    fprintf(stderr, "-H             Back the arena and the array with huge pages.\n");
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    int runtime = 10;
+    size_t item_count = 10000000;
+    bool huge_pages = false;
+
+#ifdef _WIN32
+    for (int index=1; index<argc; ++index) {
+        if (strcmp(argv[index], "-h")==0) {
+            usage();
+            exit(0);
+        } else if (strcmp(argv[index], "-t")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing runtime parameter\n");
+                usage();
+                exit(1);
+            }
+            runtime = atoi(argv[index+1]);
+            // since we consume the next parameter then skip it
+            ++index;
+        } else if (strcmp(argv[index], "-n")==0) {
+            if (argc<index+2) {
+                printf("ERROR: missing count parameter\n");
+                usage();
+                exit(1);
+            }
+            item_count = strtoull(argv[index+1], NULL, 10);
+            ++index;
+        } else if (strcmp(argv[index], "-H")==0) {
+            huge_pages = true;
+        }
+    }
+#else
+    while( (opt = getopt(argc, argv, "ht:n:H")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+
+            case 't':
+                runtime = atoi(optarg);
+                break;
+
+            case 'n':
+                item_count = strtoull(optarg, NULL, 10);
+                break;
+
+            case 'H':
+                huge_pages = true;
+                break;
+
+            default:
+                fprintf(stderr, "MY_ERROR Invalid command line option\n");
+                usage();
+                exit(1);
+                break;
+        }
+    }
+#endif
+
+    printf("==============\n");
+    printf("REP Test 5\n");
+    printf("==============\n");
+
+    printf("Using runtime   [%d]seconds\n", runtime);
+    printf("Using items     [%zu]\n", item_count);
+    printf("Huge pages      [%s]\n", huge_pages ? "True" : "False");
+
+    struct test_context contexts[3] = {};
+    contexts[0].name = "ListStorage_malloc";
+    contexts[0].mode = STORAGE_MALLOC_LIST;
+    contexts[1].name = "ListStorage_arena";
+    contexts[1].mode = STORAGE_ARENA_LIST;
+    contexts[2].name = "ArrayStorage";
+    contexts[2].mode = STORAGE_ARRAY;
+
+    struct rep_tester_config tests[3] = {};
+    for (int i=0; i<3; i++) {
+        contexts[i].item_count = item_count;
+        contexts[i].huge_pages = huge_pages;
+
+        tests[i].test_name = contexts[i].name;
+        tests[i].env_setup = env_setup;
+        tests[i].test_setup = test_setup;
+        tests[i].test_main = test_main;
+        tests[i].test_teardown = test_teardown;
+        tests[i].env_teardown = env_teardown;
+        tests[i].print_stats = print_stats;
+        tests[i].test_runtime_seconds = runtime;
+        tests[i].context = &contexts[i];
+    }
+
+    printf("\n\n");
+
+    rep_tester_run(tests, 3);
+
+    printf("\n\n");
+
+
+    return 0;
+}
@@ -19,6 +19,6 @@ struct rep_tester_config {
 };
 
 
+void rep_tester(struct rep_tester_config *test_info, void *context);
 void rep_tester_run(struct rep_tester_config test_info[], int count);
-void rep_tester_run(struct rep_tester_config *test_info, int count);
 